@@ -1,6 +1,8 @@
 #include "c_apq_server.h"
 #include "c_fhsl.h"
 #include "c_fhsl_b.h"
+#include "parking_lot.h"
+#include "thread_slots.h"
 
 #include <assert.h>
 #include <stdatomic.h>
@@ -11,24 +13,48 @@
 #include <pthread.h>
 
 typedef struct op_t op_t;
+typedef struct ring_t ring_t;
 typedef enum op_type op_type_t;
 
-enum op_type {CONTAINS, ADD, REMOVE, REMOVE_LEAKY, POP_MIN, POP_MIN_LEAKY, NONE};
+enum op_type {CONTAINS, ADD, REMOVE, REMOVE_LEAKY, POP_MIN, POP_MIN_LEAKY, PEEK_MIN, NONE};
 
 // Please forgive me...
+// The 8-byte members lead so the padding leaves op_t at exactly 128 bytes.
 struct op_t {
-  _Atomic(op_type_t) pending_op;
   union {
   _Atomic(int64_t) contains, add, remove;
   } op_arg;
+  // Value passed in by add, key and value passed back by pop_min.
+  struct {
+    _Atomic(int64_t) key, value;
+  } op_item;
+  _Atomic(op_type_t) pending_op;
+  // What the owner posted; NONE for an add answered at submit.
+  op_type_t posted_op;
   union{
-    atomic_bool contains, add, remove, pop_min;
+    atomic_bool contains, add, remove, pop_min, peek_min;
   } op_ret;
-  char padding[128 - (sizeof(_Atomic(op_type_t)) + sizeof(_Atomic(int64_t)) + sizeof(atomic_bool))];
+  char padding[128 - (2 * sizeof(op_type_t) + 3 * sizeof(_Atomic(int64_t)) + sizeof(atomic_bool))];
+};
+
+// Each thread owns a ring of depth op slots.  The owner posts at submitted
+// and completes in order at reaped; the server runs slots from served up to
+// submitted, so a thread's ops take effect in the order it posted them.
+struct ring_t {
+  _Atomic(uint64_t) submitted;
+  uint64_t reaped;
+  char padding1[128 - 2 * sizeof(uint64_t)];
+  // Only touched by the server thread.
+  uint64_t served;
+  char padding2[128 - sizeof(uint64_t)];
 };
 
 struct c_apq_server_t {
   op_t *pending_ops;
+  ring_t *rings;
+  size_t depth;
+  // The rings the server scans.
+  thread_slots_t *slots;
   char padding1[128];
   _Atomic(int64_t) cutoff_key;
   char padding2[128];
@@ -38,6 +64,9 @@ struct c_apq_server_t {
   c_fhsl_b_t *fc_set;
   c_fhsl_b_t *p_set;
   pthread_t server_thread;
+  // Set by destroy; the server thread returns once it sees it.
+  atomic_bool stop;
+  parking_lot_t *waiters;
 };
 
 
@@ -47,77 +76,205 @@ void c_apq_server_print (c_apq_server_t *set){
   c_fhsl_b_print(set->fc_set);
 }
 
+static void run_op(c_apq_server_t *apq, op_t *op) {
+  op_type_t type = atomic_load_explicit(&op->pending_op, memory_order_acquire);
+  if(type == CONTAINS) {
+    int64_t arg = atomic_load_explicit(&op->op_arg.contains, memory_order_relaxed);
+    bool ans = c_fhsl_b_contains_serial(apq->fc_set, arg);
+    atomic_store_explicit(&op->op_ret.contains, ans, memory_order_relaxed);
+  } else if(type == ADD) {
+    int64_t arg = atomic_load_explicit(&op->op_arg.add, memory_order_relaxed);
+    int64_t value = atomic_load_explicit(&op->op_item.value, memory_order_relaxed);
+    bool ans = c_fhsl_b_add_serial_item(&apq->seed, apq->fc_set, arg, value);
+    if(ans) { apq->fc_size++; }
+    atomic_store_explicit(&op->op_ret.add, ans, memory_order_relaxed);
+  } else if(type == REMOVE) {
+    int64_t arg = atomic_load_explicit(&op->op_arg.remove, memory_order_relaxed);
+    bool ans = c_fhsl_b_remove_serial(apq->fc_set, arg);
+    atomic_store_explicit(&op->op_ret.remove, ans, memory_order_relaxed);
+  } else if(type == REMOVE_LEAKY) {
+    int64_t arg = atomic_load_explicit(&op->op_arg.remove, memory_order_relaxed);
+    bool ans = c_fhsl_b_remove_leaky_serial(apq->fc_set, arg);
+    atomic_store_explicit(&op->op_ret.remove, ans, memory_order_relaxed);
+  } else if(type == POP_MIN_LEAKY) {
+    int64_t key = 0, value = 0;
+    bool ans = c_fhsl_b_pop_min_leaky_serial_item(apq->fc_set, &key, &value);
+    if(ans) { apq->fc_size--; }
+    atomic_store_explicit(&op->op_item.key, key, memory_order_relaxed);
+    atomic_store_explicit(&op->op_item.value, value, memory_order_relaxed);
+    atomic_store_explicit(&op->op_ret.pop_min, ans, memory_order_relaxed);
+  } else if(type == POP_MIN) {
+    int64_t key = 0, value = 0;
+    bool ans = c_fhsl_b_pop_min_serial_item(apq->fc_set, &key, &value);
+    if(ans) { apq->fc_size--; }
+    atomic_store_explicit(&op->op_item.key, key, memory_order_relaxed);
+    atomic_store_explicit(&op->op_item.value, value, memory_order_relaxed);
+    atomic_store_explicit(&op->op_ret.pop_min, ans, memory_order_relaxed);
+  } else if(type == PEEK_MIN) {
+    // Every key in the serial list is below the cutoff, and so below
+    // every key in the parallel list.
+    int64_t key = 0, value = 0;
+    bool ans = c_fhsl_b_peek_min_serial(apq->fc_set, &key, &value)
+      || c_fhsl_b_peek_min(apq->p_set, &key, &value);
+    atomic_store_explicit(&op->op_item.key, key, memory_order_relaxed);
+    atomic_store_explicit(&op->op_item.value, value, memory_order_relaxed);
+    atomic_store_explicit(&op->op_ret.peek_min, ans, memory_order_relaxed);
+  } else {
+    return;
+  }
+  atomic_store_explicit(&op->pending_op, NONE, memory_order_release);
+}
+
+static op_t *slot(c_apq_server_t *set, size_t thread_id, uint64_t seq) {
+  return &set->pending_ops[thread_id * set->depth + seq % set->depth];
+}
+
+static void serve(c_apq_server_t *apq, size_t thread_id) {
+  ring_t *ring = &apq->rings[thread_id];
+  uint64_t submitted = atomic_load_explicit(&ring->submitted, memory_order_acquire);
+  for(; ring->served < submitted; ring->served++) {
+    run_op(apq, slot(apq, thread_id, ring->served));
+  }
+}
+
 static void* server_thread_func(void *set) {
   c_apq_server_t* apq = set;
-  size_t num_threads = apq->num_threads;
-  while(true) {
-    for(size_t i = 0; i < num_threads; i++) {
-      op_type_t op = atomic_load_explicit(&apq->pending_ops[i].pending_op, memory_order_acquire);
-      if(op == NONE) {
-        continue;
-      } else if(op == CONTAINS) {
-        int64_t arg = atomic_load_explicit(&apq->pending_ops[i].op_arg.contains, memory_order_relaxed);
-        bool ans = c_fhsl_b_contains_serial(apq->fc_set, arg);
-        atomic_store_explicit(&apq->pending_ops[i].op_ret.contains, ans, memory_order_relaxed);
-        atomic_store_explicit(&apq->pending_ops[i].pending_op, NONE, memory_order_release);
-      } else if(op == ADD) {
-        int64_t arg = atomic_load_explicit(&apq->pending_ops[i].op_arg.add, memory_order_relaxed);
-        bool ans = c_fhsl_b_add_serial(&apq->seed, apq->fc_set, arg);
-        if(ans) { apq->fc_size++; }
-        atomic_store_explicit(&apq->pending_ops[i].op_ret.add, ans, memory_order_relaxed);
-        atomic_store_explicit(&apq->pending_ops[i].pending_op, NONE, memory_order_release);
-      } else if(op == REMOVE) {
-        int64_t arg = atomic_load_explicit(&apq->pending_ops[i].op_arg.remove, memory_order_relaxed);
-        bool ans = c_fhsl_b_remove_serial(apq->fc_set, arg);
-        atomic_store_explicit(&apq->pending_ops[i].op_ret.remove, ans, memory_order_relaxed);
-        atomic_store_explicit(&apq->pending_ops[i].pending_op, NONE, memory_order_release);
-      } else if(op == REMOVE_LEAKY) {
-        int64_t arg = atomic_load_explicit(&apq->pending_ops[i].op_arg.remove, memory_order_relaxed);
-        bool ans = c_fhsl_b_remove_leaky_serial(apq->fc_set, arg);
-        atomic_store_explicit(&apq->pending_ops[i].op_ret.remove, ans, memory_order_relaxed);
-        atomic_store_explicit(&apq->pending_ops[i].pending_op, NONE, memory_order_release);
-      } else if(op == POP_MIN_LEAKY) {
-        bool ans = c_fhsl_b_pop_min_leaky_serial(apq->fc_set);
-        if(ans) { apq->fc_size--; }
-        atomic_store_explicit(&apq->pending_ops[i].op_ret.pop_min, ans, memory_order_relaxed);
-        atomic_store_explicit(&apq->pending_ops[i].pending_op, NONE, memory_order_release);
-      } else if(op == POP_MIN) {
-        bool ans = c_fhsl_b_pop_min_serial(apq->fc_set);
-        if(ans) { apq->fc_size--; }
-        atomic_store_explicit(&apq->pending_ops[i].op_ret.pop_min, ans, memory_order_relaxed);
-        atomic_store_explicit(&apq->pending_ops[i].pending_op, NONE, memory_order_release);
+  size_t words = thread_slots_words(apq->slots);
+  while(!atomic_load_explicit(&apq->stop, memory_order_acquire)) {
+    // Only registered slots can hold an op.
+    for(size_t w = 0; w < words; w++) {
+      uint64_t bits = thread_slots_word(apq->slots, w);
+      for(; bits != 0; bits &= bits - 1) {
+        serve(apq, w * 64 + __builtin_ctzll(bits));
       }
     }
     if(apq->fc_size < apq->fc_size_threshold) {
       // Try take nodes from parallel skiplist.
       size_t transfer_count = apq->fc_transfer_amount;
       node_ptr head = NULL, tail = NULL;
-      size_t approx_seen = c_fhsl_b_bulk_pop(apq->p_set, transfer_count, &head, &tail);
+      size_t moved = c_fhsl_b_bulk_pop(apq->p_set, transfer_count, &head, &tail);
       // Reintegrate nodes into serial list.
       if(head != NULL && tail != NULL) {
-        c_fhsl_b_bulk_push(apq->fc_set, head, tail);
-        apq->fc_size += approx_seen;
+        c_fhsl_b_bulk_push(apq->fc_set, head, tail, moved);
+        apq->fc_size += moved;
         atomic_store_explicit(&apq->cutoff_key, tail->key, memory_order_relaxed);
+        // A waiter may have parked on an empty serial list while these sat
+        // in the parallel one.
+        parking_lot_wake(apq->waiters);
       }
     }
     _mm_pause();
   }
+  return NULL;
+}
+
+static bool done(op_t *op) {
+  return atomic_load_explicit(&op->pending_op, memory_order_acquire) == NONE;
+}
+
+static void wait(op_t *op) {
+  while(!done(op)) { _mm_pause(); }
+}
+
+/** Return the next free slot in the thread's ring, or NULL if all depth
+ *  slots hold ops that have not been completed.
+ */
+static op_t *next_slot(c_apq_server_t *set, size_t thread_id) {
+  ring_t *ring = &set->rings[thread_id];
+  uint64_t submitted = atomic_load_explicit(&ring->submitted, memory_order_relaxed);
+  if(submitted - ring->reaped == set->depth) {
+    return NULL;
+  }
+  return slot(set, thread_id, submitted);
+}
+
+static void post(c_apq_server_t *set, op_t *op, op_type_t type, size_t thread_id) {
+  op->posted_op = type;
+  atomic_store_explicit(&op->pending_op, type, memory_order_release);
+  atomic_fetch_add_explicit(&set->rings[thread_id].submitted, 1, memory_order_release);
+}
+
+/** Take the result of the thread's oldest op, which must have run, and
+ *  free its slot.  Return the op's answer.
+ */
+static bool reap(c_apq_server_t *set, int64_t *key, int64_t *value, size_t thread_id) {
+  ring_t *ring = &set->rings[thread_id];
+  op_t *op = slot(set, thread_id, ring->reaped);
+  bool ans = false;
+  switch(op->posted_op) {
+  case CONTAINS:
+    ans = atomic_load_explicit(&op->op_ret.contains, memory_order_relaxed);
+    break;
+  case ADD:
+    ans = atomic_load_explicit(&op->op_ret.add, memory_order_relaxed);
+    if(ans) { parking_lot_wake(set->waiters); }
+    break;
+  case NONE:
+    // An add to the parallel list, which already woke any waiters.
+    ans = atomic_load_explicit(&op->op_ret.add, memory_order_relaxed);
+    break;
+  case REMOVE:
+  case REMOVE_LEAKY:
+    ans = atomic_load_explicit(&op->op_ret.remove, memory_order_relaxed);
+    break;
+  case POP_MIN:
+  case POP_MIN_LEAKY:
+    ans = atomic_load_explicit(&op->op_ret.pop_min, memory_order_relaxed);
+    break;
+  case PEEK_MIN:
+    ans = atomic_load_explicit(&op->op_ret.peek_min, memory_order_relaxed);
+    break;
+  }
+  if(ans && (op->posted_op == POP_MIN || op->posted_op == POP_MIN_LEAKY || op->posted_op == PEEK_MIN)) {
+    *key = atomic_load_explicit(&op->op_item.key, memory_order_relaxed);
+    *value = atomic_load_explicit(&op->op_item.value, memory_order_relaxed);
+  }
+  ring->reaped++;
+  return ans;
+}
+
+/** Return the slot for a blocking call, or NULL if the thread still has
+ *  submitted ops outstanding.  reap takes the oldest slot's answer, so a
+ *  blocking call posted behind other ops would be handed one of theirs.
+ *  With the ring idle there is always a free slot.
+ */
+static op_t *call_slot(c_apq_server_t *set, size_t thread_id) {
+  ring_t *ring = &set->rings[thread_id];
+  bool idle = ring->reaped == atomic_load_explicit(&ring->submitted, memory_order_relaxed);
+  assert(idle);
+  return idle ? slot(set, thread_id, ring->reaped) : NULL;
 }
 
-static void wait(c_apq_server_t *set, size_t thread_id) {
-  while(atomic_load_explicit(&set->pending_ops[thread_id].pending_op, memory_order_acquire) != NONE) { _mm_pause(); }
+/** Post one op and wait for the server to run it.  op is from call_slot.
+ */
+static bool call(c_apq_server_t *set, op_t *op, op_type_t type, int64_t *key, int64_t *value, size_t thread_id) {
+  post(set, op, type, thread_id);
+  wait(op);
+  return reap(set, key, value, thread_id);
 }
 
 /** Return a new fixed-height skip list.
  */
 c_apq_server_t * c_apq_server_create(size_t num_threads, int64_t cutoff_key) {
+  return c_apq_server_create_async(num_threads, cutoff_key, 1);
+}
+
+static c_apq_server_t * create(size_t num_threads, int64_t cutoff_key, size_t depth, size_t registered) {
   c_apq_server_t* apq = forkscan_malloc(sizeof(c_apq_server_t));
   apq->num_threads = num_threads;
-  apq->pending_ops = forkscan_malloc(sizeof(op_t) * num_threads);
-  for(size_t i = 0; i < num_threads; i++) {
+  apq->depth = depth;
+  apq->pending_ops = forkscan_malloc(sizeof(op_t) * num_threads * depth);
+  for(size_t i = 0; i < num_threads * depth; i++) {
     atomic_store_explicit(&apq->pending_ops[i].pending_op, NONE, memory_order_relaxed); // Important, rest is not.
     atomic_store_explicit(&apq->pending_ops[i].op_arg.contains, UINT64_MAX, memory_order_relaxed);
     atomic_store_explicit(&apq->pending_ops[i].op_ret.contains, false, memory_order_relaxed);
+    apq->pending_ops[i].posted_op = NONE;
+  }
+  apq->rings = forkscan_malloc(sizeof(ring_t) * num_threads);
+  for(size_t i = 0; i < num_threads; i++) {
+    atomic_store_explicit(&apq->rings[i].submitted, 0, memory_order_relaxed);
+    apq->rings[i].reaped = 0;
+    apq->rings[i].served = 0;
   }
   apq->seed = time(NULL);
   atomic_store_explicit(&apq->cutoff_key, cutoff_key, memory_order_relaxed);
@@ -127,33 +284,215 @@ c_apq_server_t * c_apq_server_create(size_t num_threads, int64_t cutoff_key) {
   apq->fc_transfer_amount = apq->fc_size_threshold;
   apq->fc_set = c_fhsl_b_create();
   apq->p_set = c_fhsl_b_create();
+  apq->waiters = parking_lot_create();
+  apq->slots = thread_slots_create(num_threads, registered);
+  atomic_store_explicit(&apq->stop, false, memory_order_relaxed);
   pthread_create(&apq->server_thread, NULL, server_thread_func, apq);
   return apq;
 }
 
+/** Return a new queue in which each thread may have up to depth submitted
+ *  ops outstanding.  Threads 0 to num_threads - 1 are all registered.
+ */
+c_apq_server_t * c_apq_server_create_async(size_t num_threads, int64_t cutoff_key, size_t depth) {
+  return create(num_threads, cutoff_key, depth, num_threads);
+}
+
+/** Return a new queue with room for max_threads threads, none of them
+ *  registered.  Each thread takes its id from c_apq_server_register.
+ */
+c_apq_server_t * c_apq_server_create_dynamic(size_t max_threads, int64_t cutoff_key, size_t depth) {
+  return create(max_threads, cutoff_key, depth, 0);
+}
+
+/** Take a free thread slot and return its id, or SIZE_MAX if all are in
+ *  use.  The server scans only registered slots.
+ */
+size_t c_apq_server_register(c_apq_server_t *set) {
+  return thread_slots_register(set->slots);
+}
+
+/** Hand back the slot of a thread that is done with the queue.  Every op
+ *  the thread submitted must have been completed.
+ */
+void c_apq_server_unregister(c_apq_server_t *set, size_t thread_id) {
+  ring_t *ring = &set->rings[thread_id];
+  assert(ring->reaped == atomic_load_explicit(&ring->submitted, memory_order_relaxed));
+  (void)ring;
+  thread_slots_unregister(set->slots, thread_id);
+}
+
 /** Add a node to the skiplist.
  */
 int c_apq_server_add(uint64_t *seed, c_apq_server_t *set, int64_t key, size_t thread_id) {
+  return c_apq_server_add_item(seed, set, key, 0, thread_id);
+}
+
+/** Add a node carrying a value to the skiplist.
+ */
+int c_apq_server_add_item(uint64_t *seed, c_apq_server_t *set, int64_t key, int64_t value, size_t thread_id) {
   int64_t cutoff_key = atomic_load_explicit(&set->cutoff_key, memory_order_relaxed);
+  bool ans;
   if(key < cutoff_key) {
-    atomic_store_explicit(&set->pending_ops[thread_id].op_arg.add, key, memory_order_relaxed);
-    atomic_store_explicit(&set->pending_ops[thread_id].pending_op, ADD, memory_order_release);
-    wait(set, thread_id);
-    return atomic_load_explicit(&set->pending_ops[thread_id].op_ret.add, memory_order_relaxed);
-  } else {
-    return c_fhsl_b_add(seed, set->p_set, key);
+    op_t *op = call_slot(set, thread_id);
+    if(op == NULL) { return false; }
+    int64_t k, v;
+    atomic_store_explicit(&op->op_arg.add, key, memory_order_relaxed);
+    atomic_store_explicit(&op->op_item.value, value, memory_order_relaxed);
+    return call(set, op, ADD, &k, &v, thread_id);
   }
+  ans = c_fhsl_b_add_item(seed, set->p_set, key, value);
+  if(ans) { parking_lot_wake(set->waiters); }
+  return ans;
 }
 
+static int pop_min_item(c_apq_server_t *set, op_type_t type, int64_t *key, int64_t *value, size_t thread_id) {
+  op_t *op = call_slot(set, thread_id);
+  if(op == NULL) { return false; }
+  return call(set, op, type, key, value, thread_id);
+}
 
 int c_apq_server_pop_min_leaky(c_apq_server_t *set, size_t thread_id) {
-  atomic_store_explicit(&set->pending_ops[thread_id].pending_op, POP_MIN_LEAKY, memory_order_release);
-  wait(set, thread_id);
-  return atomic_load_explicit(&set->pending_ops[thread_id].op_ret.pop_min, memory_order_relaxed);
+  int64_t key, value;
+  return pop_min_item(set, POP_MIN_LEAKY, &key, &value, thread_id);
 }
 
 int c_apq_server_pop_min(c_apq_server_t *set, size_t thread_id) {
-  atomic_store_explicit(&set->pending_ops[thread_id].pending_op, POP_MIN, memory_order_release);
-  wait(set, thread_id);
-  return atomic_load_explicit(&set->pending_ops[thread_id].op_ret.pop_min, memory_order_relaxed);
+  int64_t key, value;
+  return pop_min_item(set, POP_MIN, &key, &value, thread_id);
+}
+
+/** Pop the front node from the skiplist and store its key and value.
+ *  Return true iff there was a node to pop.  Leak the memory.
+ */
+int c_apq_server_pop_min_leaky_item(c_apq_server_t *set, int64_t *key, int64_t *value, size_t thread_id) {
+  return pop_min_item(set, POP_MIN_LEAKY, key, value, thread_id);
+}
+
+/** Pop the front node from the skiplist and store its key and value.
+ *  Return true iff there was a node to pop.
+ */
+int c_apq_server_pop_min_item(c_apq_server_t *set, int64_t *key, int64_t *value, size_t thread_id) {
+  return pop_min_item(set, POP_MIN, key, value, thread_id);
+}
+
+typedef struct wait_ctx_t {
+  c_apq_server_t *set;
+  size_t thread_id;
+} wait_ctx_t;
+
+static int try_pop_min(void *ctx, void *key, int64_t *value) {
+  wait_ctx_t *wait = ctx;
+  return pop_min_item(wait->set, POP_MIN, key, value, wait->thread_id);
+}
+
+/** Pop the front node, waiting up to timeout_ns nanoseconds for one to
+ *  arrive if the queue is empty; a negative timeout waits forever.  Return
+ *  false on timeout.  Adds and the server's transfers out of the parallel
+ *  list both wake parked threads.
+ */
+int c_apq_server_pop_min_wait(c_apq_server_t *set, int64_t *key, int64_t *value, int64_t timeout_ns, size_t thread_id) {
+  wait_ctx_t wait = { set, thread_id };
+  return parking_lot_wait(set->waiters, try_pop_min, &wait, key, value, timeout_ns);
+}
+
+/** Store the key and value of the smallest node without removing it.
+ *  Return true iff there was one.  The server answers from the front of the
+ *  serial list, or of the parallel list when the serial one is empty.  The
+ *  serial answer is linearizable; the parallel one is exact only at
+ *  quiescence, and a batch on its way between the lists is missed.
+ */
+int c_apq_server_peek_min(c_apq_server_t *set, int64_t *key, int64_t *value, size_t thread_id) {
+  op_t *op = call_slot(set, thread_id);
+  if(op == NULL) { return false; }
+  return call(set, op, PEEK_MIN, key, value, thread_id);
+}
+
+/** Post an add without waiting for it to run.  Return false, posting
+ *  nothing, if the thread already has depth ops outstanding.  A key at or
+ *  above the cutoff goes straight into the parallel list, as in
+ *  c_apq_server_add_item, and its slot is complete on return.  Submitted
+ *  ops are completed in the order they were posted.
+ */
+int c_apq_server_submit_add(uint64_t *seed, c_apq_server_t *set, int64_t key, int64_t value, size_t thread_id) {
+  op_t *op = next_slot(set, thread_id);
+  if(op == NULL) { return false; }
+  if(key < atomic_load_explicit(&set->cutoff_key, memory_order_relaxed)) {
+    atomic_store_explicit(&op->op_arg.add, key, memory_order_relaxed);
+    atomic_store_explicit(&op->op_item.value, value, memory_order_relaxed);
+    post(set, op, ADD, thread_id);
+    return true;
+  }
+  bool ans = c_fhsl_b_add_item(seed, set->p_set, key, value);
+  if(ans) { parking_lot_wake(set->waiters); }
+  atomic_store_explicit(&op->op_ret.add, ans, memory_order_relaxed);
+  post(set, op, NONE, thread_id);
+  return true;
+}
+
+/** Post a pop_min without waiting for it to run.  Return false if the ring
+ *  is full.
+ */
+int c_apq_server_submit_pop_min(c_apq_server_t *set, size_t thread_id) {
+  op_t *op = next_slot(set, thread_id);
+  if(op == NULL) { return false; }
+  post(set, op, POP_MIN, thread_id);
+  return true;
+}
+
+/** Post a pop_min that leaks the node.  Return false if the ring is full.
+ */
+int c_apq_server_submit_pop_min_leaky(c_apq_server_t *set, size_t thread_id) {
+  op_t *op = next_slot(set, thread_id);
+  if(op == NULL) { return false; }
+  post(set, op, POP_MIN_LEAKY, thread_id);
+  return true;
+}
+
+/** If the thread's oldest submitted op has run, store its answer (and, for
+ *  a successful pop_min, the key and value) and return true.  Return false
+ *  if the op is still pending or nothing is outstanding.
+ */
+int c_apq_server_poll(c_apq_server_t *set, int *ans, int64_t *key, int64_t *value, size_t thread_id) {
+  ring_t *ring = &set->rings[thread_id];
+  if(ring->reaped == atomic_load_explicit(&ring->submitted, memory_order_relaxed)
+     || !done(slot(set, thread_id, ring->reaped))) {
+    return false;
+  }
+  *ans = reap(set, key, value, thread_id);
+  return true;
+}
+
+/** Wait for the thread's oldest submitted op to run, then return its answer
+ *  and, for a successful pop_min, store the key and value.  The thread must
+ *  have an op outstanding.
+ */
+int c_apq_server_complete(c_apq_server_t *set, int64_t *key, int64_t *value, size_t thread_id) {
+  ring_t *ring = &set->rings[thread_id];
+  assert(ring->reaped != atomic_load_explicit(&ring->submitted, memory_order_relaxed));
+  wait(slot(set, thread_id, ring->reaped));
+  return reap(set, key, value, thread_id);
+}
+
+/** Return the approximate number of nodes in both lists, each summed from
+ *  its per-thread shards without asking the server.  Exact only at
+ *  quiescence; a batch on its way between the lists is missed.
+ */
+size_t c_apq_server_size(c_apq_server_t *set) {
+  return c_fhsl_b_size(set->fc_set) + c_fhsl_b_size(set->p_set);
+}
+
+/** Stop and join the server thread, then free the queue and both of its
+ *  lists.  No other thread may be using the queue.
+ */
+void c_apq_server_destroy(c_apq_server_t *set) {
+  atomic_store_explicit(&set->stop, true, memory_order_release);
+  pthread_join(set->server_thread, NULL);
+  c_fhsl_b_destroy(set->fc_set);
+  c_fhsl_b_destroy(set->p_set);
+  parking_lot_destroy(set->waiters);
+  thread_slots_destroy(set->slots);
+  forkscan_free(set->pending_ops);
+  forkscan_free(set->rings);
+  forkscan_free(set);
 }
\ No newline at end of file
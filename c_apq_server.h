@@ -6,8 +6,24 @@
 typedef struct c_apq_server_t c_apq_server_t;
 
 c_apq_server_t * c_apq_server_create(size_t num_threads, int64_t cutoff_key);
+c_apq_server_t * c_apq_server_create_async(size_t num_threads, int64_t cutoff_key, size_t depth);
+c_apq_server_t * c_apq_server_create_dynamic(size_t max_threads, int64_t cutoff_key, size_t depth);
+size_t c_apq_server_register(c_apq_server_t *set);
+void c_apq_server_unregister(c_apq_server_t *set, size_t thread_id);
 
 int c_apq_server_add(uint64_t *seed, c_apq_server_t * set, int64_t key, size_t thread_id);
+int c_apq_server_add_item(uint64_t *seed, c_apq_server_t * set, int64_t key, int64_t value, size_t thread_id);
 int c_apq_server_pop_min_leaky(c_apq_server_t *set, size_t thread_id);
 int c_apq_server_pop_min(c_apq_server_t *set, size_t thread_id);
+int c_apq_server_pop_min_leaky_item(c_apq_server_t *set, int64_t *key, int64_t *value, size_t thread_id);
+int c_apq_server_pop_min_item(c_apq_server_t *set, int64_t *key, int64_t *value, size_t thread_id);
+int c_apq_server_pop_min_wait(c_apq_server_t *set, int64_t *key, int64_t *value, int64_t timeout_ns, size_t thread_id);
+int c_apq_server_peek_min(c_apq_server_t *set, int64_t *key, int64_t *value, size_t thread_id);
+int c_apq_server_submit_add(uint64_t *seed, c_apq_server_t *set, int64_t key, int64_t value, size_t thread_id);
+int c_apq_server_submit_pop_min(c_apq_server_t *set, size_t thread_id);
+int c_apq_server_submit_pop_min_leaky(c_apq_server_t *set, size_t thread_id);
+int c_apq_server_poll(c_apq_server_t *set, int *ans, int64_t *key, int64_t *value, size_t thread_id);
+int c_apq_server_complete(c_apq_server_t *set, int64_t *key, int64_t *value, size_t thread_id);
+size_t c_apq_server_size(c_apq_server_t *set);
+void c_apq_server_destroy(c_apq_server_t *set);
 void c_apq_server_print (c_apq_server_t *set);
\ No newline at end of file
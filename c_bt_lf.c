@@ -268,3 +268,25 @@ int c_bt_lf_remove_leaky(c_bt_lf_t * set, int64_t key) {
         }
     }
 }
+
+/** Free the tree and every node reachable from its root.  Removes leak
+ *  what they unlink, so nothing reachable has been freed.  Left children
+ *  are rotated up as the walk goes, so it needs no stack however
+ *  unbalanced the tree is.  No other thread may be using the tree.
+ */
+void c_bt_lf_destroy(c_bt_lf_t *set) {
+    node_ptr node = set->R;
+    while(node != NULL) {
+        node_ptr left = node_address(node->left);
+        if(left != NULL) {
+            node->left = left->right;
+            left->right = node;
+            node = left;
+        } else {
+            node_ptr right = node_address(node->right);
+            forkscan_free((void *)node);
+            node = right;
+        }
+    }
+    forkscan_free(set);
+}
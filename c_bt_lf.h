@@ -15,4 +15,5 @@ c_bt_lf_t * c_bt_lf_create();
 
 int c_bt_lf_contains(c_bt_lf_t * set, int64_t key);
 int c_bt_lf_add(c_bt_lf_t * set, int64_t key);
-int c_bt_lf_remove_leaky(c_bt_lf_t * set, int64_t key);
\ No newline at end of file
+int c_bt_lf_remove_leaky(c_bt_lf_t * set, int64_t key);
+void c_bt_lf_destroy(c_bt_lf_t * set);
\ No newline at end of file
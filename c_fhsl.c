@@ -3,6 +3,7 @@
  */
 
 #include "c_fhsl.h"
+#include "node_pool.h"
 #include "utils.h"
 
 #include <assert.h>
@@ -15,32 +16,53 @@
 typedef struct node_t node_t;
 typedef node_t* node_ptr;
 
-#define N 20
+#define N SKIPLIST_HEIGHT
 #define BOTTOM 0
 
 struct node_t {
   int64_t key;
+  int64_t value;
   int32_t toplevel;
-  node_ptr next[N];
+  // Sized to toplevel + 1 by node_create.
+  node_ptr next[];
 };
 
 struct c_fhsl_t {
-  node_t head, tail;
+  node_ptr head, tail;
+  // Highest level any node has been linked at; searches start there.
+  int32_t toplevel;
   uint64_t seed;
 };
 
-static node_ptr node_create(int64_t key, int32_t toplevel){
-  node_ptr node = forkscan_malloc(sizeof(node_t));
+/** Return the bytes a node with a tower toplevel + 1 high takes.
+ */
+static size_t node_size(int32_t toplevel) {
+  return sizeof(node_t) + (toplevel + 1) * sizeof(node_ptr);
+}
+
+/** Allocate a node with a tower of toplevel + 1 links.
+ */
+static node_ptr node_create(int64_t key, int64_t value, int32_t toplevel){
+  node_ptr node = node_pool_alloc(node_size(toplevel));
   node->key = key;
+  node->value = value;
   node->toplevel = toplevel;
   return node;
 }
 
+/** Hand a node no other thread can reach back to the node pool.
+ */
+static void node_free(node_ptr node) {
+  if(node != NULL) {
+    node_pool_free(node, node_size(node->toplevel));
+  }
+}
+
 /** Print out the contents of the skip list along with node heights.
  */
 void c_fhsl_print (c_fhsl_t *set){
-  node_ptr node = set->head.next[BOTTOM];
-  while(node != &set->tail) {
+  node_ptr node = set->head->next[BOTTOM];
+  while(node != set->tail) {
     node_ptr next = node->next[BOTTOM];
     printf("node[%d]: %ld\n", node->toplevel, node->key);
     node = next;
@@ -51,12 +73,13 @@ void c_fhsl_print (c_fhsl_t *set){
  */
 c_fhsl_t * c_fhsl_create() {
   c_fhsl_t* fhsl = forkscan_malloc(sizeof(c_fhsl_t));
-  fhsl->head.key = INT64_MIN;
-  fhsl->tail.key = INT64_MAX;
+  fhsl->head = node_create(INT64_MIN, 0, N - 1);
+  fhsl->tail = node_create(INT64_MAX, 0, N - 1);
   for(int64_t i = 0; i < N; i++) {
-    fhsl->head.next[i] = &fhsl->tail;
-    fhsl->tail.next[i] = NULL;
+    fhsl->head->next[i] = fhsl->tail;
+    fhsl->tail->next[i] = NULL;
   }
+  fhsl->toplevel = 0;
   fhsl->seed = time(NULL);
   return fhsl;
 }
@@ -64,8 +87,8 @@ c_fhsl_t * c_fhsl_create() {
 /** Return whether the skip list contains the value.
  */
 int c_fhsl_contains(c_fhsl_t *set, int64_t key) {
-  node_ptr node = &set->head;
-  for(int64_t i = N - 1; i >= 0; i--) {
+  node_ptr node = set->head;
+  for(int64_t i = set->toplevel; i >= 0; i--) {
     node_ptr next = node->next[i];
     while(next->key <= key) {
       node = next; 
@@ -80,8 +103,13 @@ int c_fhsl_contains(c_fhsl_t *set, int64_t key) {
 
 static bool find(c_fhsl_t *set, int64_t key, 
   node_ptr preds[N], node_ptr succs[N]) {
-  node_ptr left = &set->head, right = left;
-  for(int64_t level = N - 1; level >= BOTTOM; --level) {
+  node_ptr left = set->head, right = left;
+  // Nothing is linked above the top level.
+  for(int64_t level = N - 1; level > set->toplevel; --level) {
+    preds[level] = set->head;
+    succs[level] = set->tail;
+  }
+  for(int64_t level = set->toplevel; level >= BOTTOM; --level) {
     right = left->next[level];
     // Has the right not gone far enough?        
     while(right->key < key) {
@@ -97,17 +125,24 @@ static bool find(c_fhsl_t *set, int64_t key,
 /** Add a node to the skiplist.
  */
 int c_fhsl_add(c_fhsl_t * set, int64_t key) {
+  return c_fhsl_add_item(set, key, 0);
+}
+
+/** Add a node carrying a value to the skiplist.
+ */
+int c_fhsl_add_item(c_fhsl_t * set, int64_t key, int64_t value) {
   node_ptr preds[N], succs[N];
   int32_t toplevel = -1;
   node_ptr node = NULL;
   if(find(set, key, preds, succs)) {
-    forkscan_free((void*)node);
+    node_free(node);
     return false;
   }
   if(node == NULL) { 
     toplevel = random_level(&set->seed, N);
-    node = node_create(key, toplevel); 
+    node = node_create(key, value, toplevel); 
   }
+  if(toplevel > set->toplevel) { set->toplevel = toplevel; }
   for(int64_t i = BOTTOM; i <= toplevel; ++i) {
     node->next[i] = succs[i];
     preds[i]->next[i] = node;
@@ -126,22 +161,59 @@ int c_fhsl_remove(c_fhsl_t * set, int64_t key) {
   for(int64_t i = BOTTOM; i <= node->toplevel; ++i) {
     preds[i]->next[i] = node->next[i];
   }
-  forkscan_free(node);
+  node_free(node);
   return true;
 }
 
 /** Pop the front node from the list.  Return true iff there was a node to pop.
  */
 int c_fhsl_pop_min (c_fhsl_t *set) {
-  node_ptr head_node = set->head.next[BOTTOM];
-  if(head_node != &set->tail) {
+  int64_t key, value;
+  return c_fhsl_pop_min_item(set, &key, &value);
+}
+
+/** Pop the front node from the list and store its key and value.  Return
+ *  true iff there was a node to pop.
+ */
+int c_fhsl_pop_min_item (c_fhsl_t *set, int64_t *key, int64_t *value) {
+  node_ptr head_node = set->head->next[BOTTOM];
+  if(head_node != set->tail) {
     node_ptr node_popped = head_node;
+    *key = node_popped->key;
+    *value = node_popped->value;
     int64_t toplevel = node_popped->toplevel;
     for(int64_t i = BOTTOM; i <= toplevel; i++) {
-      set->head.next[i] = node_popped->next[i];
+      set->head->next[i] = node_popped->next[i];
     }
-    forkscan_free(node_popped);
+    node_free(node_popped);
+    return true;
+  }
+  return false;
+}
+
+/** Store the key and value of the front node without removing it.  Return
+ *  true iff the list is not empty.
+ */
+int c_fhsl_peek_min (c_fhsl_t *set, int64_t *key, int64_t *value) {
+  node_ptr head_node = set->head->next[BOTTOM];
+  if(head_node != set->tail) {
+    *key = head_node->key;
+    *value = head_node->value;
     return true;
   }
   return false;
+}
+
+/** Free the skip list and every node in it.
+ */
+void c_fhsl_destroy(c_fhsl_t *set) {
+  node_ptr node = set->head->next[BOTTOM];
+  while(node != set->tail) {
+    node_ptr next = node->next[BOTTOM];
+    node_free(node);
+    node = next;
+  }
+  node_free(set->head);
+  node_free(set->tail);
+  forkscan_free(set);
 }
\ No newline at end of file
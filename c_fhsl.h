@@ -8,6 +8,10 @@ c_fhsl_t * c_fhsl_create();
 
 int c_fhsl_contains(c_fhsl_t * set, int64_t key);
 int c_fhsl_add(c_fhsl_t * set, int64_t key);
+int c_fhsl_add_item(c_fhsl_t * set, int64_t key, int64_t value);
 int c_fhsl_remove(c_fhsl_t * set, int64_t key);
 int c_fhsl_pop_min(c_fhsl_t *set);
+int c_fhsl_pop_min_item(c_fhsl_t *set, int64_t *key, int64_t *value);
+int c_fhsl_peek_min(c_fhsl_t *set, int64_t *key, int64_t *value);
+void c_fhsl_destroy(c_fhsl_t *set);
 void c_fhsl_print (c_fhsl_t *set);
\ No newline at end of file
@@ -3,6 +3,9 @@
  */
 
 #include "c_fhsl_b.h"
+#include "parking_lot.h"
+#include "sharded_counter.h"
+#include "node_pool.h"
 #include "utils.h"
 
 #include <stdatomic.h>
@@ -15,13 +18,28 @@
 #define BOTTOM 0
 
 struct c_fhsl_b_t {
-  node_t head, tail;
+  // Updates begun and ended, which snapshot scans validate against.
+  sharded_counter_t *begun, *ended;
+  // Highest level any node has been linked at; searches start there.
+  _Atomic(int32_t) toplevel;
+  sharded_counter_t *size;
+  parking_lot_t *waiters;
+  node_ptr head, tail;
 };
 
 
-static node_ptr node_create(int64_t key, int32_t toplevel){
-  node_ptr node = forkscan_malloc(sizeof(node_t));
+/** Return the bytes a node with a tower toplevel + 1 high takes.
+ */
+static size_t node_size(int32_t toplevel) {
+  return sizeof(node_t) + (toplevel + 1) * sizeof(node_ptr);
+}
+
+/** Allocate a node with a tower of toplevel + 1 links.
+ */
+static node_ptr node_create(int64_t key, int64_t value, int32_t toplevel){
+  node_ptr node = node_pool_alloc(node_size(toplevel));
   node->key = key;
+  node->value = value;
   node->toplevel = toplevel;
   atomic_store_explicit(&node->marked, false, memory_order_relaxed);
   atomic_store_explicit(&node->fully_linked, false, memory_order_relaxed);
@@ -29,12 +47,74 @@ static node_ptr node_create(int64_t key, int32_t toplevel){
   return node;
 }
 
+/** Hand a node no other thread can reach back to the node pool.
+ */
+static void node_free(node_ptr node) {
+  if(node != NULL) {
+    node_pool_free(node, node_size(node->toplevel));
+  }
+}
+
+/** Retire a node other threads may still reach.
+ */
+static void node_retire(node_ptr node) {
+  node_pool_retire(node, node_size(node->toplevel));
+}
+
+/** Return the highest level any node has been linked at.  The levels above
+ *  it are empty, so a search starts here rather than at the top of the
+ *  head's tower.
+ */
+static int32_t top_level(c_fhsl_b_t *set) {
+  return atomic_load_explicit(&set->toplevel, memory_order_relaxed);
+}
+
+/** Raise the top level to cover a node of height toplevel + 1, before the
+ *  node is linked.
+ */
+static void raise_top_level(c_fhsl_b_t *set, int32_t toplevel) {
+  int32_t top = atomic_load_explicit(&set->toplevel, memory_order_relaxed);
+  while(top < toplevel && !atomic_compare_exchange_weak_explicit(&set->toplevel,
+    &top, toplevel, memory_order_seq_cst, memory_order_relaxed)) {}
+}
+
 static void unlock_nodes(node_ptr preds[N], int32_t highest_locked) {
   for(int32_t i = BOTTOM; i <= highest_locked; i++) {
     pthread_spin_unlock(&preds[i]->lock);
   }
 }
 
+/** Count an update as begun, before the stores that make an add, remove
+ *  or pop take effect.  Every update is counted, scan or no scan, on the
+ *  thread's own shard.
+ */
+static void begin_update(c_fhsl_b_t *set) {
+  sharded_counter_add_local(set->begun, 1);
+  atomic_thread_fence(memory_order_release);
+}
+
+/** Count an update as ended, after its stores.
+ */
+static void end_update(c_fhsl_b_t *set) {
+  atomic_thread_fence(memory_order_release);
+  sharded_counter_add_local(set->ended, 1);
+}
+
+/** Wait until no update is under way and return the number begun.  The
+ *  ended counts are read before the begun ones, so equal sums mean every
+ *  update begun had ended at some instant between the reads, and the scan
+ *  that follows sees all of them.
+ */
+static int64_t wait_for_updates(c_fhsl_b_t *set) {
+  while(true) {
+    int64_t ended = sharded_counter_read(set->ended);
+    atomic_thread_fence(memory_order_acquire);
+    int64_t begun = sharded_counter_read(set->begun);
+    atomic_thread_fence(memory_order_acquire);
+    if(begun == ended) { return begun; }
+  }
+}
+
 bool ok_to_delete(node_ptr candidate)
 {
   bool fully_linked = atomic_load_explicit(&candidate->fully_linked, memory_order_relaxed);
@@ -43,8 +123,8 @@ bool ok_to_delete(node_ptr candidate)
 }
 
 void c_fhsl_b_print (c_fhsl_b_t *set){
-  node_ptr node = atomic_load_explicit(&set->head.next[BOTTOM], memory_order_consume);
-  while(node != &set->tail) {
+  node_ptr node = atomic_load_explicit(&set->head->next[BOTTOM], memory_order_consume);
+  while(node != set->tail) {
     node_ptr next = atomic_load_explicit(&node->next[BOTTOM], memory_order_consume);
     printf("node[%d]: %ld\n", node->toplevel, node->key);
     node = next;
@@ -53,25 +133,26 @@ void c_fhsl_b_print (c_fhsl_b_t *set){
 
 c_fhsl_b_t * c_fhsl_b_create() {
   c_fhsl_b_t* fhsl_b = forkscan_malloc(sizeof(c_fhsl_b_t));
-  fhsl_b->head.key = INT64_MIN;
-  fhsl_b->tail.key = INT64_MAX;
-  atomic_store_explicit(&fhsl_b->head.marked, false, memory_order_relaxed);
-  atomic_store_explicit(&fhsl_b->tail.marked, false, memory_order_relaxed);
-  atomic_store_explicit(&fhsl_b->head.fully_linked, true, memory_order_relaxed);
-  atomic_store_explicit(&fhsl_b->tail.fully_linked, true, memory_order_relaxed);
+  fhsl_b->begun = sharded_counter_create(SHARDED_COUNTER_LOCAL_SHARDS);
+  fhsl_b->ended = sharded_counter_create(SHARDED_COUNTER_LOCAL_SHARDS);
+  fhsl_b->size = sharded_counter_create(SHARDED_COUNTER_LOCAL_SHARDS);
+  fhsl_b->waiters = parking_lot_create();
+  atomic_store_explicit(&fhsl_b->toplevel, 0, memory_order_relaxed);
+  fhsl_b->head = node_create(INT64_MIN, 0, N - 1);
+  fhsl_b->tail = node_create(INT64_MAX, 0, N - 1);
+  atomic_store_explicit(&fhsl_b->head->fully_linked, true, memory_order_relaxed);
+  atomic_store_explicit(&fhsl_b->tail->fully_linked, true, memory_order_relaxed);
   for(int64_t i = 0; i < N; i++) {
-    atomic_store_explicit(&fhsl_b->head.next[i], &fhsl_b->tail, memory_order_relaxed);
-    atomic_store_explicit(&fhsl_b->tail.next[i], NULL, memory_order_relaxed);
+    atomic_store_explicit(&fhsl_b->head->next[i], fhsl_b->tail, memory_order_relaxed);
+    atomic_store_explicit(&fhsl_b->tail->next[i], NULL, memory_order_relaxed);
   }
-  pthread_spin_init(&fhsl_b->head.lock, PTHREAD_PROCESS_PRIVATE);
-  pthread_spin_init(&fhsl_b->tail.lock, PTHREAD_PROCESS_PRIVATE);
   return fhsl_b;
 }
 
 
 int c_fhsl_b_contains(c_fhsl_b_t *set, int64_t key) {
-  node_ptr node = &set->head;
-  for(int64_t i = N - 1; i >= 0; i--) {
+  node_ptr node = set->head;
+  for(int64_t i = top_level(set); i >= 0; i--) {
     node_ptr next = atomic_load_explicit(&node->next[i], memory_order_consume);
     while(next->key <= key) {
       node = next; 
@@ -87,8 +168,8 @@ int c_fhsl_b_contains(c_fhsl_b_t *set, int64_t key) {
 }
 
 int c_fhsl_b_contains_serial(c_fhsl_b_t *set, int64_t key) {
-  node_ptr node = &set->head;
-  for(int64_t i = N - 1; i >= 0; i--) {
+  node_ptr node = set->head;
+  for(int64_t i = top_level(set); i >= 0; i--) {
     node_ptr next = atomic_load_explicit(&node->next[i], memory_order_relaxed);
     while(next->key <= key) {
       node = next; 
@@ -102,10 +183,25 @@ int c_fhsl_b_contains_serial(c_fhsl_b_t *set, int64_t key) {
 }
 
 
-static bool find_serial(c_fhsl_b_t *set, int64_t key, 
-  node_ptr preds[N], node_ptr succs[N]) {
-  node_ptr left = &set->head, right = left;
-  for(int64_t level = N - 1; level >= BOTTOM; --level) {
+/** Fill preds and succs for key and return whether a node with key is at
+ *  succs[BOTTOM].  If hinted, preds already holds the predecessors of a
+ *  smaller key and each level resumes from there rather than from the
+ *  head, unless that node has since been marked for removal.
+ */
+static bool find_from(c_fhsl_b_t *set, int64_t key,
+  node_ptr preds[N], node_ptr succs[N], bool hinted) {
+  node_ptr left = set->head, right = left;
+  int32_t top = top_level(set);
+  // Nothing is linked above the top level.
+  for(int64_t level = N - 1; level > top; --level) {
+    preds[level] = set->head;
+    succs[level] = set->tail;
+  }
+  for(int64_t level = top; level >= BOTTOM; --level) {
+    if(hinted && preds[level]->key > left->key
+       && !atomic_load_explicit(&preds[level]->marked, memory_order_relaxed)) {
+      left = preds[level];
+    }
     right = atomic_load_explicit(&left->next[level], memory_order_consume);
     while(right->key < key) {
       left = right;
@@ -117,17 +213,31 @@ static bool find_serial(c_fhsl_b_t *set, int64_t key,
   return succs[BOTTOM]->key == key;
 }
 
+static bool find_serial(c_fhsl_b_t *set, int64_t key,
+  node_ptr preds[N], node_ptr succs[N]) {
+  return find_from(set, key, preds, succs, false);
+}
+
 int c_fhsl_b_add(uint64_t *seed, c_fhsl_b_t *set, int64_t key) {
-  node_ptr preds[N], succs[N];
-  int32_t toplevel = random_level(seed, N);
-  node_ptr node = NULL;
+  return c_fhsl_b_add_item(seed, set, key, 0);
+}
+
+/** Lock the predecessors of key and link a node in after them.  If node is
+ *  not NULL it is linked in, at its own height and with its own value, in
+ *  place of a new node, and freed if key is already present.  If hinted,
+ *  preds holds the predecessors of a smaller key to search on from.
+ */
+static int add_from(uint64_t *seed, c_fhsl_b_t *set, int64_t key, int64_t value,
+  node_ptr node, node_ptr preds[N], node_ptr succs[N], bool hinted) {
+  int32_t toplevel = node != NULL ? node->toplevel : random_level(seed, N);
+  raise_top_level(set, toplevel);
   while(true) {
-    if(find_serial(set, key, preds, succs)) {
-      forkscan_free((void*)node);
+    if(find_from(set, key, preds, succs, hinted)) {
       node_ptr found_node = succs[BOTTOM];
       bool marked = atomic_load_explicit(&found_node->marked, memory_order_relaxed);
       if(!marked) {
         while(!atomic_load_explicit(&found_node->fully_linked, memory_order_relaxed)) {}
+        node_free(node);
         return false;
       }
       continue;
@@ -153,33 +263,49 @@ int c_fhsl_b_add(uint64_t *seed, c_fhsl_b_t *set, int64_t key) {
       unlock_nodes(preds, highest_locked);
       continue;
     }
-    if(node == NULL) { node = node_create(key, toplevel); }
+    if(node == NULL) { node = node_create(key, value, toplevel); }
+    begin_update(set);
     for(size_t i = BOTTOM; i <= toplevel && valid; i++) {
       atomic_store_explicit(&node->next[i], succs[i], memory_order_release);
       atomic_store_explicit(&preds[i]->next[i], node, memory_order_release);
     }
     atomic_store_explicit(&node->fully_linked, true, memory_order_relaxed);
+    end_update(set);
     unlock_nodes(preds, highest_locked);
+    sharded_counter_add_local(set->size, 1);
+    parking_lot_wake(set->waiters);
     return true;
   }
 }
 
+int c_fhsl_b_add_item(uint64_t *seed, c_fhsl_b_t *set, int64_t key, int64_t value) {
+  node_ptr preds[N], succs[N];
+  return add_from(seed, set, key, value, NULL, preds, succs, false);
+}
+
 int c_fhsl_b_add_serial(uint64_t *seed, c_fhsl_b_t *set, int64_t key) {
+  return c_fhsl_b_add_serial_item(seed, set, key, 0);
+}
+
+int c_fhsl_b_add_serial_item(uint64_t *seed, c_fhsl_b_t *set, int64_t key, int64_t value) {
   node_ptr preds[N], succs[N];
   int32_t toplevel = -1;
   node_ptr node = NULL;
   if(find_serial(set, key, preds, succs)) {
-    forkscan_free((void*)node);
+    node_free(node);
     return false;
   }
   if(node == NULL) { 
     toplevel = random_level(seed, N);
-    node = node_create(key, toplevel); 
+    node = node_create(key, value, toplevel); 
   }
+  raise_top_level(set, toplevel);
   for(int64_t i = BOTTOM; i <= toplevel; ++i) {
     atomic_store_explicit(&node->next[i], succs[i], memory_order_release);
     atomic_store_explicit(&preds[i]->next[i], node, memory_order_release);
   }
+  sharded_counter_add_local(set->size, 1);
+  parking_lot_wake(set->waiters);
   return true;
 }
 
@@ -198,7 +324,9 @@ int c_fhsl_b_remove_leaky(c_fhsl_b_t *set, int64_t key) {
           pthread_spin_unlock(&deleted_node->lock);
           return false;
         }
+        begin_update(set);
         atomic_store_explicit(&deleted_node->marked, true, memory_order_relaxed);
+        end_update(set);
         is_marked = true;
       }
       // Lock all our nodes.
@@ -227,6 +355,7 @@ int c_fhsl_b_remove_leaky(c_fhsl_b_t *set, int64_t key) {
       }
       pthread_spin_unlock(&deleted_node->lock);
       unlock_nodes(preds, highest_locked);
+      sharded_counter_add_local(set->size, -1);
       return true;
     } else {
       return false;
@@ -244,6 +373,7 @@ int c_fhsl_b_remove_leaky_serial(c_fhsl_b_t *set, int64_t key) {
     node_ptr next = atomic_load_explicit(&node->next[i], memory_order_relaxed);
     atomic_store_explicit(&preds[i]->next[i], next, memory_order_relaxed);
   }
+  sharded_counter_add_local(set->size, -1);
   return true;
 }
 
@@ -263,7 +393,9 @@ int c_fhsl_b_remove(c_fhsl_b_t *set, int64_t key) {
           pthread_spin_unlock(&deleted_node->lock);
           return false;
         }
+        begin_update(set);
         atomic_store_explicit(&deleted_node->marked, true, memory_order_relaxed);
+        end_update(set);
         is_marked = true;
       }
       // Lock all our nodes.
@@ -293,7 +425,8 @@ int c_fhsl_b_remove(c_fhsl_b_t *set, int64_t key) {
       }
       pthread_spin_unlock(&deleted_node->lock);
       unlock_nodes(preds, highest_locked);
-      forkscan_retire(deleted_node);
+      node_retire(deleted_node);
+      sharded_counter_add_local(set->size, -1);
       return true;
     } else {
       return false;
@@ -311,83 +444,191 @@ int c_fhsl_b_remove_serial(c_fhsl_b_t *set, int64_t key) {
     node_ptr next = atomic_load_explicit(&node->next[i], memory_order_consume);
     atomic_store_explicit(&preds[i]->next[i], next, memory_order_release);
   }
-  forkscan_retire(node);
+  node_retire(node);
+  sharded_counter_add_local(set->size, -1);
   return true;
 }
 
 int c_fhsl_b_pop_min_leaky (c_fhsl_b_t *set) {
-  pthread_spin_lock(&set->head.lock);
-  node_ptr node_to_remove = atomic_load_explicit(&set->head.next[BOTTOM], memory_order_consume);
-  if(node_to_remove == &set->tail) {
-    pthread_spin_unlock(&set->head.lock);
+  int64_t key, value;
+  return c_fhsl_b_pop_min_leaky_item(set, &key, &value);
+}
+
+int c_fhsl_b_pop_min_leaky_item(c_fhsl_b_t *set, int64_t *key, int64_t *value) {
+  pthread_spin_lock(&set->head->lock);
+  node_ptr node_to_remove = atomic_load_explicit(&set->head->next[BOTTOM], memory_order_consume);
+  if(node_to_remove == set->tail) {
+    pthread_spin_unlock(&set->head->lock);
     return false;
   }
+  *key = node_to_remove->key;
+  *value = node_to_remove->value;
+  begin_update(set);
   for(int32_t i = BOTTOM; i <= node_to_remove->toplevel; i++) {
     node_ptr next = atomic_load_explicit(&node_to_remove->next[i], memory_order_consume);
-    atomic_store_explicit(&set->head.next[i], next, memory_order_release);
+    atomic_store_explicit(&set->head->next[i], next, memory_order_release);
   }
-  pthread_spin_unlock(&set->head.lock);
+  end_update(set);
+  pthread_spin_unlock(&set->head->lock);
+  sharded_counter_add_local(set->size, -1);
   return true;
 }
 
 int c_fhsl_b_pop_min_leaky_serial (c_fhsl_b_t *set) {
-  node_ptr head_node = atomic_load_explicit(&set->head.next[BOTTOM], memory_order_consume);
-  if(head_node != &set->tail) {
+  int64_t key, value;
+  return c_fhsl_b_pop_min_leaky_serial_item(set, &key, &value);
+}
+
+int c_fhsl_b_pop_min_leaky_serial_item(c_fhsl_b_t *set, int64_t *key, int64_t *value) {
+  node_ptr head_node = atomic_load_explicit(&set->head->next[BOTTOM], memory_order_consume);
+  if(head_node != set->tail) {
     node_ptr node_popped = head_node;
+    *key = node_popped->key;
+    *value = node_popped->value;
     int64_t toplevel = node_popped->toplevel;
     for(int64_t i = BOTTOM; i <= toplevel; i++) {
-      set->head.next[i] = node_popped->next[i];
+      set->head->next[i] = node_popped->next[i];
     }
+    sharded_counter_add_local(set->size, -1);
     return true;
   }
   return false;
 }
 
 int c_fhsl_b_pop_min(c_fhsl_b_t *set) {
-  pthread_spin_lock(&set->head.lock);
-  node_ptr node_to_remove = atomic_load_explicit(&set->head.next[BOTTOM], memory_order_consume);
-  if(node_to_remove == &set->tail) {
-    pthread_spin_unlock(&set->head.lock);
+  int64_t key, value;
+  return c_fhsl_b_pop_min_item(set, &key, &value);
+}
+
+int c_fhsl_b_pop_min_item(c_fhsl_b_t *set, int64_t *key, int64_t *value) {
+  pthread_spin_lock(&set->head->lock);
+  node_ptr node_to_remove = atomic_load_explicit(&set->head->next[BOTTOM], memory_order_consume);
+  if(node_to_remove == set->tail) {
+    pthread_spin_unlock(&set->head->lock);
     return false;
   }
+  *key = node_to_remove->key;
+  *value = node_to_remove->value;
+  begin_update(set);
   for(int32_t i = BOTTOM; i <= node_to_remove->toplevel; i++) {
     node_ptr next = atomic_load_explicit(&node_to_remove->next[i], memory_order_consume);
-    atomic_store_explicit(&set->head.next[i], next, memory_order_release);
+    atomic_store_explicit(&set->head->next[i], next, memory_order_release);
   }
-  forkscan_retire(node_to_remove);
-  pthread_spin_unlock(&set->head.lock);
+  end_update(set);
+  node_retire(node_to_remove);
+  pthread_spin_unlock(&set->head->lock);
+  sharded_counter_add_local(set->size, -1);
   return true;
 }
 
 int c_fhsl_b_pop_min_serial (c_fhsl_b_t *set) {
-  node_ptr head_node = atomic_load_explicit(&set->head.next[BOTTOM], memory_order_consume);
-  if(head_node != &set->tail) {
+  int64_t key, value;
+  return c_fhsl_b_pop_min_serial_item(set, &key, &value);
+}
+
+int c_fhsl_b_pop_min_serial_item(c_fhsl_b_t *set, int64_t *key, int64_t *value) {
+  node_ptr head_node = atomic_load_explicit(&set->head->next[BOTTOM], memory_order_consume);
+  if(head_node != set->tail) {
     node_ptr node_popped = head_node;
+    *key = node_popped->key;
+    *value = node_popped->value;
     int64_t toplevel = node_popped->toplevel;
     for(int64_t i = BOTTOM; i <= toplevel; i++) {
       node_ptr next = atomic_load_explicit(&node_popped->next[i], memory_order_consume);
-      atomic_store_explicit(&set->head.next[i], next, memory_order_release);
+      atomic_store_explicit(&set->head->next[i], next, memory_order_release);
     }
-    forkscan_retire(node_popped);
+    node_retire(node_popped);
+    sharded_counter_add_local(set->size, -1);
     return true;
   }
   return false;
 }
 
+/** Claim up to k of the smallest nodes under the head lock and unlink them
+ *  together.  Each node is marked under its own lock, as remove does, so a
+ *  concurrent remove of the same node fails, and the sweep stops at a node
+ *  a remover or inserter still owns.  Adds and removes lock a node before
+ *  the head, so node locks are only tried here; if the first is busy the
+ *  head lock is dropped and the sweep starts over.  The claimed items are
+ *  stored in keys and values, smallest first.  Return the number claimed.
+ */
+static size_t pop_many(c_fhsl_b_t *set, size_t k, int64_t *keys, int64_t *values, bool retire) {
+  node_ptr succs[N];
+  int32_t height = -1;
+  size_t count = 0;
+  bool busy;
+  node_ptr first;
+  do {
+    busy = false;
+    pthread_spin_lock(&set->head->lock);
+    first = atomic_load_explicit(&set->head->next[BOTTOM], memory_order_consume);
+    node_ptr node = first;
+    while(count < k && node != set->tail) {
+      if(pthread_spin_trylock(&node->lock) != 0) {
+        busy = true;
+        break;
+      }
+      if(!ok_to_delete(node)) {
+        pthread_spin_unlock(&node->lock);
+        break;
+      }
+      // The marks and the unlink are one update, so a scan sees all k go or none.
+      if(count == 0) { begin_update(set); }
+      atomic_store_explicit(&node->marked, true, memory_order_relaxed);
+      pthread_spin_unlock(&node->lock);
+      keys[count] = node->key;
+      values[count] = node->value;
+      count++;
+      for(int32_t i = BOTTOM; i <= node->toplevel; i++) {
+        succs[i] = atomic_load_explicit(&node->next[i], memory_order_consume);
+      }
+      if(node->toplevel > height) { height = node->toplevel; }
+      node = succs[BOTTOM];
+    }
+    if(count == 0) { pthread_spin_unlock(&set->head->lock); }
+  } while(count == 0 && busy);
+  if(count == 0) { return 0; }
+  for(int32_t i = BOTTOM; i <= height; i++) {
+    atomic_store_explicit(&set->head->next[i], succs[i], memory_order_release);
+  }
+  end_update(set);
+  pthread_spin_unlock(&set->head->lock);
+  sharded_counter_add_local(set->size, -(int64_t)count);
+  if(retire) {
+    // The claimed run is still chained together at the bottom.
+    node_ptr node = first;
+    for(size_t i = 0; i < count; i++) {
+      node_ptr next = atomic_load_explicit(&node->next[BOTTOM], memory_order_consume);
+      node_retire(node);
+      node = next;
+    }
+  }
+  return count;
+}
+
+size_t c_fhsl_b_pop_many_leaky(c_fhsl_b_t *set, size_t k, int64_t *keys, int64_t *values) {
+  return pop_many(set, k, keys, values, false);
+}
+
+size_t c_fhsl_b_pop_many(c_fhsl_b_t *set, size_t k, int64_t *keys, int64_t *values) {
+  return pop_many(set, k, keys, values, true);
+}
+
 /*
   Don't use this in conjunction with concurrent remove calls. Will break.
+  Returns the number of nodes detached, which bulk_push takes back.
 */
 int c_fhsl_b_bulk_pop(c_fhsl_b_t *set, size_t amount, node_ptr *head, node_ptr *tail) {
-  node_ptr local_head = atomic_load_explicit(&set->head.next[BOTTOM], memory_order_consume);
-  if(local_head == &set->tail) {
+  node_ptr local_head = atomic_load_explicit(&set->head->next[BOTTOM], memory_order_consume);
+  if(local_head == set->tail) {
     *head = *tail = NULL;
     return 0;
   }
-  int approx_seen = 0;
+  int moved = 1;
   node_ptr local_tail = local_head;
-  for(size_t i = 0; i < amount; i++, approx_seen++) {
+  for(size_t i = 0; i < amount; i++, moved++) {
     node_ptr next = atomic_load_explicit(&local_tail->next[BOTTOM], memory_order_consume);
-    if(next == &set->tail) {
+    if(next == set->tail) {
       break;
     }
     local_tail = next;
@@ -395,35 +636,221 @@ int c_fhsl_b_bulk_pop(c_fhsl_b_t *set, size_t amount, node_ptr *head, node_ptr *
   node_ptr next = atomic_load_explicit(&local_tail->next[BOTTOM], memory_order_consume);
   node_ptr preds[N], succs[N];
   bool found = find_serial(set, next->key, preds, succs);
-  pthread_spin_lock(&set->head.lock);
+  pthread_spin_lock(&set->head->lock);
+  begin_update(set);
   for(int32_t i = BOTTOM; i < N; i++) {
-    atomic_store_explicit(&set->head.next[i], succs[i], memory_order_release);
+    atomic_store_explicit(&set->head->next[i], succs[i], memory_order_release);
   }
-  pthread_spin_unlock(&set->head.lock);
+  end_update(set);
+  pthread_spin_unlock(&set->head->lock);
   *head = local_head;
   *tail = local_tail;
-  return approx_seen;
+  sharded_counter_add_local(set->size, -moved);
+  return moved;
 }
 
-void c_fhsl_b_bulk_push(c_fhsl_b_t *set, node_ptr head, node_ptr tail) {
+/** Append the nodes head through tail, all keyed above anything in the
+ *  list, as taken off another list by c_fhsl_b_bulk_pop.  Their upper
+ *  levels still point into that list, so every level of every node is
+ *  relinked, not just the tail's.
+ */
+void c_fhsl_b_bulk_push(c_fhsl_b_t *set, node_ptr head, node_ptr tail, size_t count) {
   node_ptr preds[N], succs[N];
   bool _ = find_serial(set, INT64_MAX, preds, succs);
+  sharded_counter_add_local(set->size, count);
+  begin_update(set);
   node_ptr current = head;
-  for(int32_t i = BOTTOM; i < tail->toplevel; i++) {
-    atomic_store_explicit(&tail->next[i], &set->tail, memory_order_release);
-  }
-  int32_t linkup_height = 0;
-  while(current != tail) {
-    if(linkup_height <= current->toplevel) {
-      for(int32_t i = linkup_height; i <= current->toplevel; i++, linkup_height++) {
-        atomic_store_explicit(&preds[i]->next[i], current, memory_order_release);
-      }
+  while(true) {
+    node_ptr next = atomic_load_explicit(&current->next[BOTTOM], memory_order_consume);
+    raise_top_level(set, current->toplevel);
+    for(int32_t i = BOTTOM; i <= current->toplevel; i++) {
+      atomic_store_explicit(&preds[i]->next[i], current, memory_order_release);
+      preds[i] = current;
     }
-    // Our mission is done here!
-    if(linkup_height >= N) {
-      return;
+    if(current == tail) {
+      break;
     }
-    node_ptr next = atomic_load_explicit(&current->next[BOTTOM], memory_order_consume);
     current = next;
   }
-}
\ No newline at end of file
+  for(int32_t i = BOTTOM; i < N; i++) {
+    atomic_store_explicit(&preds[i]->next[i], succs[i], memory_order_release);
+  }
+  end_update(set);
+}
+
+static int try_pop_min(void *set, void *key, int64_t *value) {
+  return c_fhsl_b_pop_min_item(set, key, value);
+}
+
+/** Pop the smallest item, waiting up to timeout_ns nanoseconds for one to
+ *  arrive if the queue is empty; a negative timeout waits forever.  Return
+ *  false on timeout.
+ */
+int c_fhsl_b_pop_min_wait(c_fhsl_b_t *set, int64_t *key, int64_t *value, int64_t timeout_ns) {
+  return parking_lot_wait(set->waiters, try_pop_min, set, key, value, timeout_ns);
+}
+
+/** Store the key and value of the first node that is fully linked and not
+ *  marked, without removing it.  Return true iff there was one.  Exact only
+ *  at quiescence: a concurrent pop or remove may take the node before the
+ *  caller looks, and a smaller key linked behind the scan is missed.
+ */
+int c_fhsl_b_peek_min(c_fhsl_b_t *set, int64_t *key, int64_t *value) {
+  node_ptr node = atomic_load_explicit(&set->head->next[BOTTOM], memory_order_consume);
+  for(; node != set->tail; node = atomic_load_explicit(&node->next[BOTTOM], memory_order_consume)) {
+    if(ok_to_delete(node)) {
+      *key = node->key;
+      *value = node->value;
+      return true;
+    }
+  }
+  return false;
+}
+
+/** Store the key and value of the front node without removing it.  Return
+ *  true iff the list is not empty.  For a list only one thread changes.
+ */
+int c_fhsl_b_peek_min_serial(c_fhsl_b_t *set, int64_t *key, int64_t *value) {
+  node_ptr head_node = atomic_load_explicit(&set->head->next[BOTTOM], memory_order_consume);
+  if(head_node != set->tail) {
+    *key = head_node->key;
+    *value = head_node->value;
+    return true;
+  }
+  return false;
+}
+
+/** Store, smallest first, up to k items with keys in [low, high] and
+ *  return how many were stored.  The search descends to the last node
+ *  below low and then walks the bottom level without taking a lock,
+ *  skipping nodes that are marked or not yet fully linked.  The result is
+ *  weakly consistent: an item in the list for the whole call is stored,
+ *  but one added or removed while the walk runs may or may not be.  A pop
+ *  unlinks its node without marking it, so a node popped after the walk
+ *  passed it can still be stored.  To go on past a full buffer, call again
+ *  with low one past the last key stored.
+ */
+size_t c_fhsl_b_scan(c_fhsl_b_t *set, int64_t low, int64_t high, size_t k, int64_t *keys, int64_t *values) {
+  size_t count = 0;
+  node_ptr node = set->head;
+  for(int64_t i = top_level(set); i >= BOTTOM; i--) {
+    node_ptr next = atomic_load_explicit(&node->next[i], memory_order_consume);
+    while(next->key < low) {
+      node = next;
+      next = atomic_load_explicit(&node->next[i], memory_order_consume);
+    }
+  }
+  node = atomic_load_explicit(&node->next[BOTTOM], memory_order_consume);
+  for(; count < k && node != set->tail && node->key <= high;
+      node = atomic_load_explicit(&node->next[BOTTOM], memory_order_consume)) {
+    if(ok_to_delete(node)) {
+      keys[count] = node->key;
+      values[count] = node->value;
+      count++;
+    }
+  }
+  return count;
+}
+
+/** As c_fhsl_b_scan, but linearizable: the items stored are exactly those
+ *  with keys in [low, high], up to k of them, at one instant during the
+ *  call.  The scan starts once no update is under way and is accepted only
+ *  if none began before it finished, so a wide range under a steady stream
+ *  of updates can retry many times.  Scanners take no locks and never hold
+ *  up an update.
+ */
+size_t c_fhsl_b_scan_snapshot(c_fhsl_b_t *set, int64_t low, int64_t high, size_t k, int64_t *keys, int64_t *values) {
+  size_t count;
+  int64_t begun;
+  do {
+    begun = wait_for_updates(set);
+    count = c_fhsl_b_scan(set, low, high, k, keys, values);
+    atomic_thread_fence(memory_order_acquire);
+  } while(sharded_counter_read(set->begun) != begun);
+  return count;
+}
+
+/** Move every item of src into dst and return the number that went in.
+ *  src's nodes are relinked rather than copied, in one pass along its
+ *  bottom level, each taking the locks an add would, and each search in
+ *  dst resumes from the predecessors of the key before, so the cost is
+ *  linear in the two sizes.  A key already in dst is dropped.  src is left
+ *  empty.  Other threads may use dst throughout, but not src.
+ */
+size_t c_fhsl_b_meld(c_fhsl_b_t *dst, c_fhsl_b_t *src) {
+  node_ptr preds[N], succs[N];
+  size_t added = 0, moved = 0;
+  node_ptr node = atomic_load_explicit(&src->head->next[BOTTOM], memory_order_relaxed);
+  while(node != src->tail) {
+    node_ptr next = atomic_load_explicit(&node->next[BOTTOM], memory_order_relaxed);
+    // Readers of dst must not take the node as linked until it is.
+    atomic_store_explicit(&node->fully_linked, false, memory_order_relaxed);
+    added += add_from(NULL, dst, node->key, node->value, node, preds, succs, moved > 0);
+    moved++;
+    node = next;
+  }
+  for(int64_t i = 0; i < N; i++) {
+    atomic_store_explicit(&src->head->next[i], src->tail, memory_order_relaxed);
+  }
+  sharded_counter_add_local(src->size, -(int64_t)moved);
+  return added;
+}
+
+/** Move every item with a key at or above pivot into a new list and
+ *  return it.  Each level is cut after the last node below pivot and the
+ *  part beyond is handed to the new list, whose last node at each level is
+ *  then pointed at the new tail, so the cost is linear in the items moved.
+ *  No other thread may be using the list.
+ */
+c_fhsl_b_t *c_fhsl_b_split(c_fhsl_b_t *set, int64_t pivot) {
+  node_ptr preds[N], succs[N];
+  c_fhsl_b_t *upper = c_fhsl_b_create();
+  atomic_store_explicit(&upper->toplevel, top_level(set), memory_order_relaxed);
+  bool _ = find_serial(set, pivot, preds, succs);
+  int64_t moved = 0;
+  for(int64_t level = N - 1; level >= BOTTOM; --level) {
+    node_ptr node = succs[level];
+    if(node == set->tail) { continue; }
+    atomic_store_explicit(&upper->head->next[level], node, memory_order_relaxed);
+    atomic_store_explicit(&preds[level]->next[level], set->tail, memory_order_relaxed);
+    while(true) {
+      if(level == BOTTOM) { moved++; }
+      node_ptr next = atomic_load_explicit(&node->next[level], memory_order_relaxed);
+      if(next == set->tail) {
+        atomic_store_explicit(&node->next[level], upper->tail, memory_order_relaxed);
+        break;
+      }
+      node = next;
+    }
+  }
+  sharded_counter_add_local(set->size, -moved);
+  sharded_counter_add_local(upper->size, moved);
+  return upper;
+}
+
+/** Return the approximate number of nodes, summed from per-thread shards
+ *  without stopping writers.  Exact only at quiescence.
+ */
+size_t c_fhsl_b_size(c_fhsl_b_t *set) {
+  return sharded_counter_read_size(set->size);
+}
+
+/** Free the list and every node still in it.  Removed nodes are unlinked
+ *  before they are retired, so everything left on the bottom level is
+ *  live.  No other thread may be using the list.
+ */
+void c_fhsl_b_destroy(c_fhsl_b_t *set) {
+  node_ptr node = atomic_load_explicit(&set->head->next[BOTTOM], memory_order_relaxed);
+  while(node != set->tail) {
+    node_ptr next = atomic_load_explicit(&node->next[BOTTOM], memory_order_relaxed);
+    node_free(node);
+    node = next;
+  }
+  node_free(set->head);
+  node_free(set->tail);
+  parking_lot_destroy(set->waiters);
+  sharded_counter_destroy(set->size);
+  sharded_counter_destroy(set->begun);
+  sharded_counter_destroy(set->ended);
+  forkscan_free(set);
+}
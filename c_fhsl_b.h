@@ -6,18 +6,22 @@
 #include <stdbool.h>
 #include <stdatomic.h>
 
+#include "utils.h"
+
 typedef struct c_fhsl_b_t c_fhsl_b_t;
 typedef struct node_t node_t;
 typedef node_t* node_ptr;
 
-#define N 20
+#define N SKIPLIST_HEIGHT
 
 struct node_t {
   int64_t key;
+  int64_t value;
   int32_t toplevel;
   atomic_bool marked, fully_linked;
   pthread_spinlock_t lock;
-  _Atomic(node_ptr) next[N];
+  // Sized to toplevel + 1 when the node is allocated.
+  _Atomic(node_ptr) next[];
 };
 
 c_fhsl_b_t * c_fhsl_b_create();
@@ -25,7 +29,9 @@ c_fhsl_b_t * c_fhsl_b_create();
 int c_fhsl_b_contains(c_fhsl_b_t * set, int64_t key);
 int c_fhsl_b_contains_serial(c_fhsl_b_t * set, int64_t key);
 int c_fhsl_b_add(uint64_t *seed, c_fhsl_b_t * set, int64_t key);
+int c_fhsl_b_add_item(uint64_t *seed, c_fhsl_b_t * set, int64_t key, int64_t value);
 int c_fhsl_b_add_serial(uint64_t *seed, c_fhsl_b_t * set, int64_t key);
+int c_fhsl_b_add_serial_item(uint64_t *seed, c_fhsl_b_t * set, int64_t key, int64_t value);
 int c_fhsl_b_remove_leaky(c_fhsl_b_t * set, int64_t key);
 int c_fhsl_b_remove_leaky_serial(c_fhsl_b_t * set, int64_t key);
 int c_fhsl_b_remove(c_fhsl_b_t * set, int64_t key);
@@ -34,6 +40,21 @@ int c_fhsl_b_pop_min_leaky(c_fhsl_b_t *set);
 int c_fhsl_b_pop_min_leaky_serial(c_fhsl_b_t *set);
 int c_fhsl_b_pop_min(c_fhsl_b_t *set);
 int c_fhsl_b_pop_min_serial(c_fhsl_b_t *set);
+int c_fhsl_b_pop_min_leaky_item(c_fhsl_b_t *set, int64_t *key, int64_t *value);
+int c_fhsl_b_pop_min_leaky_serial_item(c_fhsl_b_t *set, int64_t *key, int64_t *value);
+int c_fhsl_b_pop_min_item(c_fhsl_b_t *set, int64_t *key, int64_t *value);
+int c_fhsl_b_pop_min_serial_item(c_fhsl_b_t *set, int64_t *key, int64_t *value);
+size_t c_fhsl_b_pop_many_leaky(c_fhsl_b_t *set, size_t k, int64_t *keys, int64_t *values);
+size_t c_fhsl_b_pop_many(c_fhsl_b_t *set, size_t k, int64_t *keys, int64_t *values);
+int c_fhsl_b_pop_min_wait(c_fhsl_b_t *set, int64_t *key, int64_t *value, int64_t timeout_ns);
+int c_fhsl_b_peek_min(c_fhsl_b_t *set, int64_t *key, int64_t *value);
+int c_fhsl_b_peek_min_serial(c_fhsl_b_t *set, int64_t *key, int64_t *value);
+size_t c_fhsl_b_scan(c_fhsl_b_t *set, int64_t low, int64_t high, size_t k, int64_t *keys, int64_t *values);
+size_t c_fhsl_b_scan_snapshot(c_fhsl_b_t *set, int64_t low, int64_t high, size_t k, int64_t *keys, int64_t *values);
+size_t c_fhsl_b_meld(c_fhsl_b_t *dst, c_fhsl_b_t *src);
+c_fhsl_b_t *c_fhsl_b_split(c_fhsl_b_t *set, int64_t pivot);
+size_t c_fhsl_b_size(c_fhsl_b_t *set);
+void c_fhsl_b_destroy(c_fhsl_b_t *set);
 int c_fhsl_b_bulk_pop(c_fhsl_b_t *set, size_t amount, node_ptr *head, node_ptr *tail);
-void c_fhsl_b_bulk_push(c_fhsl_b_t *set, node_ptr head, node_ptr tail);
+void c_fhsl_b_bulk_push(c_fhsl_b_t *set, node_ptr head, node_ptr tail, size_t count);
 void c_fhsl_b_print (c_fhsl_b_t *set);
\ No newline at end of file
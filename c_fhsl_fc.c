@@ -5,37 +5,68 @@
 #include "c_fhsl_fc.h"
 #include "c_fhsl.h"
 #include "c_locks.h"
+#include "parking_lot.h"
+#include "sharded_counter.h"
+#include "thread_slots.h"
 
 #include <assert.h>
 #include <stdatomic.h>
 #include <stdbool.h>
 #include <forkscan.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <immintrin.h>
 #include <pthread.h>
 
 typedef struct op_t op_t;
+typedef struct ring_t ring_t;
 typedef enum op_type op_type_t;
 
-enum op_type {CONTAINS, ADD, REMOVE, POP_MIN, NONE};
+enum op_type {CONTAINS, ADD, REMOVE, POP_MIN, PEEK_MIN, NONE};
 
 // Please forgive me...
+// The 8-byte members lead so the padding leaves op_t at exactly 128 bytes.
 struct op_t {
-  _Atomic(op_type_t) pending_op;
   union {
   _Atomic(uint64_t) contains, add, remove;
   } op_arg;
+  // Value passed in by add, key and value passed back by pop_min.
+  struct {
+    _Atomic(int64_t) key, value;
+  } op_item;
+  _Atomic(op_type_t) pending_op;
+  // What the owner posted, kept for the accounting at completion.
+  op_type_t posted_op;
   union {
-    atomic_bool contains, add, remove, pop_min;
+    atomic_bool contains, add, remove, pop_min, peek_min;
   } op_ret;
-  char padding[128 - (sizeof(_Atomic(op_type_t)) + sizeof(_Atomic(uint64_t)) + sizeof(atomic_bool))];
+  char padding[128 - (2 * sizeof(op_type_t) + sizeof(_Atomic(uint64_t)) + 2 * sizeof(_Atomic(int64_t)) + sizeof(atomic_bool))];
+};
+
+// Each thread owns a ring of depth op slots.  The owner posts at submitted
+// and completes in order at reaped; the combiner runs slots from served up
+// to submitted, so a thread's ops take effect in the order it posted them.
+struct ring_t {
+  _Atomic(uint64_t) submitted;
+  uint64_t reaped;
+  char padding1[128 - 2 * sizeof(uint64_t)];
+  // Only touched with the combiner lock held.
+  uint64_t served;
+  char padding2[128 - sizeof(uint64_t)];
 };
 
 struct c_fhsl_fc_t {
   size_t num_threads;
+  size_t depth;
   op_t *pending_ops;
+  ring_t *rings;
+  // The rings the combiner scans.
+  thread_slots_t *slots;
   spinlock_t lock;
   c_fhsl_t *inner_set;
+  // One shard per thread id, bumped by the caller once its op has run.
+  sharded_counter_t *size;
+  parking_lot_t *waiters;
 };
 
 
@@ -45,99 +76,398 @@ void c_fhsl_fc_print (c_fhsl_fc_t *set){
   c_fhsl_print(set->inner_set);
 }
 
-static void wait(c_fhsl_fc_t *fhsl_fc, size_t thread_id, size_t iterations) {
+static void run_op(c_fhsl_t *inner_set, op_t *op) {
+  op_type_t type = atomic_load_explicit(&op->pending_op, memory_order_acquire);
+  if(type == CONTAINS) {
+    uint64_t arg = atomic_load_explicit(&op->op_arg.contains, memory_order_relaxed);
+    bool ans = c_fhsl_contains(inner_set, arg);
+    atomic_store_explicit(&op->op_ret.contains, ans, memory_order_relaxed);
+  } else if(type == ADD) {
+    uint64_t arg = atomic_load_explicit(&op->op_arg.add, memory_order_relaxed);
+    int64_t value = atomic_load_explicit(&op->op_item.value, memory_order_relaxed);
+    bool ans = c_fhsl_add_item(inner_set, arg, value);
+    atomic_store_explicit(&op->op_ret.add, ans, memory_order_relaxed);
+  } else if(type == REMOVE) {
+    uint64_t arg = atomic_load_explicit(&op->op_arg.remove, memory_order_relaxed);
+    bool ans = c_fhsl_remove(inner_set, arg);
+    atomic_store_explicit(&op->op_ret.remove, ans, memory_order_relaxed);
+  } else if(type == POP_MIN) {
+    int64_t key = 0, value = 0;
+    bool ans = c_fhsl_pop_min_item(inner_set, &key, &value);
+    atomic_store_explicit(&op->op_item.key, key, memory_order_relaxed);
+    atomic_store_explicit(&op->op_item.value, value, memory_order_relaxed);
+    atomic_store_explicit(&op->op_ret.pop_min, ans, memory_order_relaxed);
+  } else if(type == PEEK_MIN) {
+    int64_t key = 0, value = 0;
+    bool ans = c_fhsl_peek_min(inner_set, &key, &value);
+    atomic_store_explicit(&op->op_item.key, key, memory_order_relaxed);
+    atomic_store_explicit(&op->op_item.value, value, memory_order_relaxed);
+    atomic_store_explicit(&op->op_ret.peek_min, ans, memory_order_relaxed);
+  } else {
+    return;
+  }
+  atomic_store_explicit(&op->pending_op, NONE, memory_order_release);
+}
+
+static op_t *slot(c_fhsl_fc_t *fhsl_fc, size_t thread_id, uint64_t seq) {
+  return &fhsl_fc->pending_ops[thread_id * fhsl_fc->depth + seq % fhsl_fc->depth];
+}
+
+static bool done(op_t *op) {
+  return atomic_load_explicit(&op->pending_op, memory_order_acquire) == NONE;
+}
+
+static void wait(op_t *op, size_t iterations) {
   size_t limit = 0;
-  while(limit++ < iterations && atomic_load_explicit(&fhsl_fc->pending_ops[thread_id].pending_op, memory_order_acquire) != NONE) { _mm_pause(); }
+  while(limit++ < iterations && !done(op)) { _mm_pause(); }
+}
+
+static void serve(c_fhsl_fc_t* fhsl_fc, size_t thread_id) {
+  ring_t *ring = &fhsl_fc->rings[thread_id];
+  uint64_t submitted = atomic_load_explicit(&ring->submitted, memory_order_acquire);
+  for(; ring->served < submitted; ring->served++) {
+    run_op(fhsl_fc->inner_set, slot(fhsl_fc, thread_id, ring->served));
+  }
+}
+
+/** Run every posted op of every registered thread, if no other thread is
+ *  combining.  Return true iff this thread took the lock.
+ */
+static bool try_combine(c_fhsl_fc_t* fhsl_fc) {
+  if(spinlock_trylock(&fhsl_fc->lock) != 0) {
+    return false;
+  }
+  size_t words = thread_slots_words(fhsl_fc->slots);
+  for(size_t w = 0; w < words; w++) {
+    uint64_t bits = thread_slots_word(fhsl_fc->slots, w);
+    for(; bits != 0; bits &= bits - 1) {
+      serve(fhsl_fc, w * 64 + __builtin_ctzll(bits));
+    }
+  }
+  spinlock_unlock(&fhsl_fc->lock);
+  return true;
 }
 
-static void flat_combine(c_fhsl_fc_t* fhsl_fc, size_t thread_id) {
-  size_t num_threads = fhsl_fc->num_threads;
-  while(true) {
+/** Return once op has run, combining for everyone if no other thread is.
+ */
+static void flat_combine(c_fhsl_fc_t* fhsl_fc, op_t *op) {
+  while(!done(op)) {
     // Can we become the active thread?
-    if(spinlock_trylock(&fhsl_fc->lock) == 0) {
-      for(size_t i = 0; i < num_threads; i++) {
-        op_type_t op = atomic_load_explicit(&fhsl_fc->pending_ops[i].pending_op, memory_order_acquire);
-        if(op == NONE) {
-          continue;
-        } else if(op == CONTAINS) {
-          uint64_t arg = atomic_load_explicit(&fhsl_fc->pending_ops[i].op_arg.contains, memory_order_relaxed);
-          bool ans = c_fhsl_contains(fhsl_fc->inner_set, arg);
-          atomic_store_explicit(&fhsl_fc->pending_ops[i].op_ret.contains, ans, memory_order_relaxed);
-          atomic_store_explicit(&fhsl_fc->pending_ops[i].pending_op, NONE, memory_order_release);
-        } else if(op == ADD) {
-          uint64_t arg = atomic_load_explicit(&fhsl_fc->pending_ops[i].op_arg.add, memory_order_relaxed);
-          bool ans = c_fhsl_add(fhsl_fc->inner_set, arg);
-          atomic_store_explicit(&fhsl_fc->pending_ops[i].op_ret.add, ans, memory_order_relaxed);
-          atomic_store_explicit(&fhsl_fc->pending_ops[i].pending_op, NONE, memory_order_release);
-        } else if(op == REMOVE) {
-          uint64_t arg = atomic_load_explicit(&fhsl_fc->pending_ops[i].op_arg.remove, memory_order_relaxed);
-          bool ans = c_fhsl_remove(fhsl_fc->inner_set, arg);
-          atomic_store_explicit(&fhsl_fc->pending_ops[i].op_ret.remove, ans, memory_order_relaxed);
-          atomic_store_explicit(&fhsl_fc->pending_ops[i].pending_op, NONE, memory_order_release);
-        } else if(op == POP_MIN) {
-          bool ans = c_fhsl_pop_min(fhsl_fc->inner_set);
-          atomic_store_explicit(&fhsl_fc->pending_ops[i].op_ret.pop_min, ans, memory_order_relaxed);
-          atomic_store_explicit(&fhsl_fc->pending_ops[i].pending_op, NONE, memory_order_release);
-        }
-      }
-      spinlock_unlock(&fhsl_fc->lock);
-      return;
-    } else {
-      wait(fhsl_fc, thread_id, 4000000);
-      bool done = atomic_load_explicit(&fhsl_fc->pending_ops[thread_id].pending_op, memory_order_acquire) != NONE;
-      if(done) {
-        return;
-      }
+    if(!try_combine(fhsl_fc)) {
+      wait(op, 4000000);
     }
   }
 }
 
+/** Return the next free slot in the thread's ring, or NULL if all depth
+ *  slots hold ops that have not been completed.
+ */
+static op_t *next_slot(c_fhsl_fc_t *set, size_t thread_id) {
+  ring_t *ring = &set->rings[thread_id];
+  uint64_t submitted = atomic_load_explicit(&ring->submitted, memory_order_relaxed);
+  if(submitted - ring->reaped == set->depth) {
+    return NULL;
+  }
+  return slot(set, thread_id, submitted);
+}
+
+static void post(c_fhsl_fc_t *set, op_t *op, op_type_t type, size_t thread_id) {
+  ring_t *ring = &set->rings[thread_id];
+  op->posted_op = type;
+  atomic_store_explicit(&op->pending_op, type, memory_order_release);
+  atomic_fetch_add_explicit(&ring->submitted, 1, memory_order_release);
+}
+
+/** Take the result of the thread's oldest op, which must have run, and
+ *  free its slot.  Return the op's answer.
+ */
+static bool reap(c_fhsl_fc_t *set, int64_t *key, int64_t *value, size_t thread_id) {
+  ring_t *ring = &set->rings[thread_id];
+  op_t *op = slot(set, thread_id, ring->reaped);
+  bool ans = false;
+  switch(op->posted_op) {
+  case CONTAINS:
+    ans = atomic_load_explicit(&op->op_ret.contains, memory_order_relaxed);
+    break;
+  case ADD:
+    ans = atomic_load_explicit(&op->op_ret.add, memory_order_relaxed);
+    if(ans) {
+      sharded_counter_add(set->size, thread_id, 1);
+      parking_lot_wake(set->waiters);
+    }
+    break;
+  case REMOVE:
+    ans = atomic_load_explicit(&op->op_ret.remove, memory_order_relaxed);
+    if(ans) { sharded_counter_add(set->size, thread_id, -1); }
+    break;
+  case POP_MIN:
+    ans = atomic_load_explicit(&op->op_ret.pop_min, memory_order_relaxed);
+    if(ans) { sharded_counter_add(set->size, thread_id, -1); }
+    break;
+  case PEEK_MIN:
+    ans = atomic_load_explicit(&op->op_ret.peek_min, memory_order_relaxed);
+    break;
+  default:
+    break;
+  }
+  if(ans && (op->posted_op == POP_MIN || op->posted_op == PEEK_MIN)) {
+    *key = atomic_load_explicit(&op->op_item.key, memory_order_relaxed);
+    *value = atomic_load_explicit(&op->op_item.value, memory_order_relaxed);
+  }
+  ring->reaped++;
+  return ans;
+}
+
+/** Return the slot for a blocking call, or NULL if the thread still has
+ *  submitted ops outstanding.  reap takes the oldest slot's answer, so a
+ *  blocking call posted behind other ops would be handed one of theirs.
+ *  With the ring idle there is always a free slot.
+ */
+static op_t *call_slot(c_fhsl_fc_t *set, size_t thread_id) {
+  ring_t *ring = &set->rings[thread_id];
+  bool idle = ring->reaped == atomic_load_explicit(&ring->submitted, memory_order_relaxed);
+  assert(idle);
+  return idle ? slot(set, thread_id, ring->reaped) : NULL;
+}
+
+/** Post one op and combine until it has run.  op is from call_slot.
+ */
+static bool call(c_fhsl_fc_t *set, op_t *op, op_type_t type, int64_t *key, int64_t *value, size_t thread_id) {
+  post(set, op, type, thread_id);
+  flat_combine(set, op);
+  return reap(set, key, value, thread_id);
+}
 
 /** Return a new fixed-height skip list.
  */
 c_fhsl_fc_t * c_fhsl_fc_create(size_t num_threads) {
+  return c_fhsl_fc_create_async(num_threads, 1);
+}
+
+static c_fhsl_fc_t * create(size_t num_threads, size_t depth, size_t registered) {
   c_fhsl_fc_t* fhsl_fc = forkscan_malloc(sizeof(c_fhsl_fc_t));
   fhsl_fc->num_threads = num_threads;
-  fhsl_fc->pending_ops = aligned_alloc(128, sizeof(op_t) * num_threads);
-  for(size_t i = 0; i < num_threads; i++) {
+  fhsl_fc->depth = depth;
+  fhsl_fc->pending_ops = aligned_alloc(128, sizeof(op_t) * num_threads * depth);
+  for(size_t i = 0; i < num_threads * depth; i++) {
     atomic_store_explicit(&fhsl_fc->pending_ops[i].pending_op, NONE, memory_order_relaxed); // Important, rest is not.
     atomic_store_explicit(&fhsl_fc->pending_ops[i].op_arg.contains, UINT64_MAX, memory_order_relaxed);
     atomic_store_explicit(&fhsl_fc->pending_ops[i].op_ret.contains, false, memory_order_relaxed);
+    fhsl_fc->pending_ops[i].posted_op = NONE;
+  }
+  fhsl_fc->rings = aligned_alloc(128, sizeof(ring_t) * num_threads);
+  for(size_t i = 0; i < num_threads; i++) {
+    atomic_store_explicit(&fhsl_fc->rings[i].submitted, 0, memory_order_relaxed);
+    fhsl_fc->rings[i].reaped = 0;
+    fhsl_fc->rings[i].served = 0;
   }
   spinlock_init(&fhsl_fc->lock);
   fhsl_fc->inner_set = c_fhsl_create();
+  fhsl_fc->slots = thread_slots_create(num_threads, registered);
+  fhsl_fc->size = sharded_counter_create(num_threads);
+  fhsl_fc->waiters = parking_lot_create();
   return fhsl_fc;
 }
 
+/** Return a new fixed-height skip list in which each thread may have up to
+ *  depth submitted ops outstanding.  Threads 0 to num_threads - 1 are all
+ *  registered.
+ */
+c_fhsl_fc_t * c_fhsl_fc_create_async(size_t num_threads, size_t depth) {
+  return create(num_threads, depth, num_threads);
+}
+
+/** Return a new fixed-height skip list with room for max_threads threads,
+ *  none of them registered.  Each thread takes its id from
+ *  c_fhsl_fc_register.
+ */
+c_fhsl_fc_t * c_fhsl_fc_create_dynamic(size_t max_threads, size_t depth) {
+  return create(max_threads, depth, 0);
+}
+
+/** Take a free thread slot and return its id, or SIZE_MAX if all are in
+ *  use.  The combiner scans only registered slots.
+ */
+size_t c_fhsl_fc_register(c_fhsl_fc_t *set) {
+  return thread_slots_register(set->slots);
+}
+
+/** Hand back the slot of a thread that is done with the queue.  Every op
+ *  the thread submitted must have been completed.
+ */
+void c_fhsl_fc_unregister(c_fhsl_fc_t *set, size_t thread_id) {
+  ring_t *ring = &set->rings[thread_id];
+  assert(ring->reaped == atomic_load_explicit(&ring->submitted, memory_order_relaxed));
+  (void)ring;
+  thread_slots_unregister(set->slots, thread_id);
+}
+
 /** Return whether the skip list contains the value.
  */
 int c_fhsl_fc_contains(c_fhsl_fc_t *set, int64_t key, size_t thread_id) {
-  atomic_store_explicit(&set->pending_ops[thread_id].op_arg.contains, key, memory_order_relaxed);
-  atomic_store_explicit(&set->pending_ops[thread_id].pending_op, CONTAINS, memory_order_release);
-  flat_combine(set, thread_id);
-  return atomic_load_explicit(&set->pending_ops[thread_id].op_ret.contains, memory_order_relaxed);
+  op_t *op = call_slot(set, thread_id);
+  if(op == NULL) { return false; }
+  int64_t k, v;
+  atomic_store_explicit(&op->op_arg.contains, key, memory_order_relaxed);
+  return call(set, op, CONTAINS, &k, &v, thread_id);
 }
 
 /** Add a node to the skiplist.
  */
 int c_fhsl_fc_add(c_fhsl_fc_t * set, int64_t key, size_t thread_id) {
-  atomic_store_explicit(&set->pending_ops[thread_id].op_arg.add, key, memory_order_relaxed);
-  atomic_store_explicit(&set->pending_ops[thread_id].pending_op, ADD, memory_order_release);
-  flat_combine(set, thread_id);
-  return atomic_load_explicit(&set->pending_ops[thread_id].op_ret.add, memory_order_relaxed);
+  return c_fhsl_fc_add_item(set, key, 0, thread_id);
+}
+
+/** Add a node carrying a value to the skiplist.
+ */
+int c_fhsl_fc_add_item(c_fhsl_fc_t * set, int64_t key, int64_t value, size_t thread_id) {
+  op_t *op = call_slot(set, thread_id);
+  if(op == NULL) { return false; }
+  int64_t k, v;
+  atomic_store_explicit(&op->op_arg.add, key, memory_order_relaxed);
+  atomic_store_explicit(&op->op_item.value, value, memory_order_relaxed);
+  return call(set, op, ADD, &k, &v, thread_id);
 }
 
 /** Remove a node from the skiplist.
  */
 int c_fhsl_fc_remove(c_fhsl_fc_t * set, int64_t key, size_t thread_id) {
-  atomic_store_explicit(&set->pending_ops[thread_id].op_arg.remove, key, memory_order_relaxed);
-  atomic_store_explicit(&set->pending_ops[thread_id].pending_op, REMOVE, memory_order_release);
-  flat_combine(set, thread_id);
-  return atomic_load_explicit(&set->pending_ops[thread_id].op_ret.remove, memory_order_relaxed);
+  op_t *op = call_slot(set, thread_id);
+  if(op == NULL) { return false; }
+  int64_t k, v;
+  atomic_store_explicit(&op->op_arg.remove, key, memory_order_relaxed);
+  return call(set, op, REMOVE, &k, &v, thread_id);
 }
 
+/** Pop the front node from the skiplist.  Return true iff there was a node
+ *  to pop.
+ */
 int c_fhsl_fc_pop_min(c_fhsl_fc_t *set, size_t thread_id) {
-  atomic_store_explicit(&set->pending_ops[thread_id].pending_op, POP_MIN, memory_order_release);
-  flat_combine(set, thread_id);
-  return atomic_load_explicit(&set->pending_ops[thread_id].op_ret.pop_min, memory_order_relaxed);
+  int64_t key, value;
+  return c_fhsl_fc_pop_min_item(set, &key, &value, thread_id);
+}
+
+/** Pop the front node from the skiplist and store its key and value.
+ *  Return true iff there was a node to pop.
+ */
+int c_fhsl_fc_pop_min_item(c_fhsl_fc_t *set, int64_t *key, int64_t *value, size_t thread_id) {
+  op_t *op = call_slot(set, thread_id);
+  if(op == NULL) { return false; }
+  return call(set, op, POP_MIN, key, value, thread_id);
+}
+
+typedef struct wait_ctx_t {
+  c_fhsl_fc_t *set;
+  size_t thread_id;
+} wait_ctx_t;
+
+static int try_pop_min(void *ctx, void *key, int64_t *value) {
+  wait_ctx_t *wait = ctx;
+  return c_fhsl_fc_pop_min_item(wait->set, key, value, wait->thread_id);
+}
+
+/** Pop the front node, waiting up to timeout_ns nanoseconds for one to
+ *  arrive if the skiplist is empty; a negative timeout waits forever.
+ *  Return false on timeout.  Each retry is a combined pop, so a parked
+ *  thread leaves no op pending while it sleeps.
+ */
+int c_fhsl_fc_pop_min_wait(c_fhsl_fc_t *set, int64_t *key, int64_t *value, int64_t timeout_ns, size_t thread_id) {
+  wait_ctx_t wait = { set, thread_id };
+  return parking_lot_wait(set->waiters, try_pop_min, &wait, key, value, timeout_ns);
+}
+
+/** Store the key and value of the front node without removing it.  Return
+ *  true iff there was one.  The combiner runs the peek in its pass like any
+ *  other op, so it is linearizable, and it costs as much as a contains.
+ */
+int c_fhsl_fc_peek_min(c_fhsl_fc_t *set, int64_t *key, int64_t *value, size_t thread_id) {
+  op_t *op = call_slot(set, thread_id);
+  if(op == NULL) { return false; }
+  return call(set, op, PEEK_MIN, key, value, thread_id);
+}
+
+/** Post an add without waiting for it to run.  Return false, posting
+ *  nothing, if the thread already has depth ops outstanding.  Submitted ops
+ *  run in the order they were posted and are completed in the same order
+ *  by c_fhsl_fc_poll or c_fhsl_fc_complete.
+ */
+int c_fhsl_fc_submit_add(c_fhsl_fc_t *set, int64_t key, int64_t value, size_t thread_id) {
+  op_t *op = next_slot(set, thread_id);
+  if(op == NULL) { return false; }
+  atomic_store_explicit(&op->op_arg.add, key, memory_order_relaxed);
+  atomic_store_explicit(&op->op_item.value, value, memory_order_relaxed);
+  post(set, op, ADD, thread_id);
+  return true;
+}
+
+/** Post a remove without waiting for it to run.  Return false if the ring
+ *  is full.
+ */
+int c_fhsl_fc_submit_remove(c_fhsl_fc_t *set, int64_t key, size_t thread_id) {
+  op_t *op = next_slot(set, thread_id);
+  if(op == NULL) { return false; }
+  atomic_store_explicit(&op->op_arg.remove, key, memory_order_relaxed);
+  post(set, op, REMOVE, thread_id);
+  return true;
+}
+
+/** Post a pop_min without waiting for it to run.  Return false if the ring
+ *  is full.
+ */
+int c_fhsl_fc_submit_pop_min(c_fhsl_fc_t *set, size_t thread_id) {
+  op_t *op = next_slot(set, thread_id);
+  if(op == NULL) { return false; }
+  post(set, op, POP_MIN, thread_id);
+  return true;
+}
+
+/** If the thread's oldest submitted op has run, store its answer (and, for
+ *  a successful pop_min, the key and value) and return true.  Combine once
+ *  if no other thread is, but never wait.  Return false if the op is still
+ *  pending or nothing is outstanding.
+ */
+int c_fhsl_fc_poll(c_fhsl_fc_t *set, int *ans, int64_t *key, int64_t *value, size_t thread_id) {
+  ring_t *ring = &set->rings[thread_id];
+  if(ring->reaped == atomic_load_explicit(&ring->submitted, memory_order_relaxed)) {
+    return false;
+  }
+  op_t *op = slot(set, thread_id, ring->reaped);
+  if(!done(op)) {
+    try_combine(set);
+    if(!done(op)) { return false; }
+  }
+  *ans = reap(set, key, value, thread_id);
+  return true;
+}
+
+/** Combine until the thread's oldest submitted op has run, then return its
+ *  answer and, for a successful pop_min, store the key and value.  The
+ *  thread must have an op outstanding.
+ */
+int c_fhsl_fc_complete(c_fhsl_fc_t *set, int64_t *key, int64_t *value, size_t thread_id) {
+  ring_t *ring = &set->rings[thread_id];
+  assert(ring->reaped != atomic_load_explicit(&ring->submitted, memory_order_relaxed));
+  flat_combine(set, slot(set, thread_id, ring->reaped));
+  return reap(set, key, value, thread_id);
+}
+
+/** Return the approximate number of nodes.  Each thread counts its own
+ *  successful ops on the shard for its thread id, and the read sums the
+ *  shards without combining, so it is exact only at quiescence.
+ */
+size_t c_fhsl_fc_size(c_fhsl_fc_t *set) {
+  return sharded_counter_read_size(set->size);
+}
+
+/** Free the queue and everything in it.  No other thread may be using the
+ *  queue.
+ */
+void c_fhsl_fc_destroy(c_fhsl_fc_t *set) {
+  c_fhsl_destroy(set->inner_set);
+  parking_lot_destroy(set->waiters);
+  sharded_counter_destroy(set->size);
+  free(set->pending_ops);
+  free(set->rings);
+  thread_slots_destroy(set->slots);
+  forkscan_free(set);
 }
\ No newline at end of file
@@ -6,9 +6,24 @@
 typedef struct c_fhsl_fc_t c_fhsl_fc_t;
 
 c_fhsl_fc_t * c_fhsl_fc_create(size_t num_threads);
+c_fhsl_fc_t * c_fhsl_fc_create_async(size_t num_threads, size_t depth);
+c_fhsl_fc_t * c_fhsl_fc_create_dynamic(size_t max_threads, size_t depth);
+size_t c_fhsl_fc_register(c_fhsl_fc_t *set);
+void c_fhsl_fc_unregister(c_fhsl_fc_t *set, size_t thread_id);
 
 int c_fhsl_fc_contains(c_fhsl_fc_t * set, int64_t key, size_t thread_id);
 int c_fhsl_fc_add(c_fhsl_fc_t * set, int64_t key, size_t thread_id);
+int c_fhsl_fc_add_item(c_fhsl_fc_t * set, int64_t key, int64_t value, size_t thread_id);
 int c_fhsl_fc_remove(c_fhsl_fc_t * set, int64_t key, size_t thread_id);
 int c_fhsl_fc_pop_min(c_fhsl_fc_t *set, size_t thread_id);
+int c_fhsl_fc_pop_min_item(c_fhsl_fc_t *set, int64_t *key, int64_t *value, size_t thread_id);
+int c_fhsl_fc_pop_min_wait(c_fhsl_fc_t *set, int64_t *key, int64_t *value, int64_t timeout_ns, size_t thread_id);
+int c_fhsl_fc_peek_min(c_fhsl_fc_t *set, int64_t *key, int64_t *value, size_t thread_id);
+int c_fhsl_fc_submit_add(c_fhsl_fc_t *set, int64_t key, int64_t value, size_t thread_id);
+int c_fhsl_fc_submit_remove(c_fhsl_fc_t *set, int64_t key, size_t thread_id);
+int c_fhsl_fc_submit_pop_min(c_fhsl_fc_t *set, size_t thread_id);
+int c_fhsl_fc_poll(c_fhsl_fc_t *set, int *ans, int64_t *key, int64_t *value, size_t thread_id);
+int c_fhsl_fc_complete(c_fhsl_fc_t *set, int64_t *key, int64_t *value, size_t thread_id);
+size_t c_fhsl_fc_size(c_fhsl_fc_t *set);
+void c_fhsl_fc_destroy(c_fhsl_fc_t *set);
 void c_fhsl_fc_print (c_fhsl_fc_t *set);
\ No newline at end of file
@@ -4,6 +4,7 @@
 
 #include "c_fhsl_fc_server.h"
 #include "c_fhsl.h"
+#include "thread_slots.h"
 
 #include <assert.h>
 #include <stdatomic.h>
@@ -33,7 +34,11 @@ struct op_t {
 struct c_fhsl_fc_server_t {
   size_t num_threads;
   op_t *pending_ops;
+  // The slots the server scans.
+  thread_slots_t *slots;
   pthread_t server_thread;
+  // Set by destroy; the server thread returns once it sees it.
+  atomic_bool stop;
   c_fhsl_t *inner_set;
 };
 
@@ -44,46 +49,50 @@ void c_fhsl_fc_server_print (c_fhsl_fc_server_t *set){
   c_fhsl_print(set->inner_set);
 }
 
+static void run_op(c_fhsl_t *inner_set, op_t *op) {
+  op_type_t type = atomic_load_explicit(&op->pending_op, memory_order_acquire);
+  if(type == CONTAINS) {
+    uint64_t arg = atomic_load_explicit(&op->op_arg.contains, memory_order_relaxed);
+    bool ans = c_fhsl_contains(inner_set, arg);
+    atomic_store_explicit(&op->op_ret.contains, ans, memory_order_relaxed);
+  } else if(type == ADD) {
+    uint64_t arg = atomic_load_explicit(&op->op_arg.add, memory_order_relaxed);
+    bool ans = c_fhsl_add(inner_set, arg);
+    atomic_store_explicit(&op->op_ret.add, ans, memory_order_relaxed);
+  } else if(type == REMOVE) {
+    uint64_t arg = atomic_load_explicit(&op->op_arg.remove, memory_order_relaxed);
+    bool ans = c_fhsl_remove(inner_set, arg);
+    atomic_store_explicit(&op->op_ret.remove, ans, memory_order_relaxed);
+  } else if(type == POP_MIN) {
+    bool ans = c_fhsl_pop_min(inner_set);
+    atomic_store_explicit(&op->op_ret.pop_min, ans, memory_order_relaxed);
+  } else {
+    return;
+  }
+  atomic_store_explicit(&op->pending_op, NONE, memory_order_release);
+}
+
 static void* server_thread_func(void *set) {
   c_fhsl_fc_server_t* fhsl_fc = set;
-  size_t num_threads = fhsl_fc->num_threads;
-  while(true) {
-    for(size_t i = 0; i < num_threads; i++) {
-      op_type_t op = atomic_load_explicit(&fhsl_fc->pending_ops[i].pending_op, memory_order_acquire);
-      if(op == NONE) {
-        continue;
-      } else if(op == CONTAINS) {
-        uint64_t arg = atomic_load_explicit(&fhsl_fc->pending_ops[i].op_arg.contains, memory_order_relaxed);
-        bool ans = c_fhsl_contains(fhsl_fc->inner_set, arg);
-        atomic_store_explicit(&fhsl_fc->pending_ops[i].op_ret.contains, ans, memory_order_relaxed);
-        atomic_store_explicit(&fhsl_fc->pending_ops[i].pending_op, NONE, memory_order_release);
-      } else if(op == ADD) {
-        uint64_t arg = atomic_load_explicit(&fhsl_fc->pending_ops[i].op_arg.add, memory_order_relaxed);
-        bool ans = c_fhsl_add(fhsl_fc->inner_set, arg);
-        atomic_store_explicit(&fhsl_fc->pending_ops[i].op_ret.add, ans, memory_order_relaxed);
-        atomic_store_explicit(&fhsl_fc->pending_ops[i].pending_op, NONE, memory_order_release);
-      } else if(op == REMOVE) {
-        uint64_t arg = atomic_load_explicit(&fhsl_fc->pending_ops[i].op_arg.remove, memory_order_relaxed);
-        bool ans = c_fhsl_remove(fhsl_fc->inner_set, arg);
-        atomic_store_explicit(&fhsl_fc->pending_ops[i].op_ret.remove, ans, memory_order_relaxed);
-        atomic_store_explicit(&fhsl_fc->pending_ops[i].pending_op, NONE, memory_order_release);
-      } else if(op == POP_MIN) {
-        bool ans = c_fhsl_pop_min(fhsl_fc->inner_set);
-        atomic_store_explicit(&fhsl_fc->pending_ops[i].op_ret.pop_min, ans, memory_order_relaxed);
-        atomic_store_explicit(&fhsl_fc->pending_ops[i].pending_op, NONE, memory_order_release);
+  size_t words = thread_slots_words(fhsl_fc->slots);
+  while(!atomic_load_explicit(&fhsl_fc->stop, memory_order_acquire)) {
+    // Only registered slots can hold an op.
+    for(size_t w = 0; w < words; w++) {
+      uint64_t bits = thread_slots_word(fhsl_fc->slots, w);
+      for(; bits != 0; bits &= bits - 1) {
+        run_op(fhsl_fc->inner_set, &fhsl_fc->pending_ops[w * 64 + __builtin_ctzll(bits)]);
       }
     }
     _mm_pause();
   }
+  return NULL;
 }
 
 static void wait(c_fhsl_fc_server_t *set, size_t thread_id) {
   while(atomic_load_explicit(&set->pending_ops[thread_id].pending_op, memory_order_acquire) != NONE) { _mm_pause(); }
 }
 
-/** Return a new fixed-height skip list.
- */
-c_fhsl_fc_server_t * c_fhsl_fc_server_create(size_t num_threads) {
+static c_fhsl_fc_server_t * create(size_t num_threads, size_t registered) {
   c_fhsl_fc_server_t* fhsl_fc = forkscan_malloc(sizeof(c_fhsl_fc_server_t));
   fhsl_fc->num_threads = num_threads;
   fhsl_fc->pending_ops = forkscan_malloc(sizeof(op_t) * num_threads);
@@ -92,11 +101,42 @@ c_fhsl_fc_server_t * c_fhsl_fc_server_create(size_t num_threads) {
     atomic_store_explicit(&fhsl_fc->pending_ops[i].op_arg.contains, UINT64_MAX, memory_order_relaxed);
     atomic_store_explicit(&fhsl_fc->pending_ops[i].op_ret.contains, false, memory_order_relaxed);
   }
-  pthread_create(&fhsl_fc->server_thread, NULL, server_thread_func, fhsl_fc);
+  fhsl_fc->slots = thread_slots_create(num_threads, registered);
+  atomic_store_explicit(&fhsl_fc->stop, false, memory_order_relaxed);
   fhsl_fc->inner_set = c_fhsl_create();
+  pthread_create(&fhsl_fc->server_thread, NULL, server_thread_func, fhsl_fc);
   return fhsl_fc;
 }
 
+/** Return a new fixed-height skip list for threads 0 to num_threads - 1,
+ *  all of them registered.
+ */
+c_fhsl_fc_server_t * c_fhsl_fc_server_create(size_t num_threads) {
+  return create(num_threads, num_threads);
+}
+
+/** Return a new fixed-height skip list with room for max_threads threads,
+ *  none of them registered.  Each thread takes its id from
+ *  c_fhsl_fc_server_register.
+ */
+c_fhsl_fc_server_t * c_fhsl_fc_server_create_dynamic(size_t max_threads) {
+  return create(max_threads, 0);
+}
+
+/** Take a free thread slot and return its id, or SIZE_MAX if all are in
+ *  use.  The server scans only registered slots.
+ */
+size_t c_fhsl_fc_server_register(c_fhsl_fc_server_t *set) {
+  return thread_slots_register(set->slots);
+}
+
+/** Hand back the slot of a thread that is done with the queue.  The thread
+ *  must not be in the middle of an op.
+ */
+void c_fhsl_fc_server_unregister(c_fhsl_fc_server_t *set, size_t thread_id) {
+  thread_slots_unregister(set->slots, thread_id);
+}
+
 /** Return whether the skip list contains the value.
  */
 int c_fhsl_fc_server_contains(c_fhsl_fc_server_t *set, int64_t key, size_t thread_id) {
@@ -128,4 +168,16 @@ int c_fhsl_fc_server_pop_min(c_fhsl_fc_server_t *set, size_t thread_id) {
   atomic_store_explicit(&set->pending_ops[thread_id].pending_op, POP_MIN, memory_order_release);
   wait(set, thread_id);
   return atomic_load_explicit(&set->pending_ops[thread_id].op_ret.pop_min, memory_order_relaxed);
+}
+
+/** Stop and join the server thread, then free the queue and everything in
+ *  it.  No other thread may be using the queue.
+ */
+void c_fhsl_fc_server_destroy(c_fhsl_fc_server_t *set) {
+  atomic_store_explicit(&set->stop, true, memory_order_release);
+  pthread_join(set->server_thread, NULL);
+  c_fhsl_destroy(set->inner_set);
+  thread_slots_destroy(set->slots);
+  forkscan_free(set->pending_ops);
+  forkscan_free(set);
 }
\ No newline at end of file
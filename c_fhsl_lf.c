@@ -3,6 +3,8 @@
  */
 
 #include "c_fhsl_lf.h"
+#include "sharded_counter.h"
+#include "node_pool.h"
 
 #include <stdatomic.h>
 #include <stdbool.h>
@@ -10,28 +12,63 @@
 #include <stdio.h>
 #include "utils.h"
 
-#define N 20
+#define N SKIPLIST_HEIGHT
 #define BOTTOM 0
 
 
 struct node_t {
-  int64_t key;
+  pq_key_t key;
+  uint64_t seq;
   int32_t toplevel;
-  _Atomic(node_ptr) next[N];
+  // Sized to toplevel + 1 by node_create.
+  _Atomic(node_ptr) next[];
 };
 
 struct c_fhsl_lf_t {
-  node_t head, tail;
+  // Sequence numbers for add_dup, off the lines that finds read.
+  _Atomic(uint64_t) seq;
+  char padding[128];
+  // Adds and claims begun and ended, which snapshot scans validate against.
+  sharded_counter_t *begun, *ended;
+  // Highest level any node has been linked at; searches start there.
+  _Atomic(int32_t) toplevel;
+  sharded_counter_t *size;
+  node_ptr head, tail;
 };
 
 
-static node_ptr node_create(int64_t key, int32_t toplevel){
-  node_ptr node = forkscan_malloc(sizeof(node_t));
+/** Return the bytes a node with a tower toplevel + 1 high takes.
+ */
+static size_t node_size(int32_t toplevel) {
+  return sizeof(node_t) + (toplevel + 1) * sizeof(node_ptr);
+}
+
+/** Allocate a node with a tower of toplevel + 1 links.  Most nodes are
+ *  height 1, so this keeps them to the key, seq and one link rather than
+ *  the full N.
+ */
+static node_ptr node_create(pq_key_t key, uint64_t seq, int32_t toplevel){
+  node_ptr node = node_pool_alloc(node_size(toplevel));
   node->key = key;
+  node->seq = seq;
   node->toplevel = toplevel;
   return node;
 }
 
+/** Hand a node no other thread can reach back to the node pool.
+ */
+static void node_free(node_ptr node) {
+  if(node != NULL) {
+    node_pool_free(node, node_size(node->toplevel));
+  }
+}
+
+/** Retire a node other threads may still reach.
+ */
+static void node_retire(node_ptr node) {
+  node_pool_retire(node, node_size(node->toplevel));
+}
+
 static node_ptr node_unmark(node_ptr node){
   return (node_ptr)(((size_t)node) & (~0x1));
 }
@@ -44,15 +81,45 @@ static bool node_is_marked(node_ptr node){
   return node_unmark(node) != node;
 }
 
+/** Return the highest level any node has been linked at.  The levels above
+ *  it are empty, so a search starts here rather than at the top of the
+ *  head's tower, which in a small list skips most of it.
+ */
+static int32_t top_level(c_fhsl_lf_t *set) {
+  return atomic_load_explicit(&set->toplevel, memory_order_relaxed);
+}
+
+/** Raise the top level to cover a node of height toplevel + 1.  This is
+ *  done before the node is linked, so that by the time a search can reach
+ *  the node it starts at or above the node's top.
+ */
+static void raise_top_level(c_fhsl_lf_t *set, int32_t toplevel) {
+  int32_t top = atomic_load_explicit(&set->toplevel, memory_order_relaxed);
+  while(top < toplevel && !atomic_compare_exchange_weak_explicit(&set->toplevel,
+    &top, toplevel, memory_order_seq_cst, memory_order_relaxed)) {}
+}
+
+/** Point preds and succs at the head and tail on the empty levels above the
+ *  top level, and return the top level for the search to start at.
+ */
+static int32_t skip_empty_levels(c_fhsl_lf_t *set, node_ptr preds[N], node_ptr succs[N]) {
+  int32_t top = top_level(set);
+  for(int64_t level = N - 1; level > top; --level) {
+    preds[level] = set->head;
+    succs[level] = set->tail;
+  }
+  return top;
+}
+
 /** Print out the contents of the skip list along with node heights.
  */
 void c_fhsl_lf_print (c_fhsl_lf_t *set){
-  node_ptr node = atomic_load_explicit(&set->head.next[0], memory_order_consume);
-  while(node_unmark(node) != &set->tail) {
+  node_ptr node = atomic_load_explicit(&set->head->next[0], memory_order_consume);
+  while(node_unmark(node) != set->tail) {
     node_ptr next = atomic_load_explicit(&node->next[0], memory_order_consume);
     if(!node_is_marked(next)) {
       node = node_unmark(node);
-      printf("node[%d]: %ld\n", node->toplevel, node->key);
+      printf("node[%d]: %ld\n", node->toplevel, (long)node->key);
     }
     node = next;
   }
@@ -62,20 +129,25 @@ void c_fhsl_lf_print (c_fhsl_lf_t *set){
  */
 c_fhsl_lf_t * c_fhsl_lf_create() {
   c_fhsl_lf_t* fhsl_lf = forkscan_malloc(sizeof(c_fhsl_lf_t));
-  fhsl_lf->head.key = INT64_MIN;
-  fhsl_lf->tail.key = INT64_MAX;
+  fhsl_lf->head = node_create(PQ_KEY_MIN, 0, N - 1);
+  fhsl_lf->tail = node_create(PQ_KEY_MAX, UINT64_MAX, N - 1);
+  atomic_store_explicit(&fhsl_lf->seq, 0, memory_order_relaxed);
+  atomic_store_explicit(&fhsl_lf->toplevel, 0, memory_order_relaxed);
+  fhsl_lf->size = sharded_counter_create(SHARDED_COUNTER_LOCAL_SHARDS);
+  fhsl_lf->begun = sharded_counter_create(SHARDED_COUNTER_LOCAL_SHARDS);
+  fhsl_lf->ended = sharded_counter_create(SHARDED_COUNTER_LOCAL_SHARDS);
   for(int64_t i = 0; i < N; i++) {
-    atomic_store_explicit(&fhsl_lf->head.next[i], &fhsl_lf->tail, memory_order_relaxed);
-    atomic_store_explicit(&fhsl_lf->tail.next[i], NULL, memory_order_relaxed);
+    atomic_store_explicit(&fhsl_lf->head->next[i], fhsl_lf->tail, memory_order_relaxed);
+    atomic_store_explicit(&fhsl_lf->tail->next[i], NULL, memory_order_relaxed);
   }
   return fhsl_lf;
 }
 
 /** Return whether the skip list contains the value.
  */
-int c_fhsl_lf_contains(c_fhsl_lf_t *set, int64_t key) {
-  node_ptr node = &set->head;
-  for(int64_t i = N - 1; i >= 0; i--) {
+int c_fhsl_lf_contains(c_fhsl_lf_t *set, pq_key_t key) {
+  node_ptr node = set->head;
+  for(int64_t i = top_level(set); i >= 0; i--) {
     node_ptr next = node_unmark(atomic_load_explicit(&node->next[i], memory_order_consume));
     while(next->key <= key) {
       node = next; 
@@ -88,9 +160,9 @@ int c_fhsl_lf_contains(c_fhsl_lf_t *set, int64_t key) {
   return false;
 }
 
-int c_fhsl_lf_contains_serial(c_fhsl_lf_t * set, int64_t key) {
-  node_ptr node = &set->head;
-  for(int64_t i = N - 1; i >= 0; i--) {
+int c_fhsl_lf_contains_serial(c_fhsl_lf_t * set, pq_key_t key) {
+  node_ptr node = set->head;
+  for(int64_t i = top_level(set); i >= 0; i--) {
     node_ptr next = atomic_load_explicit(&node->next[i], memory_order_relaxed);
     while(next->key <= key) {
       node = next; 
@@ -103,16 +175,62 @@ int c_fhsl_lf_contains_serial(c_fhsl_lf_t * set, int64_t key) {
   return false;
 }
 
-static bool find(c_fhsl_lf_t *set, int64_t key, 
-  node_ptr preds[N], node_ptr succs[N]) {
+/** The CAS that makes an add or a claim take effect, counted as begun
+ *  before it and ended after it so that snapshot scans can tell whether
+ *  it overlapped them.  The counts go to the calling thread's shard, so
+ *  updates do not contend on them.  The release fences order the begun
+ *  count before the CAS and the CAS before the ended count.
+ */
+static bool update_cas(c_fhsl_lf_t *set, _Atomic(node_ptr) *link, node_ptr *expected, node_ptr desired) {
+  sharded_counter_add_local(set->begun, 1);
+  atomic_thread_fence(memory_order_release);
+  bool done = atomic_compare_exchange_weak_explicit(link, expected, desired,
+    memory_order_seq_cst, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  sharded_counter_add_local(set->ended, 1);
+  return done;
+}
+
+/** Wait until no add or claim is under way and return the number begun.
+ *  The ended counts are read before the begun ones, and no shard's ended
+ *  count passes its begun count, so equal sums mean that every update
+ *  begun had ended at some instant between the two reads, and the scan
+ *  that follows sees all of them.
+ */
+static int64_t wait_for_updates(c_fhsl_lf_t *set) {
+  while(true) {
+    int64_t ended = sharded_counter_read(set->ended);
+    atomic_thread_fence(memory_order_acquire);
+    int64_t begun = sharded_counter_read(set->begun);
+    atomic_thread_fence(memory_order_acquire);
+    if(begun == ended) { return begun; }
+  }
+}
+
+/** Order nodes by key, then by sequence number.  Plain adds use sequence
+ *  0, which sorts ahead of every duplicate of the same key.
+ */
+static bool node_less(node_ptr node, pq_key_t key, uint64_t seq) {
+  return node->key < key || (node->key == key && node->seq < seq);
+}
+
+/** Fill preds and succs for (key, seq) and return whether a node with key
+ *  is at succs[BOTTOM].  If hinted, preds already holds the predecessors of
+ *  a smaller key and each level resumes from there rather than from the
+ *  head.
+ */
+static bool find_from(c_fhsl_lf_t *set, pq_key_t key, uint64_t seq,
+  node_ptr preds[N], node_ptr succs[N], bool hinted) {
   bool marked, snip;
 retry:
   while(true) {
-    node_ptr left = &set->head, right = NULL;
-    for(int64_t level = N - 1; level >= BOTTOM; --level) {
+    node_ptr left = set->head, right = NULL;
+    int32_t top = skip_empty_levels(set, preds, succs);
+    for(int64_t level = top; level >= BOTTOM; --level) {
+      if(hinted && preds[level]->key > left->key) { left = preds[level]; }
       node_ptr left_next = atomic_load_explicit(&left->next[level], memory_order_consume);
-      // Is our current node invalid?
-      if(node_is_marked(left_next)) { goto retry; }
+      // Is our current node invalid?  A stale hint is, so drop the hints.
+      if(node_is_marked(left_next)) { hinted = false; goto retry; }
       node_ptr right = left_next;
       // Find two nodes to put into preds and succs.
       while(true) {
@@ -123,7 +241,7 @@ retry:
           right_next = atomic_load_explicit(&right->next[level], memory_order_consume);
         }
         // Has the right not gone far enough?        
-        if(right->key < key) {
+        if(node_less(right, key, seq)) {
           left = right;
           left_next = right_next;
           right = right_next;
@@ -145,10 +263,16 @@ retry:
   }
 }
 
-static bool find_serial(c_fhsl_lf_t *set, int64_t key, 
+static bool find(c_fhsl_lf_t *set, pq_key_t key, 
   node_ptr preds[N], node_ptr succs[N]) {
-  node_ptr left = &set->head, right = left;
-  for(int64_t level = N - 1; level >= BOTTOM; --level) {
+  return find_from(set, key, 0, preds, succs, false);
+}
+
+static bool find_serial(c_fhsl_lf_t *set, pq_key_t key, 
+  node_ptr preds[N], node_ptr succs[N]) {
+  node_ptr left = set->head, right = left;
+  int32_t top = skip_empty_levels(set, preds, succs);
+  for(int64_t level = top; level >= BOTTOM; --level) {
     right = left->next[level];
     // Has the right not gone far enough?        
     while(right->key < key) {
@@ -161,23 +285,26 @@ static bool find_serial(c_fhsl_lf_t *set, int64_t key,
   return succs[BOTTOM]->key == key;
 }
 
-/** Add a node, lock-free, to the skiplist.
+/** Insert (key, seq).  Sequence 0 is a plain add and fails if key is
+ *  already present; any other sequence always goes in, after every older
+ *  duplicate of key.  If node is not NULL it is linked in, at its own
+ *  height, in place of a new node, and freed if the add fails.
  */
-int c_fhsl_lf_add(uint64_t *seed, c_fhsl_lf_t * set, int64_t key) {
-  node_ptr preds[N], succs[N];
-  int32_t toplevel = random_level(seed, N);
-  node_ptr node = NULL;
+static int add_from(uint64_t *seed, c_fhsl_lf_t * set, pq_key_t key, uint64_t seq,
+  node_ptr node, node_ptr preds[N], node_ptr succs[N], bool hinted) {
+  int32_t toplevel = node != NULL ? node->toplevel : random_level(seed, N);
+  raise_top_level(set, toplevel);
   while(true) {
-    if(find(set, key, preds, succs)) {
-      forkscan_free((void*)node);
+    if(find_from(set, key, seq, preds, succs, hinted) && seq == 0) {
+      node_free(node);
       return false;
     }
-    if(node == NULL) { node = node_create(key, toplevel); }
+    if(node == NULL) { node = node_create(key, seq, toplevel); }
     for(int64_t i = BOTTOM; i <= toplevel; ++i) {
       atomic_store_explicit(&node->next[i], succs[i], memory_order_release);
     }
     node_ptr pred = preds[BOTTOM], succ = succs[BOTTOM];
-    if(!atomic_compare_exchange_weak_explicit(&pred->next[BOTTOM], &succ, node, memory_order_release, memory_order_relaxed)) {
+    if(!update_cas(set, &pred->next[BOTTOM], &succ, node)) {
       continue;
     }
     for(int64_t i = 1; i <= toplevel; i++) {
@@ -187,35 +314,69 @@ int c_fhsl_lf_add(uint64_t *seed, c_fhsl_lf_t * set, int64_t key) {
           &succ, node, memory_order_release, memory_order_relaxed)) {
           break;
         }
-        bool _ = find(set, key, preds, succs);
+        bool _ = find_from(set, key, seq, preds, succs, false);
       }
     }
+    sharded_counter_add_local(set->size, 1);
     return true;
   }
 }
 
-int c_fhsl_lf_add_serial(uint64_t *seed, c_fhsl_lf_t * set, int64_t key) {
+/** Add a node, lock-free, to the skiplist.
+ */
+int c_fhsl_lf_add(uint64_t *seed, c_fhsl_lf_t * set, pq_key_t key) {
+  node_ptr preds[N], succs[N];
+  return add_from(seed, set, key, 0, NULL, preds, succs, false);
+}
+
+/** Add a node, lock-free, to the skiplist even if key is already present.
+ *  Equal keys pop in the order they were added.
+ */
+int c_fhsl_lf_add_dup(uint64_t *seed, c_fhsl_lf_t * set, pq_key_t key) {
+  node_ptr preds[N], succs[N];
+  uint64_t seq = atomic_fetch_add_explicit(&set->seq, 1, memory_order_relaxed) + 1;
+  return add_from(seed, set, key, seq, NULL, preds, succs, false);
+}
+
+/** Add n keys, lock-free, to the skiplist.  The keys are sorted in place
+ *  and spliced in left to right, each search resuming from the
+ *  predecessors of the key before it.  Return the number of keys added.
+ */
+int c_fhsl_lf_add_batch(uint64_t *seed, c_fhsl_lf_t * set, pq_key_t *keys, size_t n) {
+  node_ptr preds[N], succs[N];
+  int added = 0;
+  pq_key_sort(keys, n);
+  for(size_t i = 0; i < n; i++) {
+    if(i > 0 && keys[i] == keys[i - 1]) { continue; }
+    added += add_from(seed, set, keys[i], 0, NULL, preds, succs, i > 0);
+  }
+  return added;
+}
+
+int c_fhsl_lf_add_serial(uint64_t *seed, c_fhsl_lf_t * set, pq_key_t key) {
   node_ptr preds[N], succs[N];
   int32_t toplevel = -1;
   node_ptr node = NULL;
   if(find(set, key, preds, succs)) {
-    forkscan_free((void*)node);
+    node_free(node);
     return false;
   }
   if(node == NULL) { 
     toplevel = random_level(seed, N);
-    node = node_create(key, toplevel); 
+    node = node_create(key, 0, toplevel); 
   }
+  raise_top_level(set, toplevel);
   for(int64_t i = BOTTOM; i <= toplevel; ++i) {
     node->next[i] = succs[i];
     preds[i]->next[i] = node;
   }
+  sharded_counter_add_local(set->size, 1);
   return true;
 }
 
 /** Remove a node, lock-free, from the skiplist.
  */
-int c_fhsl_lf_remove_leaky(c_fhsl_lf_t * set, int64_t key) {
+int c_fhsl_lf_remove_leaky(c_fhsl_lf_t * set, pq_key_t key) {
   node_ptr preds[N], succs[N];
   node_ptr succ = NULL;
   while(true) {
@@ -237,11 +398,11 @@ int c_fhsl_lf_remove_leaky(c_fhsl_lf_t * set, int64_t key) {
     marked = node_is_marked(succ);
     if(marked) { return false; }
     while(true) {
-      bool i_marked_it = atomic_compare_exchange_weak_explicit(&node_to_remove->next[BOTTOM],
-        &succ, node_mark(succ), memory_order_relaxed, memory_order_relaxed);
+      bool i_marked_it = update_cas(set, &node_to_remove->next[BOTTOM], &succ, node_mark(succ));
       marked = node_is_marked(succ);
       if(i_marked_it) {
         bool _ = find(set, key, preds, succs);
+        sharded_counter_add_local(set->size, -1);
         return true;
       } else if(marked) {
         return false;
@@ -250,7 +411,7 @@ int c_fhsl_lf_remove_leaky(c_fhsl_lf_t * set, int64_t key) {
   }
 }
 
-int c_fhsl_lf_remove_leaky_serial(c_fhsl_lf_t * set, int64_t key) {
+int c_fhsl_lf_remove_leaky_serial(c_fhsl_lf_t * set, pq_key_t key) {
   node_ptr preds[N], succs[N];
   if(!find(set, key, preds, succs)) {
     return false;
@@ -260,12 +421,13 @@ int c_fhsl_lf_remove_leaky_serial(c_fhsl_lf_t * set, int64_t key) {
     node_ptr next = atomic_load_explicit(&node->next[i], memory_order_relaxed);
     atomic_store_explicit(&preds[i]->next[i], next, memory_order_relaxed);
   }
+  sharded_counter_add_local(set->size, -1);
   return true;
 }
 
 /** Remove a node, lock-free, from the skiplist.
  */
-int c_fhsl_lf_remove(c_fhsl_lf_t * set, int64_t key) {
+int c_fhsl_lf_remove(c_fhsl_lf_t * set, pq_key_t key) {
   node_ptr preds[N], succs[N];
   node_ptr succ = NULL;
   while(true) {
@@ -286,12 +448,12 @@ int c_fhsl_lf_remove(c_fhsl_lf_t * set, int64_t key) {
     succ = atomic_load_explicit(&node_to_remove->next[BOTTOM], memory_order_relaxed);
     marked = node_is_marked(succ);
     while(true) {
-      bool i_marked_it = atomic_compare_exchange_weak_explicit(&node_to_remove->next[BOTTOM],
-        &succ, node_mark(succ), memory_order_relaxed, memory_order_relaxed);
+      bool i_marked_it = update_cas(set, &node_to_remove->next[BOTTOM], &succ, node_mark(succ));
       marked = node_is_marked(succ);
       if(i_marked_it) {
         bool _ = find(set, key, preds, succs);
-        forkscan_retire(node_to_remove);
+        node_retire(node_to_remove);
+        sharded_counter_add_local(set->size, -1);
         return true;
       } else if(marked) {
         return false;
@@ -302,7 +464,7 @@ int c_fhsl_lf_remove(c_fhsl_lf_t * set, int64_t key) {
 
 /** Remove a node, lock-free, from the skiplist.
  */
-int c_fhsl_lf_remove_serial(c_fhsl_lf_t * set, int64_t key) {
+int c_fhsl_lf_remove_serial(c_fhsl_lf_t * set, pq_key_t key) {
   node_ptr preds[N], succs[N];
   if(!find(set, key, preds, succs)) {
     return false;
@@ -311,7 +473,8 @@ int c_fhsl_lf_remove_serial(c_fhsl_lf_t * set, int64_t key) {
   for(int64_t i = BOTTOM; i <= node->toplevel; ++i) {
     preds[i]->next[i] = node->next[i];
   }
-  forkscan_retire(node);
+  node_retire(node);
+  sharded_counter_add_local(set->size, -1);
   return true;
 }
 
@@ -321,12 +484,12 @@ int c_fhsl_lf_pop_min_leaky (c_fhsl_lf_t *set) {
   node_ptr preds[N], succs[N];
   node_ptr succ = NULL;
   while(true) {
-    node_ptr node_to_remove = atomic_load_explicit(&set->head.next[0], memory_order_relaxed);
-    if (node_to_remove == &set->tail) {
+    node_ptr node_to_remove = atomic_load_explicit(&set->head->next[0], memory_order_relaxed);
+    if (node_to_remove == set->tail) {
       return false;
     }
     for(int64_t level = node_to_remove->toplevel; level >= 1; --level) {
-      preds[level] = &set->head;
+      preds[level] = set->head;
       succs[level] = node_to_remove;
     }
 
@@ -342,21 +505,23 @@ int c_fhsl_lf_pop_min_leaky (c_fhsl_lf_t *set) {
     }
     succ = node_unmark(atomic_load_explicit(&node_to_remove->next[BOTTOM], memory_order_relaxed));
 
-    if (atomic_compare_exchange_weak_explicit(&node_to_remove->next[BOTTOM], &succ, node_mark(succ), memory_order_relaxed, memory_order_relaxed)) {
-      bool _ = find(set, node_to_remove->key, preds, succs);
+    if (update_cas(set, &node_to_remove->next[BOTTOM], &succ, node_mark(succ))) {
+      bool _ = find_from(set, node_to_remove->key, node_to_remove->seq, preds, succs, false);
+      sharded_counter_add_local(set->size, -1);
       return true;
     }
   }
 }
 
 int c_fhsl_lf_pop_min_leaky_serial (c_fhsl_lf_t *set) {
-  node_ptr head_node = set->head.next[BOTTOM];
-  if(head_node != &set->tail) {
+  node_ptr head_node = set->head->next[BOTTOM];
+  if(head_node != set->tail) {
     node_ptr node_popped = head_node;
     int64_t toplevel = node_popped->toplevel;
     for(int64_t i = BOTTOM; i <= toplevel; i++) {
-      set->head.next[i] = node_popped->next[i];
+      set->head->next[i] = node_popped->next[i];
     }
+    sharded_counter_add_local(set->size, -1);
     return true;
   }
   return false;
@@ -366,12 +531,12 @@ int c_fhsl_lf_pop_min(c_fhsl_lf_t *set) {
   node_ptr preds[N], succs[N];
   node_ptr succ = NULL;
   while(true) {
-    node_ptr node_to_remove = atomic_load_explicit(&set->head.next[BOTTOM], memory_order_relaxed);
-    if (node_to_remove == &set->tail) {
+    node_ptr node_to_remove = atomic_load_explicit(&set->head->next[BOTTOM], memory_order_relaxed);
+    if (node_to_remove == set->tail) {
       return false;
     }
     for(int64_t level = node_to_remove->toplevel; level >= 1; --level) {
-      preds[level] = &set->head;
+      preds[level] = set->head;
       succs[level] = node_to_remove;
     }
 
@@ -387,24 +552,317 @@ int c_fhsl_lf_pop_min(c_fhsl_lf_t *set) {
     }
     succ = node_unmark(atomic_load_explicit(&node_to_remove->next[BOTTOM], memory_order_relaxed));
 
-    if (atomic_compare_exchange_weak_explicit(&node_to_remove->next[BOTTOM], &succ, node_mark(succ), memory_order_relaxed, memory_order_relaxed)) {
-      bool _ = find(set, node_to_remove->key, preds, succs);
-      forkscan_retire(node_to_remove);
+    if (update_cas(set, &node_to_remove->next[BOTTOM], &succ, node_mark(succ))) {
+      bool _ = find_from(set, node_to_remove->key, node_to_remove->seq, preds, succs, false);
+      node_retire(node_to_remove);
+      sharded_counter_add_local(set->size, -1);
       return true;
     }
   }
 }
 
 int c_fhsl_lf_pop_min_serial (c_fhsl_lf_t *set) {
-  node_ptr head_node = set->head.next[BOTTOM];
-  if(head_node != &set->tail) {
+  node_ptr head_node = set->head->next[BOTTOM];
+  if(head_node != set->tail) {
     node_ptr node_popped = head_node;
     int64_t toplevel = node_popped->toplevel;
     for(int64_t i = BOTTOM; i <= toplevel; i++) {
-      set->head.next[i] = node_popped->next[i];
+      set->head->next[i] = node_popped->next[i];
     }
-    forkscan_retire(node_popped);
+    node_retire(node_popped);
+    sharded_counter_add_local(set->size, -1);
     return true;
   }
   return false;
 }
+
+/** Return the last node on the bottom level, or the head if there is none.
+ *  Each level is walked to its end before dropping to the next, so the
+ *  search costs what a find for the largest key would.  The node returned
+ *  may already be claimed.
+ */
+static node_ptr find_last(c_fhsl_lf_t *set) {
+  node_ptr node = set->head;
+  for(int64_t level = top_level(set); level >= BOTTOM; --level) {
+    node_ptr next = node_unmark(atomic_load_explicit(&node->next[level], memory_order_consume));
+    while(next != set->tail) {
+      node = next;
+      next = node_unmark(atomic_load_explicit(&node->next[level], memory_order_consume));
+    }
+  }
+  return node;
+}
+
+/** Claim the last node the way remove claims a node by key: mark its upper
+ *  levels, then race for the bottom mark.  A last node that is already
+ *  claimed is unlinked first, so that the next search finds the node
+ *  before it.  Once the upper levels are marked the node is committed to,
+ *  even if a larger key lands behind it before the bottom mark goes in.
+ */
+static int pop_max(c_fhsl_lf_t *set, bool retire) {
+  node_ptr preds[N], succs[N];
+  while(true) {
+    node_ptr node_to_remove = find_last(set);
+    if(node_to_remove == set->head) {
+      return false;
+    }
+    node_ptr succ = atomic_load_explicit(&node_to_remove->next[BOTTOM], memory_order_relaxed);
+    if(node_is_marked(succ)) {
+      bool _ = find_from(set, node_to_remove->key, node_to_remove->seq, preds, succs, false);
+      continue;
+    }
+    for(int64_t level = node_to_remove->toplevel; level >= 1; --level) {
+      node_ptr upper = atomic_load_explicit(&node_to_remove->next[level], memory_order_relaxed);
+      while(!node_is_marked(upper)) {
+        bool _ = atomic_compare_exchange_weak_explicit(&node_to_remove->next[level], &upper,
+          node_mark(upper), memory_order_relaxed, memory_order_relaxed);
+      }
+    }
+    bool claimed = false;
+    while(!claimed && !node_is_marked(succ)) {
+      claimed = update_cas(set, &node_to_remove->next[BOTTOM], &succ, node_mark(succ));
+    }
+    if(claimed) {
+      bool _ = find_from(set, node_to_remove->key, node_to_remove->seq, preds, succs, false);
+      if(retire) { node_retire(node_to_remove); }
+      sharded_counter_add_local(set->size, -1);
+      return true;
+    }
+  }
+}
+
+/** Pop the back node from the list.  Return true iff there was a node to
+ *  pop.  Leak the memory.
+ */
+int c_fhsl_lf_pop_max_leaky(c_fhsl_lf_t *set) {
+  return pop_max(set, false);
+}
+
+/** Pop the back node from the list.  Return true iff there was a node to
+ *  pop.
+ */
+int c_fhsl_lf_pop_max(c_fhsl_lf_t *set) {
+  return pop_max(set, true);
+}
+
+/** Claim up to k of the smallest nodes in one sweep along the bottom
+ *  level, then unlink them all with a single find.  The claimed keys are
+ *  stored in keys, smallest first.  Return the number claimed.
+ */
+static size_t pop_many(c_fhsl_lf_t *set, size_t k, pq_key_t *keys, bool retire) {
+  node_ptr preds[N], succs[N];
+  size_t count = 0;
+  pq_key_t last_key = PQ_KEY_MIN;
+  uint64_t last_seq = 0;
+  node_ptr node = node_unmark(atomic_load_explicit(&set->head->next[BOTTOM], memory_order_relaxed));
+  while(count < k && node != set->tail) {
+    node_ptr succ = atomic_load_explicit(&node->next[BOTTOM], memory_order_relaxed);
+    if(!node_is_marked(succ)) {
+      for(int64_t level = node->toplevel; level >= 1; --level) {
+        node_ptr upper = atomic_load_explicit(&node->next[level], memory_order_relaxed);
+        while(!node_is_marked(upper)) {
+          bool _ = atomic_compare_exchange_weak_explicit(&node->next[level], &upper,
+            node_mark(upper), memory_order_relaxed, memory_order_relaxed);
+        }
+      }
+      // Retry past concurrent inserts until either we or another popper
+      // marks the bottom pointer.
+      bool claimed = false;
+      while(!claimed && !node_is_marked(succ)) {
+        claimed = update_cas(set, &node->next[BOTTOM], &succ, node_mark(succ));
+      }
+      if(claimed) {
+        keys[count++] = node->key;
+        last_key = node->key;
+        last_seq = node->seq;
+        // Forkscan holds off the free until the node is unreachable.
+        if(retire) { node_retire(node); }
+      }
+    }
+    node = node_unmark(succ);
+  }
+  if(count > 0) {
+    bool _ = find_from(set, last_key, last_seq, preds, succs, false);
+    sharded_counter_add_local(set->size, -(int64_t)count);
+  }
+  return count;
+}
+
+/** Pop up to k of the smallest nodes into keys, smallest first.  Return the
+ *  number popped.  Leak the memory.
+ */
+size_t c_fhsl_lf_pop_many_leaky(c_fhsl_lf_t *set, size_t k, pq_key_t *keys) {
+  return pop_many(set, k, keys, false);
+}
+
+/** Pop up to k of the smallest nodes into keys, smallest first.  Return the
+ *  number popped.
+ */
+size_t c_fhsl_lf_pop_many(c_fhsl_lf_t *set, size_t k, pq_key_t *keys) {
+  return pop_many(set, k, keys, true);
+}
+
+/** Store the smallest key without removing it.  Return true iff there was
+ *  one.  A node whose bottom pointer is marked has been claimed, so this
+ *  returns the first node that was unclaimed when the scan passed it.
+ *  Exact only at quiescence: a concurrent pop may claim the node before the
+ *  caller looks.
+ */
+int c_fhsl_lf_peek_min(c_fhsl_lf_t *set, pq_key_t *key) {
+  node_ptr node = node_unmark(atomic_load_explicit(&set->head->next[BOTTOM], memory_order_consume));
+  while(node != set->tail) {
+    node_ptr succ = atomic_load_explicit(&node->next[BOTTOM], memory_order_consume);
+    if(!node_is_marked(succ)) {
+      *key = node->key;
+      return true;
+    }
+    node = node_unmark(succ);
+  }
+  return false;
+}
+
+/** Store, smallest first, up to k keys in [low, high] and return how
+ *  many were stored.  The search descends to the last node below low and
+ *  then walks the bottom level, skipping nodes whose bottom pointer is
+ *  marked.  The result is weakly consistent: a key in the list for the
+ *  whole call is stored, but one added or claimed while the walk runs may
+ *  or may not be.  To go on past a full buffer, call again with low one
+ *  past the last key stored.
+ */
+size_t c_fhsl_lf_scan(c_fhsl_lf_t *set, pq_key_t low, pq_key_t high, size_t k, pq_key_t *keys) {
+  size_t count = 0;
+  node_ptr node = set->head;
+  for(int64_t level = top_level(set); level >= BOTTOM; --level) {
+    node_ptr next = node_unmark(atomic_load_explicit(&node->next[level], memory_order_consume));
+    while(next->key < low) {
+      node = next;
+      next = node_unmark(atomic_load_explicit(&node->next[level], memory_order_consume));
+    }
+  }
+  node = node_unmark(atomic_load_explicit(&node->next[BOTTOM], memory_order_consume));
+  while(count < k && node != set->tail && node->key <= high) {
+    node_ptr succ = atomic_load_explicit(&node->next[BOTTOM], memory_order_consume);
+    if(!node_is_marked(succ)) {
+      keys[count++] = node->key;
+    }
+    node = node_unmark(succ);
+  }
+  return count;
+}
+
+/** As c_fhsl_lf_scan, but linearizable: the keys stored are exactly those
+ *  in [low, high], up to k of them, at one instant during the call.  The
+ *  scan starts once no add or claim is under way and is accepted only if
+ *  none began before it finished, so that the list it walked was the one
+ *  at that instant.  A wide range under a steady stream of updates can
+ *  retry many times.  Every add and claim pays two uncontended atomic adds
+ *  for this.
+ */
+size_t c_fhsl_lf_scan_snapshot(c_fhsl_lf_t *set, pq_key_t low, pq_key_t high, size_t k, pq_key_t *keys) {
+  size_t count;
+  int64_t begun;
+  do {
+    begun = wait_for_updates(set);
+    count = c_fhsl_lf_scan(set, low, high, k, keys);
+    atomic_thread_fence(memory_order_acquire);
+  } while(sharded_counter_read(set->begun) != begun);
+  return count;
+}
+
+/** Move every key of src into dst and return the number that went in.
+ *  src's nodes are relinked rather than copied, in one pass along its
+ *  bottom level, and each search in dst resumes from the predecessors of
+ *  the key before, so the cost is linear in the two sizes.  A plain key
+ *  already in dst is dropped; a duplicate from add_dup is given a new
+ *  sequence number and pops after dst's own copies.  src is left empty.
+ *  Other threads may use dst throughout, but not src.
+ */
+size_t c_fhsl_lf_meld(c_fhsl_lf_t *dst, c_fhsl_lf_t *src) {
+  node_ptr preds[N], succs[N];
+  size_t added = 0, moved = 0;
+  node_ptr node = node_unmark(atomic_load_explicit(&src->head->next[BOTTOM], memory_order_relaxed));
+  while(node != src->tail) {
+    node_ptr succ = atomic_load_explicit(&node->next[BOTTOM], memory_order_relaxed);
+    // Claimed nodes were retired, or leaked, by the call that claimed them.
+    if(!node_is_marked(succ)) {
+      uint64_t seq = node->seq;
+      if(seq != 0) {
+        seq = atomic_fetch_add_explicit(&dst->seq, 1, memory_order_relaxed) + 1;
+        node->seq = seq;
+      }
+      added += add_from(NULL, dst, node->key, seq, node, preds, succs, moved > 0);
+      moved++;
+    }
+    node = node_unmark(succ);
+  }
+  for(int64_t i = 0; i < N; i++) {
+    atomic_store_explicit(&src->head->next[i], src->tail, memory_order_relaxed);
+  }
+  sharded_counter_add_local(src->size, -(int64_t)moved);
+  return added;
+}
+
+/** Move every key at or above pivot into a new list and return it.  Each
+ *  level is cut after the last node below pivot and the part beyond is
+ *  handed to the new list, whose last node at each level is then pointed
+ *  at the new tail, so the cost is linear in the keys moved.  No other
+ *  thread may be using the list.
+ */
+c_fhsl_lf_t *c_fhsl_lf_split(c_fhsl_lf_t *set, pq_key_t pivot) {
+  node_ptr preds[N], succs[N];
+  c_fhsl_lf_t *upper = c_fhsl_lf_create();
+  // Later duplicates must still sort after the ones moved across.
+  atomic_store_explicit(&upper->seq, atomic_load_explicit(&set->seq, memory_order_relaxed),
+    memory_order_relaxed);
+  atomic_store_explicit(&upper->toplevel, top_level(set), memory_order_relaxed);
+  bool _ = find_from(set, pivot, 0, preds, succs, false);
+  int64_t moved = 0;
+  for(int64_t level = N - 1; level >= BOTTOM; --level) {
+    node_ptr node = succs[level];
+    if(node == set->tail) { continue; }
+    atomic_store_explicit(&upper->head->next[level], node, memory_order_relaxed);
+    atomic_store_explicit(&preds[level]->next[level], set->tail, memory_order_relaxed);
+    while(true) {
+      node_ptr next = atomic_load_explicit(&node->next[level], memory_order_relaxed);
+      if(level == BOTTOM && !node_is_marked(next)) { moved++; }
+      if(node_unmark(next) == set->tail) {
+        // Keep the mark: a claimed node stays claimed in its new list.
+        node_ptr end = node_is_marked(next) ? node_mark(upper->tail) : upper->tail;
+        atomic_store_explicit(&node->next[level], end, memory_order_relaxed);
+        break;
+      }
+      node = node_unmark(next);
+    }
+  }
+  sharded_counter_add_local(set->size, -moved);
+  sharded_counter_add_local(upper->size, moved);
+  return upper;
+}
+
+/** Return the approximate number of nodes, summed from per-thread shards
+ *  without stopping writers.  Exact only at quiescence.
+ */
+size_t c_fhsl_lf_size(c_fhsl_lf_t *set) {
+  return sharded_counter_read_size(set->size);
+}
+
+/** Free the skip list and every node still in it.  Nodes with a marked
+ *  bottom pointer were retired, or leaked, by the call that marked them
+ *  and are skipped.  No other thread may be using the list.
+ */
+void c_fhsl_lf_destroy(c_fhsl_lf_t *set) {
+  node_ptr node = node_unmark(atomic_load_explicit(&set->head->next[BOTTOM], memory_order_relaxed));
+  while(node != set->tail) {
+    node_ptr succ = atomic_load_explicit(&node->next[BOTTOM], memory_order_relaxed);
+    if(!node_is_marked(succ)) {
+      node_free(node);
+    }
+    node = node_unmark(succ);
+  }
+  node_free(set->head);
+  node_free(set->tail);
+  sharded_counter_destroy(set->size);
+  sharded_counter_destroy(set->begun);
+  sharded_counter_destroy(set->ended);
+  forkscan_free(set);
+}
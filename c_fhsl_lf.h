@@ -3,23 +3,38 @@
 #include <stdint.h>
 #include <stddef.h>
 
+#include "pq_key.h"
+
 typedef struct c_fhsl_lf_t c_fhsl_lf_t;
 typedef struct node_t node_t;
 typedef node_t* node_ptr;
 
 c_fhsl_lf_t * c_fhsl_lf_create();
 
-int c_fhsl_lf_contains(c_fhsl_lf_t * set, int64_t key);
-int c_fhsl_lf_contains_serial(c_fhsl_lf_t * set, int64_t key);
-int c_fhsl_lf_add(uint64_t *seed, c_fhsl_lf_t * set, int64_t key);
-int c_fhsl_lf_add_serial(uint64_t *seed, c_fhsl_lf_t * set, int64_t key);
-int c_fhsl_lf_remove_leaky(c_fhsl_lf_t * set, int64_t key);
-int c_fhsl_lf_remove_leaky_serial(c_fhsl_lf_t * set, int64_t key);
-int c_fhsl_lf_remove(c_fhsl_lf_t * set, int64_t key);
-int c_fhsl_lf_remove_serial(c_fhsl_lf_t * set, int64_t key);
+int c_fhsl_lf_contains(c_fhsl_lf_t * set, pq_key_t key);
+int c_fhsl_lf_contains_serial(c_fhsl_lf_t * set, pq_key_t key);
+int c_fhsl_lf_add(uint64_t *seed, c_fhsl_lf_t * set, pq_key_t key);
+int c_fhsl_lf_add_dup(uint64_t *seed, c_fhsl_lf_t * set, pq_key_t key);
+int c_fhsl_lf_add_batch(uint64_t *seed, c_fhsl_lf_t * set, pq_key_t *keys, size_t n);
+int c_fhsl_lf_add_serial(uint64_t *seed, c_fhsl_lf_t * set, pq_key_t key);
+int c_fhsl_lf_remove_leaky(c_fhsl_lf_t * set, pq_key_t key);
+int c_fhsl_lf_remove_leaky_serial(c_fhsl_lf_t * set, pq_key_t key);
+int c_fhsl_lf_remove(c_fhsl_lf_t * set, pq_key_t key);
+int c_fhsl_lf_remove_serial(c_fhsl_lf_t * set, pq_key_t key);
 int c_fhsl_lf_pop_min_leaky(c_fhsl_lf_t *set);
 int c_fhsl_lf_pop_min_leaky_serial(c_fhsl_lf_t *set);
 int c_fhsl_lf_pop_min(c_fhsl_lf_t *set);
 int c_fhsl_lf_pop_min_serial(c_fhsl_lf_t *set);
+int c_fhsl_lf_pop_max_leaky(c_fhsl_lf_t *set);
+int c_fhsl_lf_pop_max(c_fhsl_lf_t *set);
+size_t c_fhsl_lf_pop_many_leaky(c_fhsl_lf_t *set, size_t k, pq_key_t *keys);
+size_t c_fhsl_lf_pop_many(c_fhsl_lf_t *set, size_t k, pq_key_t *keys);
+int c_fhsl_lf_peek_min(c_fhsl_lf_t *set, pq_key_t *key);
+size_t c_fhsl_lf_scan(c_fhsl_lf_t *set, pq_key_t low, pq_key_t high, size_t k, pq_key_t *keys);
+size_t c_fhsl_lf_scan_snapshot(c_fhsl_lf_t *set, pq_key_t low, pq_key_t high, size_t k, pq_key_t *keys);
+size_t c_fhsl_lf_meld(c_fhsl_lf_t *dst, c_fhsl_lf_t *src);
+c_fhsl_lf_t *c_fhsl_lf_split(c_fhsl_lf_t *set, pq_key_t pivot);
+size_t c_fhsl_lf_size(c_fhsl_lf_t *set);
+void c_fhsl_lf_destroy(c_fhsl_lf_t *set);
 int c_fhsl_lf_bulk_pop(size_t amount, node_ptr *head, node_ptr *tail);
 void c_fhsl_lf_print (c_fhsl_lf_t *set);
\ No newline at end of file
@@ -0,0 +1,393 @@
+/* Fixed height skiplist with 32-bit links into a per-list node arena.
+ * The algorithms are those of c_fhsl_lf.
+ */
+
+#include "c_fhsl_lfc.h"
+#include "sharded_counter.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <forkscan.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include "utils.h"
+
+#define N SKIPLIST_HEIGHT
+#define BOTTOM 0
+// Nodes start on 8-byte boundaries, so a link's two low bits are free.
+#define ARENA_GRAIN 8
+// Bytes a thread takes from the arena at a time to carve nodes from.
+#define ARENA_CHUNK 4096
+
+typedef struct node_t node_t;
+typedef struct arena_cursor_t arena_cursor_t;
+// A node's offset in the arena in 4-byte units; bit 0 is the mark.
+typedef uint32_t link_t;
+
+struct node_t {
+  int64_t key;
+  int32_t toplevel;
+  // Sized to toplevel + 1 by node_create.
+  _Atomic(link_t) next[];
+};
+
+struct c_fhsl_lfc_t {
+  // Highest level any node has been linked at; searches start there.
+  _Atomic(int32_t) toplevel;
+  char padding[128];
+  // Bytes of the arena handed out to threads so far.
+  _Atomic(uint64_t) used;
+  char *arena;
+  uint64_t id;
+  sharded_counter_t *size;
+  link_t head, tail;
+};
+
+/* The part of a chunk this thread has yet to carve, and the list it came
+ * from.  Lists are told apart by id rather than address, since a new list
+ * can be created where a destroyed one was.
+ */
+struct arena_cursor_t {
+  uint64_t id;
+  uint64_t next, end;
+};
+
+static _Atomic(uint64_t) arena_ids = 0;
+static _Thread_local arena_cursor_t local_cursor = { 0, 0, 0 };
+
+static link_t link_unmark(link_t link){
+  return link & ~(link_t)0x1;
+}
+
+static link_t link_mark(link_t link){
+  return link | 0x1;
+}
+
+static bool link_is_marked(link_t link){
+  return (link & 0x1) != 0;
+}
+
+/** Return the node a link refers to, marked or not.
+ */
+static node_t * node_at(c_fhsl_lfc_t *set, link_t link) {
+  return (node_t *)(set->arena + ((size_t)link_unmark(link) << 2));
+}
+
+/** Return the arena bytes a node with a tower toplevel + 1 high takes.
+ */
+static size_t node_size(int32_t toplevel) {
+  size_t size = sizeof(node_t) + (toplevel + 1) * sizeof(link_t);
+  return (size + ARENA_GRAIN - 1) & ~(size_t)(ARENA_GRAIN - 1);
+}
+
+/** Carve a node with a tower of toplevel + 1 links from the arena and
+ *  return its link.  Threads take the arena a chunk at a time, so the
+ *  shared counter is only touched once every few hundred nodes.
+ */
+static link_t node_create(c_fhsl_lfc_t *set, int64_t key, int32_t toplevel){
+  size_t size = node_size(toplevel);
+  arena_cursor_t *cursor = &local_cursor;
+  if(cursor->id != set->id || cursor->end - cursor->next < size) {
+    uint64_t chunk = atomic_fetch_add_explicit(&set->used, ARENA_CHUNK, memory_order_relaxed);
+    if(chunk + ARENA_CHUNK > C_FHSL_LFC_ARENA) {
+      fprintf(stderr, "c_fhsl_lfc: node arena of %zu bytes exhausted\n", (size_t)C_FHSL_LFC_ARENA);
+      abort();
+    }
+    cursor->id = set->id;
+    cursor->next = chunk;
+    cursor->end = chunk + ARENA_CHUNK;
+  }
+  link_t link = (link_t)(cursor->next >> 2);
+  cursor->next += size;
+  node_t *node = node_at(set, link);
+  node->key = key;
+  node->toplevel = toplevel;
+  return link;
+}
+
+/** Return the highest level any node has been linked at.
+ */
+static int32_t top_level(c_fhsl_lfc_t *set) {
+  return atomic_load_explicit(&set->toplevel, memory_order_relaxed);
+}
+
+/** Raise the top level to cover a node of height toplevel + 1, before the
+ *  node is linked.
+ */
+static void raise_top_level(c_fhsl_lfc_t *set, int32_t toplevel) {
+  int32_t top = atomic_load_explicit(&set->toplevel, memory_order_relaxed);
+  while(top < toplevel && !atomic_compare_exchange_weak_explicit(&set->toplevel,
+    &top, toplevel, memory_order_seq_cst, memory_order_relaxed)) {}
+}
+
+/** Point preds and succs at the head and tail on the empty levels above the
+ *  top level, and return the top level for the search to start at.
+ */
+static int32_t skip_empty_levels(c_fhsl_lfc_t *set, link_t preds[N], link_t succs[N]) {
+  int32_t top = top_level(set);
+  for(int64_t level = N - 1; level > top; --level) {
+    preds[level] = set->head;
+    succs[level] = set->tail;
+  }
+  return top;
+}
+
+/** Print out the contents of the skip list along with node heights.
+ */
+void c_fhsl_lfc_print (c_fhsl_lfc_t *set){
+  link_t link = atomic_load_explicit(&node_at(set, set->head)->next[0], memory_order_consume);
+  while(link_unmark(link) != set->tail) {
+    node_t *node = node_at(set, link);
+    link_t next = atomic_load_explicit(&node->next[0], memory_order_consume);
+    if(!link_is_marked(next)) {
+      printf("node[%d]: %ld\n", node->toplevel, node->key);
+    }
+    link = next;
+  }
+}
+
+/** Return a new fixed-height skip list with an empty arena, or NULL if the
+ *  arena's address space cannot be reserved.
+ */
+c_fhsl_lfc_t * c_fhsl_lfc_create() {
+  char *arena = mmap(NULL, C_FHSL_LFC_ARENA, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if(arena == MAP_FAILED) {
+    return NULL;
+  }
+  c_fhsl_lfc_t* fhsl_lfc = forkscan_malloc(sizeof(c_fhsl_lfc_t));
+  fhsl_lfc->arena = arena;
+  fhsl_lfc->id = atomic_fetch_add_explicit(&arena_ids, 1, memory_order_relaxed) + 1;
+  atomic_store_explicit(&fhsl_lfc->used, 0, memory_order_relaxed);
+  atomic_store_explicit(&fhsl_lfc->toplevel, 0, memory_order_relaxed);
+  fhsl_lfc->size = sharded_counter_create(SHARDED_COUNTER_LOCAL_SHARDS);
+  fhsl_lfc->head = node_create(fhsl_lfc, INT64_MIN, N - 1);
+  fhsl_lfc->tail = node_create(fhsl_lfc, INT64_MAX, N - 1);
+  node_t *head = node_at(fhsl_lfc, fhsl_lfc->head);
+  node_t *tail = node_at(fhsl_lfc, fhsl_lfc->tail);
+  for(int64_t i = 0; i < N; i++) {
+    atomic_store_explicit(&head->next[i], fhsl_lfc->tail, memory_order_relaxed);
+    // Never followed: no key sorts past the tail.
+    atomic_store_explicit(&tail->next[i], fhsl_lfc->head, memory_order_relaxed);
+  }
+  return fhsl_lfc;
+}
+
+/** Return whether the skip list contains the value.
+ */
+int c_fhsl_lfc_contains(c_fhsl_lfc_t *set, int64_t key) {
+  node_t *node = node_at(set, set->head);
+  for(int64_t i = top_level(set); i >= 0; i--) {
+    node_t *next = node_at(set, atomic_load_explicit(&node->next[i], memory_order_consume));
+    while(next->key <= key) {
+      node = next;
+      next = node_at(set, atomic_load_explicit(&node->next[i], memory_order_consume));
+    }
+    if(node->key == key) {
+      return !link_is_marked(atomic_load_explicit(&node->next[0], memory_order_relaxed));
+    }
+  }
+  return false;
+}
+
+/** Fill preds and succs for key and return whether a node with key is at
+ *  succs[BOTTOM], unlinking marked nodes on the way as c_fhsl_lf does.
+ */
+static bool find(c_fhsl_lfc_t *set, int64_t key, link_t preds[N], link_t succs[N]) {
+retry:
+  while(true) {
+    link_t left = set->head;
+    int32_t top = skip_empty_levels(set, preds, succs);
+    for(int64_t level = top; level >= BOTTOM; --level) {
+      node_t *left_node = node_at(set, left);
+      link_t left_next = atomic_load_explicit(&left_node->next[level], memory_order_consume);
+      // Is our current node invalid?
+      if(link_is_marked(left_next)) { goto retry; }
+      link_t right = left_next;
+      // Find two nodes to put into preds and succs.
+      while(true) {
+        // Scan to the right so long as we find deleted nodes.
+        node_t *right_node = node_at(set, right);
+        link_t right_next = atomic_load_explicit(&right_node->next[level], memory_order_consume);
+        while(link_is_marked(right_next)) {
+          right = link_unmark(right_next);
+          right_node = node_at(set, right);
+          right_next = atomic_load_explicit(&right_node->next[level], memory_order_consume);
+        }
+        // Has the right not gone far enough?
+        if(right_node->key < key) {
+          left = right;
+          left_node = right_node;
+          left_next = right_next;
+          right = right_next;
+        } else {
+          // Right node is greater than our key, he's our succ, break.
+          break;
+        }
+      }
+      // Ensure the left node points to the right node, they must be adjacent.
+      if(left_next != right) {
+        bool success = atomic_compare_exchange_weak_explicit(&left_node->next[level], &left_next, right,
+          memory_order_release, memory_order_relaxed);
+        if(!success) { goto retry; }
+      }
+      preds[level] = left;
+      succs[level] = right;
+    }
+    return node_at(set, succs[BOTTOM])->key == key;
+  }
+}
+
+/** Add a node, lock-free, to the skiplist.  A node created for an add that
+ *  then loses to a concurrent add of the same key is left in the arena.
+ */
+int c_fhsl_lfc_add(uint64_t *seed, c_fhsl_lfc_t * set, int64_t key) {
+  link_t preds[N], succs[N];
+  int32_t toplevel = random_level(seed, N);
+  link_t link = 0;
+  node_t *node = NULL;
+  raise_top_level(set, toplevel);
+  while(true) {
+    if(find(set, key, preds, succs)) {
+      return false;
+    }
+    if(node == NULL) {
+      link = node_create(set, key, toplevel);
+      node = node_at(set, link);
+    }
+    for(int64_t i = BOTTOM; i <= toplevel; ++i) {
+      atomic_store_explicit(&node->next[i], succs[i], memory_order_release);
+    }
+    link_t succ = succs[BOTTOM];
+    if(!atomic_compare_exchange_weak_explicit(&node_at(set, preds[BOTTOM])->next[BOTTOM], &succ, link,
+      memory_order_seq_cst, memory_order_relaxed)) {
+      continue;
+    }
+    for(int64_t i = 1; i <= toplevel; i++) {
+      while(true) {
+        succ = succs[i];
+        if(atomic_compare_exchange_weak_explicit(&node_at(set, preds[i])->next[i],
+          &succ, link, memory_order_release, memory_order_relaxed)) {
+          break;
+        }
+        bool _ = find(set, key, preds, succs);
+      }
+    }
+    sharded_counter_add_local(set->size, 1);
+    return true;
+  }
+}
+
+/** Remove a node, lock-free, from the skiplist.  The node stays in the
+ *  arena.
+ */
+int c_fhsl_lfc_remove_leaky(c_fhsl_lfc_t * set, int64_t key) {
+  link_t preds[N], succs[N];
+  link_t succ = 0;
+  while(true) {
+    if(!find(set, key, preds, succs)) {
+      return false;
+    }
+    node_t *node_to_remove = node_at(set, succs[BOTTOM]);
+    bool marked;
+    for(int64_t level = node_to_remove->toplevel; level >= 1; --level) {
+      succ = atomic_load_explicit(&node_to_remove->next[level], memory_order_relaxed);
+      marked = link_is_marked(succ);
+      while(!marked) {
+        bool _ = atomic_compare_exchange_weak_explicit(&node_to_remove->next[level],
+          &succ, link_mark(succ), memory_order_relaxed, memory_order_relaxed);
+        marked = link_is_marked(succ);
+      }
+    }
+    succ = atomic_load_explicit(&node_to_remove->next[BOTTOM], memory_order_relaxed);
+    marked = link_is_marked(succ);
+    if(marked) { return false; }
+    while(true) {
+      bool i_marked_it = atomic_compare_exchange_weak_explicit(&node_to_remove->next[BOTTOM],
+        &succ, link_mark(succ), memory_order_seq_cst, memory_order_relaxed);
+      marked = link_is_marked(succ);
+      if(i_marked_it) {
+        bool _ = find(set, key, preds, succs);
+        sharded_counter_add_local(set->size, -1);
+        return true;
+      } else if(marked) {
+        return false;
+      }
+    }
+  }
+}
+
+/** Pop the front node from the list.  Return true iff there was a node to
+ *  pop.  The node stays in the arena.
+ */
+int c_fhsl_lfc_pop_min_leaky (c_fhsl_lfc_t *set) {
+  link_t preds[N], succs[N];
+  link_t succ = 0;
+  node_t *head = node_at(set, set->head);
+  while(true) {
+    link_t first = atomic_load_explicit(&head->next[BOTTOM], memory_order_relaxed);
+    if (first == set->tail) {
+      return false;
+    }
+    node_t *node_to_remove = node_at(set, first);
+    for(int64_t level = node_to_remove->toplevel; level >= 1; --level) {
+      succ = atomic_load_explicit(&node_to_remove->next[level], memory_order_relaxed);
+      bool marked = link_is_marked(succ);
+      while(!marked) {
+        bool _ = atomic_compare_exchange_weak_explicit(&node_to_remove->next[level], &succ,
+                      link_mark(succ), memory_order_relaxed, memory_order_relaxed);
+        succ = atomic_load_explicit(&node_to_remove->next[level], memory_order_relaxed);
+        marked = link_is_marked(succ);
+      }
+    }
+    succ = link_unmark(atomic_load_explicit(&node_to_remove->next[BOTTOM], memory_order_relaxed));
+
+    if (atomic_compare_exchange_weak_explicit(&node_to_remove->next[BOTTOM], &succ, link_mark(succ),
+      memory_order_seq_cst, memory_order_relaxed)) {
+      bool _ = find(set, node_to_remove->key, preds, succs);
+      sharded_counter_add_local(set->size, -1);
+      return true;
+    }
+  }
+}
+
+/** Store the smallest key without removing it.  Return true iff there was
+ *  one.  Exact only at quiescence, as for c_fhsl_lf_peek_min.
+ */
+int c_fhsl_lfc_peek_min(c_fhsl_lfc_t *set, int64_t *key) {
+  link_t link = link_unmark(atomic_load_explicit(&node_at(set, set->head)->next[BOTTOM], memory_order_consume));
+  while(link != set->tail) {
+    node_t *node = node_at(set, link);
+    link_t succ = atomic_load_explicit(&node->next[BOTTOM], memory_order_consume);
+    if(!link_is_marked(succ)) {
+      *key = node->key;
+      return true;
+    }
+    link = link_unmark(succ);
+  }
+  return false;
+}
+
+/** Return the approximate number of nodes, summed from per-thread shards
+ *  without stopping writers.  Exact only at quiescence.
+ */
+size_t c_fhsl_lfc_size(c_fhsl_lfc_t *set) {
+  return sharded_counter_read_size(set->size);
+}
+
+/** Return the bytes of arena handed out to threads, removed nodes and the
+ *  unused ends of chunks included.  Only these pages are ever touched.
+ */
+size_t c_fhsl_lfc_footprint(c_fhsl_lfc_t *set) {
+  return atomic_load_explicit(&set->used, memory_order_relaxed);
+}
+
+/** Free the skip list and its arena, nodes and all.  No other thread may be
+ *  using the list.
+ */
+void c_fhsl_lfc_destroy(c_fhsl_lfc_t *set) {
+  munmap(set->arena, C_FHSL_LFC_ARENA);
+  sharded_counter_destroy(set->size);
+  forkscan_free(set);
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+/* The lock-free skiplist of c_fhsl_lf with compressed links.  Every node
+ * lives in one arena reserved by the list, and a link is the node's offset
+ * in the arena in 4-byte units, with the mark in the low bit.  Towers are
+ * half the size they are with pointers, so twice the levels share a cache
+ * line.  The arena is reserved up front but only touched as nodes are
+ * carved from it, so its size caps the list rather than costing memory.
+ *
+ * Forkscan cannot see a link as a reference, so removed nodes cannot be
+ * retired: they are left in the arena until the list is destroyed, as in
+ * the leaky policy, and only the leaky removes are provided.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Bytes of address space each list reserves for its nodes.  Links reach
+// at most 16 GB.
+#ifndef C_FHSL_LFC_ARENA
+#define C_FHSL_LFC_ARENA ((size_t)1 << 34)
+#endif
+
+typedef struct c_fhsl_lfc_t c_fhsl_lfc_t;
+
+c_fhsl_lfc_t * c_fhsl_lfc_create();
+
+int c_fhsl_lfc_contains(c_fhsl_lfc_t * set, int64_t key);
+int c_fhsl_lfc_add(uint64_t *seed, c_fhsl_lfc_t * set, int64_t key);
+int c_fhsl_lfc_remove_leaky(c_fhsl_lfc_t * set, int64_t key);
+int c_fhsl_lfc_pop_min_leaky(c_fhsl_lfc_t *set);
+int c_fhsl_lfc_peek_min(c_fhsl_lfc_t *set, int64_t *key);
+size_t c_fhsl_lfc_size(c_fhsl_lfc_t *set);
+size_t c_fhsl_lfc_footprint(c_fhsl_lfc_t *set);
+void c_fhsl_lfc_destroy(c_fhsl_lfc_t *set);
+void c_fhsl_lfc_print (c_fhsl_lfc_t *set);
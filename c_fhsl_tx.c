@@ -4,6 +4,7 @@
 
 #include "c_fhsl_tx.h"
 #include "elided_lock.h"
+#include "node_pool.h"
 
 #include <stdbool.h>
 #include <forkscan.h>
@@ -27,7 +28,7 @@ struct c_fhsl_tx_t {
 
 
 static node_ptr node_create(int64_t key, int32_t toplevel){
-  node_ptr node = forkscan_malloc(sizeof(node_t));
+  node_ptr node = node_pool_alloc(sizeof(node_t));
   node->key = key;
   node->toplevel = toplevel;
   return node;
@@ -78,26 +79,6 @@ int c_fhsl_tx_contains(c_fhsl_tx_t *set, int64_t key) {
   return false;
 }
 
-static uint64_t fast_rand (uint64_t *seed){
-  uint64_t val = *seed;
-  if(val == 0) {
-    val = 1;
-  }
-  val ^= val << 6;
-  val ^= val >> 21;
-  val ^= val << 7;
-  *seed = val;
-  return val;
-}
-
-static int32_t random_level (uint64_t *seed, int32_t max) {
-  int32_t level = 1;
-  while(fast_rand(seed) % 2 == 0 && level < max) {
-    level++;
-  }
-  return level - 1;
-}
-
 static bool find(c_fhsl_tx_t *set, int64_t key, 
   node_ptr preds[N], node_ptr succs[N]) {
   node_ptr prev = &set->head;
@@ -128,7 +109,7 @@ int c_fhsl_tx_add(uint64_t *seed, c_fhsl_tx_t * set, int64_t key) {
     added = true;
   }
   unlock(set->lock);
-  if(!added) { forkscan_free(node); }
+  if(!added) { node_pool_free(node, sizeof(node_t)); }
   return added;
 }
 
@@ -160,7 +141,7 @@ int c_fhsl_tx_remove(c_fhsl_tx_t * set, int64_t key) {
     }
   }
   unlock(set->lock);
-  forkscan_retire((void*)node);
+  node_pool_retire(node, sizeof(node_t));
   return node != NULL;
 }
 
@@ -192,6 +173,20 @@ int c_fhsl_tx_pop_min(c_fhsl_tx_t *set) {
     }
   }
   unlock(set->lock);
-  forkscan_retire((void*)node_popped);
+  node_pool_retire(node_popped, sizeof(node_t));
   return node_popped != NULL;
+}
+
+/** Free the skip list, its lock and every node in it.  No other thread may
+ *  be using the list.
+ */
+void c_fhsl_tx_destroy(c_fhsl_tx_t *set) {
+  node_ptr node = set->head.next[0];
+  while(node != &set->tail) {
+    node_ptr next = node->next[0];
+    node_pool_free(node, sizeof(node_t));
+    node = next;
+  }
+  destroy_elided_lock(set->lock);
+  forkscan_free(set);
 }
\ No newline at end of file
@@ -2,7 +2,9 @@
 
 #include <stdint.h>
 
-#define N 20
+#include "utils.h"
+
+#define N SKIPLIST_HEIGHT
 
 typedef struct c_fhsl_tx_t c_fhsl_tx_t;
 
@@ -13,4 +15,5 @@ int c_fhsl_tx_add(uint64_t *seed, c_fhsl_tx_t * set, int64_t key);
 int c_fhsl_tx_remove_leaky(c_fhsl_tx_t * set, int64_t key);
 int c_fhsl_tx_remove(c_fhsl_tx_t * set, int64_t key);
 int c_fhsl_tx_pop_min_leaky(c_fhsl_tx_t *set);
+void c_fhsl_tx_destroy(c_fhsl_tx_t *set);
 void c_fhsl_tx_print (c_fhsl_tx_t *set);
\ No newline at end of file
@@ -5,6 +5,8 @@
  */
 
 #include "c_hunt_heap.h"
+#include "parking_lot.h"
+#include "sharded_counter.h"
 
 #include <stdbool.h>
 #include <stdatomic.h>
@@ -22,15 +24,23 @@
 typedef struct bucket_t bucket_t;
 typedef struct bit_reversed_counter_t bit_reversed_counter_t;
 
+struct c_hunt_pq_handle_t {
+  // Bucket holding the item, or 0 once it has left the heap.
+  _Atomic(uintmax_t) index;
+};
+
 struct bucket_t {
   pthread_spinlock_t lock;
   atomic_uintmax_t tag;
-  int64_t priority;
+  pq_key_t priority;
+  int64_t value;
+  c_hunt_pq_handle_t *handle;
 };
 
 void bucket_init(bucket_t *bucket) {
   pthread_spin_init(&bucket->lock, PTHREAD_PROCESS_PRIVATE);
   bucket->tag = EMPTY;
+  bucket->handle = NULL;
 }
 
 struct bit_reversed_counter_t {
@@ -51,7 +61,7 @@ uintmax_t bit_reversed_counter_increment(bit_reversed_counter_t *brc) {
     uintmax_t mask = UINTMAX_C(1) << bit;
     uintmax_t was_set = brc->reversed & mask;
     brc->reversed ^= mask;
-    if(was_set != 0) {
+    if(was_set == 0) {
       break;
     }
   }
@@ -62,14 +72,18 @@ uintmax_t bit_reversed_counter_increment(bit_reversed_counter_t *brc) {
   return brc->reversed;
 }
 
+/** Step the counter back and return the position it held, which is the
+ *  last occupied bucket.
+ */
 uintmax_t bit_reversed_counter_decrement(bit_reversed_counter_t *brc) {
+  uintmax_t last = brc->reversed;
   brc->count--;
   int32_t bit = brc->high_bit - 1;
   for(; bit >= 0; bit--) {
     uintmax_t mask = UINTMAX_C(1) << bit;
     uintmax_t was_set = brc->reversed & mask;
     brc->reversed ^= mask;
-    if(was_set == 0) {
+    if(was_set != 0) {
       break;
     }
   }
@@ -77,7 +91,7 @@ uintmax_t bit_reversed_counter_decrement(bit_reversed_counter_t *brc) {
     brc->reversed = brc->count;
     brc->high_bit--;
   }
-  return brc->reversed;
+  return last;
 }
 
 struct c_hunt_pq_t {
@@ -85,6 +99,9 @@ struct c_hunt_pq_t {
   bit_reversed_counter_t counter;
   size_t size;
   bucket_t * buckets;
+  // Number of items, for c_hunt_pq_size; size above is the capacity.
+  sharded_counter_t *items;
+  parking_lot_t *waiters;
 };
 
 
@@ -97,6 +114,8 @@ c_hunt_pq_t* c_hunt_pq_create(size_t size) {
   pthread_spin_init(&hunt_pqueue->lock, PTHREAD_PROCESS_PRIVATE);
   bit_reversed_counter_init(&hunt_pqueue->counter);
   hunt_pqueue->size = size;
+  hunt_pqueue->items = sharded_counter_create(SHARDED_COUNTER_LOCAL_SHARDS);
+  hunt_pqueue->waiters = parking_lot_create();
   hunt_pqueue->buckets = forkscan_malloc(sizeof(bucket_t) * size);
   for(size_t i = 0; i < size; i++) {
     bucket_init(hunt_pqueue->buckets + i);
@@ -125,37 +144,45 @@ static void unlock(pthread_spinlock_t *lock) {
   pthread_spin_unlock(lock);
 }
 
-static void swap_buckets(bucket_t *b1, bucket_t *b2) {
+static void set_index(c_hunt_pq_handle_t *handle, uintmax_t i) {
+  if(handle != NULL) {
+    atomic_store_explicit(&handle->index, i, memory_order_relaxed);
+  }
+}
+
+static void swap_buckets(c_hunt_pq_t *pqueue, uintmax_t i1, uintmax_t i2) {
+  bucket_t *b1 = pqueue->buckets + i1, *b2 = pqueue->buckets + i2;
   atomic_uintmax_t tag1 = atomic_load_explicit(&b1->tag, memory_order_relaxed),
     tag2 = atomic_load_explicit(&b2->tag, memory_order_relaxed);
-  int64_t priority1 = b1->priority, priority2 = b2->priority;
+  pq_key_t priority1 = b1->priority, priority2 = b2->priority;
+  int64_t value1 = b1->value, value2 = b2->value;
+  c_hunt_pq_handle_t *handle1 = b1->handle, *handle2 = b2->handle;
   atomic_store_explicit(&b1->tag, tag2, memory_order_relaxed);
   atomic_store_explicit(&b2->tag, tag1, memory_order_relaxed);
   b1->priority = priority2;
   b2->priority = priority1;
+  b1->value = value2;
+  b2->value = value1;
+  b1->handle = handle2;
+  b2->handle = handle1;
+  set_index(handle2, i1);
+  set_index(handle1, i2);
 }
 
-/** Add an item to the Hunt priority queue.
+/** Carry the item tagged tid up from bucket i, which is unlocked, while it
+ *  is smaller than its parent.  Others may move the item meanwhile; follow
+ *  it up by its tag, and give up if the tag is taken over.
  */
-int c_hunt_pq_add(c_hunt_pq_t * pqueue, int64_t priority) {
-  int tid = syscall(SYS_gettid);
-  lock(&pqueue->lock);
-  uintmax_t i = bit_reversed_counter_increment(&pqueue->counter);
-  lock(&pqueue->buckets[i].lock);
-  unlock(&pqueue->lock);
-  pqueue->buckets[i].priority = priority;
-  pqueue->buckets[i].tag = tid;
-
-  unlock(&pqueue->buckets[i].lock);
+static void sift_up(c_hunt_pq_t *pqueue, uintmax_t i, uintmax_t tid) {
   while (i > 1) {
     uintmax_t parent = i / 2;
     lock(&pqueue->buckets[parent].lock);
     lock(&pqueue->buckets[i].lock);
     uintmax_t old_i = i;
-    if((atomic_load_explicit(&pqueue->buckets[parent].tag, memory_order_relaxed) == AVAILABLE) 
+    if((atomic_load_explicit(&pqueue->buckets[parent].tag, memory_order_relaxed) == AVAILABLE)
       && (atomic_load_explicit(&pqueue->buckets[i].tag, memory_order_relaxed) == tid)){
-      if(pqueue->buckets[i].priority > pqueue->buckets[parent].priority) {
-        swap_buckets(pqueue->buckets + i, pqueue->buckets + parent);
+      if(pqueue->buckets[i].priority < pqueue->buckets[parent].priority) {
+        swap_buckets(pqueue, i, parent);
         i = parent;
       }
       else {
@@ -180,33 +207,12 @@ int c_hunt_pq_add(c_hunt_pq_t * pqueue, int64_t priority) {
     }
     unlock(&pqueue->buckets[i].lock);
   }
-  return true;
 }
 
-
-/** Remove the minimum element in the Hunt priority queue.
+/** Carry the item in bucket i, which is locked and AVAILABLE, down while it
+ *  is larger than a child.  Return with every lock released.
  */
-int c_hunt_pq_leaky_pop_min(c_hunt_pq_t * pqueue) {
-  lock(&pqueue->lock);
-  uintmax_t bottom = bit_reversed_counter_decrement(&pqueue->counter);
-  lock(&pqueue->buckets[bottom].lock);
-  unlock(&pqueue->lock);
-
-  int64_t priority = pqueue->buckets[bottom].priority;
-  pqueue->buckets[bottom].tag = EMPTY;
-  unlock(&pqueue->buckets[bottom].lock);
-
-  lock(&pqueue->buckets[1].lock);
-  if(atomic_load_explicit(&pqueue->buckets[1].tag, memory_order_relaxed) == EMPTY) {
-    unlock(&pqueue->buckets[1].lock);
-    return true;
-  }
-
-  pqueue->buckets[bottom].priority = pqueue->buckets[1].priority;
-  pqueue->buckets[1].priority = priority;
-  atomic_store_explicit(&pqueue->buckets[1].tag, AVAILABLE, memory_order_relaxed);
-
-  uintmax_t i = 1;
+static void sift_down(c_hunt_pq_t *pqueue, uintmax_t i) {
   size_t size = pqueue->size;
   while (i < (size / 2)) {
     uintmax_t left = i * 2, right = (i * 2) + 1, child = i * 2;
@@ -217,8 +223,8 @@ int c_hunt_pq_leaky_pop_min(c_hunt_pq_t * pqueue) {
       unlock(&pqueue->buckets[left].lock);
       break;
     }
-    else if((atomic_load_explicit(&pqueue->buckets[right].tag, memory_order_relaxed) == EMPTY) || 
-      (pqueue->buckets[left].priority > pqueue->buckets[right].priority)) {
+    else if((atomic_load_explicit(&pqueue->buckets[right].tag, memory_order_relaxed) == EMPTY) ||
+      (pqueue->buckets[left].priority < pqueue->buckets[right].priority)) {
       unlock(&pqueue->buckets[right].lock);
       child = left;
     }
@@ -227,8 +233,8 @@ int c_hunt_pq_leaky_pop_min(c_hunt_pq_t * pqueue) {
       child = right;
     }
 
-    if(pqueue->buckets[child].priority > pqueue->buckets[i].priority) {
-      swap_buckets(pqueue->buckets + child, pqueue->buckets + i);
+    if(pqueue->buckets[child].priority < pqueue->buckets[i].priority) {
+      swap_buckets(pqueue, child, i);
       unlock(&pqueue->buckets[i].lock);
       i = child;
     } else {
@@ -237,11 +243,286 @@ int c_hunt_pq_leaky_pop_min(c_hunt_pq_t * pqueue) {
     }
   }
   unlock(&pqueue->buckets[i].lock);
+}
+
+static void insert(c_hunt_pq_t * pqueue, pq_key_t priority, int64_t value, c_hunt_pq_handle_t *handle) {
+  uintmax_t tid = syscall(SYS_gettid);
+  lock(&pqueue->lock);
+  uintmax_t i = bit_reversed_counter_increment(&pqueue->counter);
+  lock(&pqueue->buckets[i].lock);
+  unlock(&pqueue->lock);
+  pqueue->buckets[i].priority = priority;
+  pqueue->buckets[i].value = value;
+  pqueue->buckets[i].handle = handle;
+  set_index(handle, i);
+  pqueue->buckets[i].tag = tid;
+
+  unlock(&pqueue->buckets[i].lock);
+  sharded_counter_add_local(pqueue->items, 1);
+  sift_up(pqueue, i, tid);
+  parking_lot_wake(pqueue->waiters);
+}
+
+/** Add an item to the Hunt priority queue.
+ */
+int c_hunt_pq_add(c_hunt_pq_t * pqueue, pq_key_t priority) {
+  return c_hunt_pq_add_item(pqueue, priority, 0);
+}
+
+/** Add a priority with its value to the Hunt priority queue.
+ */
+int c_hunt_pq_add_item(c_hunt_pq_t * pqueue, pq_key_t priority, int64_t value) {
+  insert(pqueue, priority, value, NULL);
   return true;
 }
 
+/** Add a priority with its value to the Hunt priority queue and return a
+ *  handle for decrease_key and remove.  The handle tracks the item's bucket
+ *  until the item leaves the heap, and stays safe to pass in afterwards.
+ */
+c_hunt_pq_handle_t *c_hunt_pq_add_handle(c_hunt_pq_t * pqueue, pq_key_t priority, int64_t value) {
+  c_hunt_pq_handle_t *handle = forkscan_malloc(sizeof(c_hunt_pq_handle_t));
+  atomic_store_explicit(&handle->index, 0, memory_order_relaxed);
+  insert(pqueue, priority, value, handle);
+  return handle;
+}
+
+/** Lock and return the bucket holding handle's item, or return 0 if the
+ *  item has left the heap.  An item moving between buckets briefly has an
+ *  index whose bucket does not hold it, so try again until it lands.
+ */
+static uintmax_t locate(c_hunt_pq_t *pqueue, c_hunt_pq_handle_t *handle) {
+  while(true) {
+    uintmax_t i = atomic_load_explicit(&handle->index, memory_order_relaxed);
+    if(i == 0) {
+      return 0;
+    }
+    lock(&pqueue->buckets[i].lock);
+    if(pqueue->buckets[i].handle == handle) {
+      return i;
+    }
+    unlock(&pqueue->buckets[i].lock);
+  }
+}
+
+/** Lower the priority of handle's item and move it up the heap.  A
+ *  priority that is not lower leaves the item alone.  Return false iff the
+ *  item has already left the heap.
+ */
+int c_hunt_pq_decrease_key(c_hunt_pq_t * pqueue, c_hunt_pq_handle_t *handle, pq_key_t priority) {
+  uintmax_t tid = syscall(SYS_gettid);
+  uintmax_t i = locate(pqueue, handle);
+  if(i == 0) {
+    return false;
+  }
+  bucket_t *bucket = pqueue->buckets + i;
+  if(priority >= bucket->priority) {
+    unlock(&bucket->lock);
+    return true;
+  }
+  bucket->priority = priority;
+  // Take the item over as an insert would.  An insert still carrying it
+  // loses the tag and stops following it.
+  atomic_store_explicit(&bucket->tag, tid, memory_order_relaxed);
+  unlock(&bucket->lock);
+  sift_up(pqueue, i, tid);
+  return true;
+}
+
+/** Remove handle's item from the Hunt priority queue, filling its bucket
+ *  with the last item as pop_min does for the root.  Return false iff the
+ *  item has already left the heap.
+ */
+int c_hunt_pq_remove(c_hunt_pq_t * pqueue, c_hunt_pq_handle_t *handle) {
+  uintmax_t tid = syscall(SYS_gettid);
+  while(true) {
+    uintmax_t i = locate(pqueue, handle);
+    if(i == 0) {
+      return false;
+    }
+    // pop_min takes the heap lock and then the last bucket, so holding the
+    // item's bucket we may only try for them, and start over on failure.
+    if(pthread_spin_trylock(&pqueue->lock) != 0) {
+      unlock(&pqueue->buckets[i].lock);
+      continue;
+    }
+    uintmax_t bottom = bit_reversed_counter_decrement(&pqueue->counter);
+    if(bottom != i && pthread_spin_trylock(&pqueue->buckets[bottom].lock) != 0) {
+      bit_reversed_counter_increment(&pqueue->counter);
+      unlock(&pqueue->lock);
+      unlock(&pqueue->buckets[i].lock);
+      continue;
+    }
+    unlock(&pqueue->lock);
+    sharded_counter_add_local(pqueue->items, -1);
+
+    bucket_t *bucket = pqueue->buckets + i;
+    set_index(handle, 0);
+    forkscan_retire(handle);
+    if(bottom == i) {
+      atomic_store_explicit(&bucket->tag, EMPTY, memory_order_relaxed);
+      bucket->handle = NULL;
+      unlock(&bucket->lock);
+      return true;
+    }
+
+    bucket_t *last = pqueue->buckets + bottom;
+    pq_key_t removed = bucket->priority;
+    bucket->priority = last->priority;
+    bucket->value = last->value;
+    bucket->handle = last->handle;
+    set_index(bucket->handle, i);
+    atomic_store_explicit(&last->tag, EMPTY, memory_order_relaxed);
+    last->handle = NULL;
+    unlock(&last->lock);
+
+    // The removed item sat between its parent and children, so the last
+    // item only has to move one way.
+    if(bucket->priority > removed) {
+      atomic_store_explicit(&bucket->tag, AVAILABLE, memory_order_relaxed);
+      sift_down(pqueue, i);
+    } else {
+      atomic_store_explicit(&bucket->tag, tid, memory_order_relaxed);
+      unlock(&bucket->lock);
+      sift_up(pqueue, i, tid);
+    }
+    return true;
+  }
+}
+
+/** Remove the minimum element and store its priority and value.  Retire
+ *  its handle, if it has one, iff retire.  Return true iff there was an
+ *  element to pop.
+ */
+static int pop_min(c_hunt_pq_t * pqueue, pq_key_t *popped_priority, int64_t *popped_value, bool retire) {
+  lock(&pqueue->lock);
+  if(pqueue->counter.count == 0) {
+    unlock(&pqueue->lock);
+    return false;
+  }
+  uintmax_t bottom = bit_reversed_counter_decrement(&pqueue->counter);
+  lock(&pqueue->buckets[bottom].lock);
+  unlock(&pqueue->lock);
+  sharded_counter_add_local(pqueue->items, -1);
+
+  pq_key_t priority = pqueue->buckets[bottom].priority;
+  int64_t value = pqueue->buckets[bottom].value;
+  c_hunt_pq_handle_t *handle = pqueue->buckets[bottom].handle;
+  pqueue->buckets[bottom].tag = EMPTY;
+  pqueue->buckets[bottom].handle = NULL;
+  unlock(&pqueue->buckets[bottom].lock);
+
+  lock(&pqueue->buckets[1].lock);
+  if(atomic_load_explicit(&pqueue->buckets[1].tag, memory_order_relaxed) == EMPTY) {
+    // The bottom was the root.
+    unlock(&pqueue->buckets[1].lock);
+    *popped_priority = priority;
+    *popped_value = value;
+    set_index(handle, 0);
+    if(retire && handle != NULL) { forkscan_retire(handle); }
+    return true;
+  }
+
+  c_hunt_pq_handle_t *popped = pqueue->buckets[1].handle;
+  *popped_priority = pqueue->buckets[1].priority;
+  *popped_value = pqueue->buckets[1].value;
+  pqueue->buckets[1].priority = priority;
+  pqueue->buckets[1].value = value;
+  pqueue->buckets[1].handle = handle;
+  set_index(handle, 1);
+  set_index(popped, 0);
+  atomic_store_explicit(&pqueue->buckets[1].tag, AVAILABLE, memory_order_relaxed);
+
+  sift_down(pqueue, 1);
+  if(retire && popped != NULL) { forkscan_retire(popped); }
+  return true;
+}
+
+/** Remove the minimum element in the Hunt priority queue.
+ */
+int c_hunt_pq_leaky_pop_min(c_hunt_pq_t * pqueue) {
+  pq_key_t priority;
+  int64_t value;
+  return c_hunt_pq_leaky_pop_min_item(pqueue, &priority, &value);
+}
+
+/** Remove the minimum element in the Hunt priority queue and store its
+ *  priority and value.  Return true iff there was an element to pop.
+ */
+int c_hunt_pq_leaky_pop_min_item(c_hunt_pq_t * pqueue, pq_key_t *priority, int64_t *value) {
+  return pop_min(pqueue, priority, value, false);
+}
+
 /** Remove the minimum element in the Hunt priority queue.
  */
 int c_hunt_pq_pop_min(c_hunt_pq_t * pqueue) {
-  return c_hunt_pq_leaky_pop_min(pqueue);
+  pq_key_t priority;
+  int64_t value;
+  return c_hunt_pq_pop_min_item(pqueue, &priority, &value);
+}
+
+/** Remove the minimum element in the Hunt priority queue and store its
+ *  priority and value.  Return true iff there was an element to pop.
+ */
+int c_hunt_pq_pop_min_item(c_hunt_pq_t * pqueue, pq_key_t *priority, int64_t *value) {
+  return pop_min(pqueue, priority, value, true);
+}
+
+static int try_pop_min(void *pqueue, void *key, int64_t *value) {
+  return c_hunt_pq_pop_min_item(pqueue, key, value);
+}
+
+/** Pop the smallest item, waiting up to timeout_ns nanoseconds for one to
+ *  arrive if the queue is empty; a negative timeout waits forever.  Return
+ *  false on timeout.
+ */
+int c_hunt_pq_pop_min_wait(c_hunt_pq_t *pqueue, pq_key_t *key, int64_t *value, int64_t timeout_ns) {
+  return parking_lot_wait(pqueue->waiters, try_pop_min, pqueue, key, value, timeout_ns);
+}
+
+/** Store the priority and value at the root without removing it.  Return
+ *  true iff the heap was not empty.  The root is read under its lock, and a
+ *  pop holds that lock until the root holds the smaller child, so this is
+ *  the minimum of every item whose insert or decrease_key has finished
+ *  sifting up.  An item still on its way up is not seen yet.
+ */
+int c_hunt_pq_peek_min(c_hunt_pq_t * pqueue, pq_key_t *priority, int64_t *value) {
+  bucket_t *root = pqueue->buckets + 1;
+  lock(&root->lock);
+  if(atomic_load_explicit(&root->tag, memory_order_relaxed) == EMPTY) {
+    unlock(&root->lock);
+    return false;
+  }
+  *priority = root->priority;
+  *value = root->value;
+  unlock(&root->lock);
+  return true;
+}
+
+/** Return the approximate number of items.  Each thread counts on its own
+ *  shard rather than touching the heap lock, and the read sums the shards
+ *  without stopping writers, so it is exact only at quiescence.
+ */
+size_t c_hunt_pq_size(c_hunt_pq_t * pqueue) {
+  return sharded_counter_read_size(pqueue->items);
+}
+
+/** Free the heap and the handles of the items still in it.  Handles of
+ *  items that have left were retired, or leaked, when they left.  No other
+ *  thread may be using the heap, and its outstanding handles are invalid
+ *  afterwards.
+ */
+void c_hunt_pq_destroy(c_hunt_pq_t * pqueue) {
+  // The bit-reversed counter spreads the items over the last level, so
+  // look at every bucket rather than the first count.
+  for(size_t i = 1; i < pqueue->size; i++) {
+    if(atomic_load_explicit(&pqueue->buckets[i].tag, memory_order_relaxed) != EMPTY
+      && pqueue->buckets[i].handle != NULL) {
+      forkscan_free(pqueue->buckets[i].handle);
+    }
+  }
+  parking_lot_destroy(pqueue->waiters);
+  sharded_counter_destroy(pqueue->items);
+  forkscan_free(pqueue->buckets);
+  forkscan_free(pqueue);
 }
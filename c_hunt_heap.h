@@ -7,13 +7,24 @@
 #include <stdint.h>
 #include <stddef.h>
 
-#define N 20
+#include "pq_key.h"
 
 typedef struct c_hunt_pq_t c_hunt_pq_t;
+typedef struct c_hunt_pq_handle_t c_hunt_pq_handle_t;
 
 c_hunt_pq_t *c_hunt_pq_create(size_t size);
 
-int c_hunt_pq_add(c_hunt_pq_t *pqueue, int64_t priority);
+int c_hunt_pq_add(c_hunt_pq_t *pqueue, pq_key_t priority);
+int c_hunt_pq_add_item(c_hunt_pq_t *pqueue, pq_key_t priority, int64_t value);
+c_hunt_pq_handle_t *c_hunt_pq_add_handle(c_hunt_pq_t *pqueue, pq_key_t priority, int64_t value);
+int c_hunt_pq_decrease_key(c_hunt_pq_t *pqueue, c_hunt_pq_handle_t *handle, pq_key_t priority);
+int c_hunt_pq_remove(c_hunt_pq_t *pqueue, c_hunt_pq_handle_t *handle);
 int c_hunt_pq_leaky_pop_min(c_hunt_pq_t *pqueue);
 int c_hunt_pq_pop_min(c_hunt_pq_t * pqueue);
+int c_hunt_pq_leaky_pop_min_item(c_hunt_pq_t *pqueue, pq_key_t *priority, int64_t *value);
+int c_hunt_pq_pop_min_item(c_hunt_pq_t *pqueue, pq_key_t *priority, int64_t *value);
+int c_hunt_pq_pop_min_wait(c_hunt_pq_t *pqueue, pq_key_t *key, int64_t *value, int64_t timeout_ns);
+int c_hunt_pq_peek_min(c_hunt_pq_t *pqueue, pq_key_t *priority, int64_t *value);
+size_t c_hunt_pq_size(c_hunt_pq_t *pqueue);
+void c_hunt_pq_destroy(c_hunt_pq_t *pqueue);
 void c_hunt_pq_print (c_hunt_pq_t *pqueue);
\ No newline at end of file
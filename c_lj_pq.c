@@ -3,6 +3,9 @@
  */
 
 #include "c_lj_pq.h"
+#include "parking_lot.h"
+#include "sharded_counter.h"
+#include "node_pool.h"
 #include "utils.h"
 
 #include <stdbool.h>
@@ -19,25 +22,62 @@ enum LJ_STATE { INSERT_PENDING, INSERTED };
 typedef enum LJ_STATE state_t;
 
 struct node_t {
-  int64_t key;
+  pq_key_t key;
+  int64_t value;
+  uint64_t seq;
   int32_t toplevel;
   _Atomic(state_t) insert_state;
-  _Atomic(node_ptr) next[N];
+  // Set by whichever of pop_min and pop_max claims the node first.
+  atomic_bool taken;
+  // Sized to toplevel + 1 by node_create.
+  _Atomic(node_ptr) next[];
 };
 
 struct c_lj_pq_t {
+  // Sequence numbers for add_dup, off the lines that searches read.
+  _Atomic(uint64_t) seq;
+  char padding[128];
+  sharded_counter_t *size;
+  parking_lot_t *waiters;
   uint32_t boundoffset;
-  node_t head, tail;
+  // Highest level any node has been linked at; searches start there.
+  _Atomic(int32_t) toplevel;
+  node_ptr head, tail;
 };
 
-static node_ptr node_create(int64_t key, int32_t toplevel){
-  node_ptr node = forkscan_malloc(sizeof(node_t));
+/** Return the bytes a node with a tower toplevel + 1 high takes.
+ */
+static size_t node_size(int32_t toplevel) {
+  return sizeof(node_t) + (toplevel + 1) * sizeof(node_ptr);
+}
+
+/** Allocate a node with a tower of toplevel + 1 links.
+ */
+static node_ptr node_create(pq_key_t key, int64_t value, uint64_t seq, int32_t toplevel){
+  node_ptr node = node_pool_alloc(node_size(toplevel));
   node->key = key;
+  node->value = value;
+  node->seq = seq;
   node->toplevel = toplevel;
   atomic_store_explicit(&node->insert_state, INSERT_PENDING, memory_order_relaxed);
+  atomic_store_explicit(&node->taken, false, memory_order_relaxed);
   return node;
 }
 
+/** Hand a node no other thread can reach back to the node pool.
+ */
+static void node_free(node_ptr node) {
+  if(node != NULL) {
+    node_pool_free(node, node_size(node->toplevel));
+  }
+}
+
+/** Retire a node other threads may still reach.
+ */
+static void node_retire(node_ptr node) {
+  node_pool_retire(node, node_size(node->toplevel));
+}
+
 static node_ptr unmark(node_ptr node){
   return (node_ptr)(((size_t)node) & (~0x1));
 }
@@ -50,14 +90,32 @@ static bool is_marked(node_ptr node){
   return unmark(node) != node;
 }
 
+/** Return the highest level any node has been linked at.  The levels above
+ *  it are empty, so a search starts here rather than at the top of the
+ *  head's tower, which in a small queue skips most of it.
+ */
+static int32_t top_level(c_lj_pq_t *pqueue) {
+  return atomic_load_explicit(&pqueue->toplevel, memory_order_relaxed);
+}
+
+/** Raise the top level to cover a node of height toplevel + 1.  This is
+ *  done before the node is linked, so that by the time a search can reach
+ *  the node it starts at or above the node's top.
+ */
+static void raise_top_level(c_lj_pq_t *pqueue, int32_t toplevel) {
+  int32_t top = atomic_load_explicit(&pqueue->toplevel, memory_order_relaxed);
+  while(top < toplevel && !atomic_compare_exchange_weak_explicit(&pqueue->toplevel,
+    &top, toplevel, memory_order_seq_cst, memory_order_relaxed)) {}
+}
+
 
 /** Print out the contents of the skip list along with node heights.
  */
 void c_lj_pq_print (c_lj_pq_t *pqueue){
-  node_ptr node = atomic_load_explicit(&pqueue->head.next[0], memory_order_consume);
-  while(unmark(node) != &pqueue->tail) {
+  node_ptr node = atomic_load_explicit(&pqueue->head->next[0], memory_order_consume);
+  while(unmark(node) != pqueue->tail) {
     node_ptr unmarked_node = unmark(node);
-    printf("node[%d]: %ld deleted: %d\n", unmarked_node->toplevel, unmarked_node->key, is_marked(node));
+    printf("node[%d]: %ld deleted: %d\n", unmarked_node->toplevel, (long)unmarked_node->key, is_marked(node));
     node = atomic_load_explicit(&unmarked_node->next[0], memory_order_relaxed);
   }
 }
@@ -67,32 +125,57 @@ void c_lj_pq_print (c_lj_pq_t *pqueue){
 c_lj_pq_t * c_lj_pq_create(uint32_t boundoffset) {
   c_lj_pq_t* lj_pqueue = forkscan_malloc(sizeof(c_lj_pq_t));
   lj_pqueue->boundoffset = boundoffset;
-  lj_pqueue->head.key = INT64_MIN;
-  atomic_store_explicit(&lj_pqueue->head.insert_state, INSERTED, memory_order_relaxed);
-  lj_pqueue->tail.key = INT64_MAX;
-  atomic_store_explicit(&lj_pqueue->tail.insert_state, INSERTED, memory_order_relaxed);
+  atomic_store_explicit(&lj_pqueue->seq, 0, memory_order_relaxed);
+  lj_pqueue->size = sharded_counter_create(SHARDED_COUNTER_LOCAL_SHARDS);
+  lj_pqueue->waiters = parking_lot_create();
+  atomic_store_explicit(&lj_pqueue->toplevel, 0, memory_order_relaxed);
+  lj_pqueue->head = node_create(PQ_KEY_MIN, 0, 0, N - 1);
+  lj_pqueue->tail = node_create(PQ_KEY_MAX, 0, UINT64_MAX, N - 1);
+  atomic_store_explicit(&lj_pqueue->head->insert_state, INSERTED, memory_order_relaxed);
+  atomic_store_explicit(&lj_pqueue->tail->insert_state, INSERTED, memory_order_relaxed);
   for(int64_t i = 0; i < N; i++) {
-    atomic_store_explicit(&lj_pqueue->head.next[i], &lj_pqueue->tail, memory_order_relaxed);
-    atomic_store_explicit(&lj_pqueue->tail.next[i], NULL, memory_order_relaxed);
+    atomic_store_explicit(&lj_pqueue->head->next[i], lj_pqueue->tail, memory_order_relaxed);
+    atomic_store_explicit(&lj_pqueue->tail->next[i], NULL, memory_order_relaxed);
   }
   return lj_pqueue;
 }
 
 
-static node_ptr locate_preds(
+/** Order nodes by key, then by sequence number.  Plain adds use sequence
+ *  0, which sorts ahead of every duplicate of the same key.
+ */
+static bool node_less(node_ptr node, pq_key_t key, uint64_t seq) {
+  return node->key < key || (node->key == key && node->seq < seq);
+}
+
+/** Fill preds and succs for (key, seq) and return the last deleted node passed
+ *  at the bottom level.  If hinted, preds already holds the predecessors of
+ *  a smaller key and each level resumes from there rather than from the
+ *  head; a hint that has since been deleted has a marked next[0], so the
+ *  bottom level walks past it as it would from the head.
+ */
+static node_ptr locate_preds_from(
   c_lj_pq_t *pqueue, 
-  int64_t key,
+  pq_key_t key,
+  uint64_t seq,
   node_ptr preds[N],
-  node_ptr succs[N]) {
-  node_ptr cur = &pqueue->head, next = NULL, del = NULL;
-  int32_t level = N - 1;
+  node_ptr succs[N],
+  bool hinted) {
+  node_ptr cur = pqueue->head, next = NULL, del = NULL;
+  int32_t level = top_level(pqueue);
   bool deleted = false;
+  // Nothing is linked above the top level.
+  for(int32_t empty = N - 1; empty > level; --empty) {
+    preds[empty] = pqueue->head;
+    succs[empty] = pqueue->tail;
+  }
   while(level >= 0) {
+    if(hinted && preds[level]->key > cur->key) { cur = preds[level]; }
     next = atomic_load_explicit(&cur->next[level], memory_order_consume);
     deleted = is_marked(next);
     next = unmark(next);
 
-    while(next->key < key || 
+    while(node_less(next, key, seq) || 
       is_marked(atomic_load_explicit(&next->next[0], memory_order_relaxed)) || 
       ((level == 0) && deleted)) {
       if(level == 0 && deleted) {
@@ -112,24 +195,37 @@ static node_ptr locate_preds(
 
 /** Add a node, lock-free, to the skiplist.
  */
-int c_lj_pq_add(uint64_t *seed, c_lj_pq_t * pqueue, int64_t key) {
-  node_ptr preds[N], succs[N];
+int c_lj_pq_add(uint64_t *seed, c_lj_pq_t * pqueue, pq_key_t key) {
+  return c_lj_pq_add_item(seed, pqueue, key, 0);
+}
+
+/** Insert (key, seq).  Sequence 0 is a plain add and fails if key is
+ *  already present; any other sequence always goes in, after every older
+ *  duplicate of key.
+ */
+static int add_from(uint64_t *seed, c_lj_pq_t * pqueue, pq_key_t key, int64_t value,
+  uint64_t seq, node_ptr preds[N], node_ptr succs[N], bool hinted) {
   int32_t toplevel = random_level(seed, N);
   node_ptr node = NULL;
+  raise_top_level(pqueue, toplevel);
   while(true) {
-    node_ptr del = locate_preds(pqueue, key, preds, succs);
+    node_ptr del = locate_preds_from(pqueue, key, seq, preds, succs, hinted);
     node_ptr pred_next = atomic_load_explicit(&preds[0]->next[0], memory_order_relaxed);
-    if(succs[0]->key == key &&
+    if(seq == 0 && succs[0]->key == key &&
       !is_marked(pred_next) &&
-      pred_next == succs[0]) {
-      if(node != NULL) { forkscan_free((void*)node); }
+      pred_next == succs[0] &&
+      !atomic_load_explicit(&succs[0]->taken, memory_order_relaxed)) {
+      node_free(node);
       return false;
     }
 
-    if(node == NULL) { node = node_create(key, toplevel); }
+    if(node == NULL) { node = node_create(key, value, seq, toplevel); }
     for(int64_t i = 0; i <= toplevel; ++i) { atomic_store_explicit(&node->next[i], succs[i], memory_order_release); }
     node_ptr pred = preds[0], succ = succs[0];
     if(!atomic_compare_exchange_weak_explicit(&pred->next[0], &succ, node, memory_order_release, memory_order_relaxed)) { continue; }
+    // Linked at the bottom, so the node is in the queue whatever happens above.
+    sharded_counter_add_local(pqueue->size, 1);
+    parking_lot_wake(pqueue->waiters);
 
     for(int64_t i = 1; i <= toplevel; i++) {
 
@@ -143,7 +239,7 @@ int c_lj_pq_add(uint64_t *seed, c_lj_pq_t * pqueue, int64_t key) {
       atomic_store_explicit(&node->next[i], succs[i], memory_order_release);
 
       if(!atomic_compare_exchange_weak_explicit(&preds[i]->next[i], &succs[i], node, memory_order_release, memory_order_relaxed)) {
-        del = locate_preds(pqueue, key, preds, succs);
+        del = locate_preds_from(pqueue, key, seq, preds, succs, false);
         if(succs[0] != node) {
           atomic_store_explicit(&node->insert_state, INSERTED, memory_order_relaxed);
           return true;
@@ -155,13 +251,59 @@ int c_lj_pq_add(uint64_t *seed, c_lj_pq_t * pqueue, int64_t key) {
   }
 }
 
+/** Add a key with its value, lock-free, to the skiplist.
+ */
+int c_lj_pq_add_item(uint64_t *seed, c_lj_pq_t * pqueue, pq_key_t key, int64_t value) {
+  node_ptr preds[N], succs[N];
+  return add_from(seed, pqueue, key, value, 0, preds, succs, false);
+}
+
+/** Add a key, lock-free, to the skiplist even if it is already present.
+ *  Equal keys pop in the order they were added.
+ */
+int c_lj_pq_add_dup(uint64_t *seed, c_lj_pq_t * pqueue, pq_key_t key) {
+  return c_lj_pq_add_dup_item(seed, pqueue, key, 0);
+}
+
+/** Add a key with its value, lock-free, to the skiplist even if the key is
+ *  already present.  Equal keys pop in the order they were added.
+ */
+int c_lj_pq_add_dup_item(uint64_t *seed, c_lj_pq_t * pqueue, pq_key_t key, int64_t value) {
+  node_ptr preds[N], succs[N];
+  uint64_t seq = atomic_fetch_add_explicit(&pqueue->seq, 1, memory_order_relaxed) + 1;
+  return add_from(seed, pqueue, key, value, seq, preds, succs, false);
+}
+
+/** Add n keys, lock-free, to the skiplist.  The keys are sorted in place
+ *  and spliced in left to right, each search resuming from the
+ *  predecessors of the key before it.  Return the number of keys added.
+ */
+int c_lj_pq_add_batch(uint64_t *seed, c_lj_pq_t * pqueue, pq_key_t *keys, size_t n) {
+  node_ptr preds[N], succs[N];
+  int added = 0;
+  pq_key_sort(keys, n);
+  for(size_t i = 0; i < n; i++) {
+    if(i > 0 && keys[i] == keys[i - 1]) { continue; }
+    added += add_from(seed, pqueue, keys[i], 0, 0, preds, succs, i > 0);
+  }
+  return added;
+}
+
+
+/** Take the node whose incoming pointer was just marked, unless pop_max
+ *  got to it first.  Either way the node is now deleted and part of the
+ *  prefix, so a pop that loses here carries on walking from it.
+ */
+static bool taken_by_pop_max(node_ptr node) {
+  return atomic_exchange_explicit(&node->taken, true, memory_order_relaxed);
+}
 
 static void restructure(c_lj_pq_t *pqueue) {
   node_ptr pred = NULL, cur = NULL, head = NULL;
-  int32_t level = N - 1;
-  pred = &pqueue->head;
+  int32_t level = top_level(pqueue);
+  pred = pqueue->head;
   while(level > 0) {
-    head = atomic_load_explicit(&pqueue->head.next[level], memory_order_consume);
+    head = atomic_load_explicit(&pqueue->head->next[level], memory_order_consume);
     cur = atomic_load_explicit(&pred->next[level], memory_order_consume);
     if(!is_marked(atomic_load_explicit(&head->next[0], memory_order_consume))) {
       level--;
@@ -171,7 +313,7 @@ static void restructure(c_lj_pq_t *pqueue) {
       pred = cur;
       cur = atomic_load_explicit(&pred->next[level], memory_order_consume);
     }
-    if(atomic_compare_exchange_weak_explicit(&pqueue->head.next[level], 
+    if(atomic_compare_exchange_weak_explicit(&pqueue->head->next[level], 
       &head, cur, memory_order_release, memory_order_consume)){
       level--;
     }
@@ -183,25 +325,37 @@ static void restructure(c_lj_pq_t *pqueue) {
  *  Leak the memory.
  */
 int c_lj_pq_leaky_pop_min(c_lj_pq_t * pqueue) {
-  node_ptr cur = &pqueue->head, next = NULL, newhead = NULL,
+  pq_key_t key;
+  int64_t value;
+  return c_lj_pq_leaky_pop_min_item(pqueue, &key, &value);
+}
+
+/** Pop the front node from the list and store its key and value.  Return
+ *  true iff there was a node to pop.  Leak the memory.
+ */
+int c_lj_pq_leaky_pop_min_item(c_lj_pq_t * pqueue, pq_key_t *key, int64_t *value) {
+  node_ptr cur = pqueue->head, next = NULL, newhead = NULL,
     obs_head = atomic_load_explicit(&cur->next[0], memory_order_relaxed);
   int32_t offset = 0;
   do {
     offset++;
     next = atomic_load_explicit(&cur->next[0], memory_order_consume);
-    if(unmark(next) == &pqueue->tail) { return false; }
+    if(unmark(next) == pqueue->tail) { return false; }
     if(newhead == NULL && atomic_load_explicit(&cur->insert_state, memory_order_relaxed) == INSERT_PENDING) { newhead = cur; }
     if(is_marked(next)) { continue; }
     // Yuck
     next = atomic_fetch_or_explicit((_Atomic(uintptr_t)*)&cur->next[0], 1, memory_order_relaxed);
-  } while((cur = unmark(next)) && is_marked(next));
-  
+  } while((cur = unmark(next)) && (is_marked(next) || taken_by_pop_max(cur)));
+  // The successor whose incoming pointer we marked is ours.
+  *key = cur->key;
+  *value = cur->value;
+  sharded_counter_add_local(pqueue->size, -1);
 
   if(newhead == NULL) { newhead = cur; }
   if(offset <= pqueue->boundoffset) { return true; }
-  if(atomic_load_explicit(&pqueue->head.next[0], memory_order_relaxed) != obs_head) { return true; }
+  if(atomic_load_explicit(&pqueue->head->next[0], memory_order_relaxed) != obs_head) { return true; }
 
-  if(atomic_compare_exchange_weak_explicit(&pqueue->head.next[0], &obs_head, mark(newhead), memory_order_release, memory_order_relaxed)) {
+  if(atomic_compare_exchange_weak_explicit(&pqueue->head->next[0], &obs_head, mark(newhead), memory_order_release, memory_order_relaxed)) {
     restructure(pqueue);
   }
   return true;
@@ -210,33 +364,223 @@ int c_lj_pq_leaky_pop_min(c_lj_pq_t * pqueue) {
 /** Pop the front node from the list.  Return true iff there was a node to pop.
  */
 int c_lj_pq_pop_min(c_lj_pq_t * pqueue) {
-  node_ptr cur = &pqueue->head, next = NULL, newhead = NULL,
+  pq_key_t key;
+  int64_t value;
+  return c_lj_pq_pop_min_item(pqueue, &key, &value);
+}
+
+/** Pop the front node from the list and store its key and value.  Return
+ *  true iff there was a node to pop.
+ */
+int c_lj_pq_pop_min_item(c_lj_pq_t * pqueue, pq_key_t *key, int64_t *value) {
+  node_ptr cur = pqueue->head, next = NULL, newhead = NULL,
     obs_head = NULL;
   int32_t offset = 0;
   obs_head = atomic_load_explicit(&cur->next[0], memory_order_consume);
   do {
     offset++;
     next = atomic_load_explicit(&cur->next[0], memory_order_consume);
-    if(unmark(next) == &pqueue->tail) { return false; }
+    if(unmark(next) == pqueue->tail) { return false; }
     if(newhead == NULL && atomic_load_explicit(&cur->insert_state, memory_order_relaxed) == INSERT_PENDING) { newhead = cur; }
     if(is_marked(next)) { continue; }
     // Yuck
     next = atomic_fetch_or_explicit((_Atomic(uintptr_t)*)&cur->next[0], 1, memory_order_relaxed);
-  } while((cur = unmark(next)) && is_marked(next));
-  
+  } while((cur = unmark(next)) && (is_marked(next) || taken_by_pop_max(cur)));
+  // The successor whose incoming pointer we marked is ours.
+  *key = cur->key;
+  *value = cur->value;
+  sharded_counter_add_local(pqueue->size, -1);
 
   if(newhead == NULL) { newhead = cur; }
   if(offset <= pqueue->boundoffset) { return true; }
-  if(atomic_load_explicit(&pqueue->head.next[0], memory_order_relaxed) != obs_head) { return true; }
+  if(atomic_load_explicit(&pqueue->head->next[0], memory_order_relaxed) != obs_head) { return true; }
 
-  if(atomic_compare_exchange_weak_explicit(&pqueue->head.next[0], &obs_head, mark(newhead), memory_order_release, memory_order_relaxed)) {
+  if(atomic_compare_exchange_weak_explicit(&pqueue->head->next[0], &obs_head, mark(newhead), memory_order_release, memory_order_relaxed)) {
     restructure(pqueue);
     cur = unmark(obs_head);
     while (cur != unmark(newhead)) {
       next = unmark(cur->next[0]);
-      forkscan_retire((void*) cur);
+      node_retire(cur);
       cur = next;
     }
   }
   return true;
-}
\ No newline at end of file
+}
+
+/** Pop the back node from the list and store its key and value.  Return
+ *  true iff there was a node to pop.
+ *  Marking the pointer into a node, as pop_min does, is only sound at the
+ *  front: searches take a node with a marked next[0] to be in the deleted
+ *  prefix and walk past it.  So pop_max claims the last live node through
+ *  its taken flag instead, leaving the pointers alone, and pop_min
+ *  exchanges the same flag on every node it marks so that only one of the
+ *  two takes it.  Each upper level is left from the last node whose
+ *  successor was live and untaken when read, which keeps the last such
+ *  node ahead of the bottom walk.  A taken node stays linked until the
+ *  deleted prefix reaches it and the head swings past, which also retires
+ *  it; so there is no leaky variant, and a run of pop_max calls with no
+ *  pop_min behind them leaves a growing taken tail for later pops to walk.
+ */
+int c_lj_pq_pop_max_item(c_lj_pq_t * pqueue, pq_key_t *key, int64_t *value) {
+  while(true) {
+    node_ptr start = pqueue->head;
+    for(int32_t level = top_level(pqueue); level >= 1; level--) {
+      node_ptr cur = start;
+      node_ptr next = unmark(atomic_load_explicit(&cur->next[level], memory_order_consume));
+      while(next != pqueue->tail) {
+        cur = next;
+        node_ptr succ = atomic_load_explicit(&cur->next[0], memory_order_relaxed);
+        if(!is_marked(succ) && succ != pqueue->tail &&
+          !atomic_load_explicit(&succ->taken, memory_order_relaxed)) {
+          start = cur;
+        }
+        next = unmark(atomic_load_explicit(&cur->next[level], memory_order_consume));
+      }
+    }
+    node_ptr last = NULL, cur = start;
+    node_ptr next = atomic_load_explicit(&cur->next[0], memory_order_consume);
+    while(unmark(next) != pqueue->tail) {
+      cur = unmark(next);
+      if(!is_marked(next) && !atomic_load_explicit(&cur->taken, memory_order_relaxed)) {
+        last = cur;
+      }
+      next = atomic_load_explicit(&cur->next[0], memory_order_consume);
+    }
+    if(last == NULL) {
+      if(start == pqueue->head) { return false; }
+      continue;
+    }
+    if(!atomic_exchange_explicit(&last->taken, true, memory_order_relaxed)) {
+      *key = last->key;
+      *value = last->value;
+      sharded_counter_add_local(pqueue->size, -1);
+      return true;
+    }
+  }
+}
+
+/** Pop the back node from the list.  Return true iff there was a node to
+ *  pop.
+ */
+int c_lj_pq_pop_max(c_lj_pq_t * pqueue) {
+  pq_key_t key;
+  int64_t value;
+  return c_lj_pq_pop_max_item(pqueue, &key, &value);
+}
+
+/** Claim up to k of the smallest nodes by carrying the marking walk of
+ *  pop_min on past the first claimed node, then swing the head once for
+ *  the whole run.  The claimed items are stored in keys and values,
+ *  smallest first.  Return the number claimed.
+ */
+static size_t pop_many(c_lj_pq_t * pqueue, size_t k, pq_key_t *keys, int64_t *values, bool retire) {
+  node_ptr cur = pqueue->head, next = NULL, newhead = NULL,
+    obs_head = atomic_load_explicit(&cur->next[0], memory_order_consume);
+  int32_t offset = 0;
+  size_t count = 0;
+  while(count < k) {
+    do {
+      offset++;
+      next = atomic_load_explicit(&cur->next[0], memory_order_consume);
+      if(unmark(next) == pqueue->tail) { goto swing_head; }
+      if(newhead == NULL && atomic_load_explicit(&cur->insert_state, memory_order_relaxed) == INSERT_PENDING) { newhead = cur; }
+      if(is_marked(next)) { continue; }
+      next = (node_ptr)atomic_fetch_or_explicit((_Atomic(uintptr_t)*)&cur->next[0], 1, memory_order_relaxed);
+    } while((cur = unmark(next)) && (is_marked(next) || taken_by_pop_max(cur)));
+    keys[count] = cur->key;
+    values[count] = cur->value;
+    count++;
+  }
+
+swing_head:
+  if(count == 0) { return 0; }
+  sharded_counter_add_local(pqueue->size, -(int64_t)count);
+  if(newhead == NULL) { newhead = cur; }
+  if(offset <= pqueue->boundoffset) { return count; }
+  if(atomic_load_explicit(&pqueue->head->next[0], memory_order_relaxed) != obs_head) { return count; }
+
+  if(atomic_compare_exchange_weak_explicit(&pqueue->head->next[0], &obs_head, mark(newhead), memory_order_release, memory_order_relaxed)) {
+    restructure(pqueue);
+    if(retire) {
+      cur = unmark(obs_head);
+      while (cur != unmark(newhead)) {
+        next = unmark(cur->next[0]);
+        node_retire(cur);
+        cur = next;
+      }
+    }
+  }
+  return count;
+}
+
+/** Pop up to k of the smallest nodes into keys and values, smallest
+ *  first.  Return the number popped.  Leak the memory.
+ */
+size_t c_lj_pq_leaky_pop_many(c_lj_pq_t * pqueue, size_t k, pq_key_t *keys, int64_t *values) {
+  return pop_many(pqueue, k, keys, values, false);
+}
+
+/** Pop up to k of the smallest nodes into keys and values, smallest
+ *  first.  Return the number popped.
+ */
+size_t c_lj_pq_pop_many(c_lj_pq_t * pqueue, size_t k, pq_key_t *keys, int64_t *values) {
+  return pop_many(pqueue, k, keys, values, true);
+}
+
+static int try_pop_min(void *pqueue, void *key, int64_t *value) {
+  return c_lj_pq_pop_min_item(pqueue, key, value);
+}
+
+/** Pop the smallest item, waiting up to timeout_ns nanoseconds for one to
+ *  arrive if the queue is empty; a negative timeout waits forever.  Return
+ *  false on timeout.
+ */
+int c_lj_pq_pop_min_wait(c_lj_pq_t *pqueue, pq_key_t *key, int64_t *value, int64_t timeout_ns) {
+  return parking_lot_wait(pqueue->waiters, try_pop_min, pqueue, key, value, timeout_ns);
+}
+
+/** Store the key and value of the first node not yet deleted without
+ *  removing it.  Return true iff there was one.  A node is deleted once
+ *  the pointer into it is marked, so this is the walk pop_min makes minus
+ *  the fetch_or.  Exact only at quiescence: a concurrent pop may mark the
+ *  node before the caller looks.
+ */
+int c_lj_pq_peek_min(c_lj_pq_t * pqueue, pq_key_t *key, int64_t *value) {
+  node_ptr cur = pqueue->head;
+  while(true) {
+    node_ptr next = atomic_load_explicit(&cur->next[0], memory_order_consume);
+    cur = unmark(next);
+    if(cur == pqueue->tail) { return false; }
+    if(!is_marked(next) && !atomic_load_explicit(&cur->taken, memory_order_relaxed)) {
+      *key = cur->key;
+      *value = cur->value;
+      return true;
+    }
+  }
+}
+
+/** Return the approximate number of nodes, summed from per-thread shards
+ *  without stopping writers.  Exact only at quiescence.
+ */
+size_t c_lj_pq_size(c_lj_pq_t * pqueue) {
+  return sharded_counter_read_size(pqueue->size);
+}
+
+/** Free the queue and every node still in it.  Every node past the head is
+ *  freed, deleted or not: pops retire a deleted prefix only once the head
+ *  has swung past it, so whatever is still reachable was never retired.
+ *  No other thread may be using the queue.
+ */
+void c_lj_pq_destroy(c_lj_pq_t * pqueue) {
+  node_ptr node = unmark(atomic_load_explicit(&pqueue->head->next[0], memory_order_relaxed));
+  while(node != pqueue->tail) {
+    node_ptr next = unmark(atomic_load_explicit(&node->next[0], memory_order_relaxed));
+    node_free(node);
+    node = next;
+  }
+  node_free(pqueue->head);
+  node_free(pqueue->tail);
+  parking_lot_destroy(pqueue->waiters);
+  sharded_counter_destroy(pqueue->size);
+  forkscan_free(pqueue);
+}
@@ -1,14 +1,32 @@
 #pragma once
 
 #include <stdint.h>
+#include <stddef.h>
 
-#define N 20
+#include "pq_key.h"
+#include "utils.h"
+
+#define N SKIPLIST_HEIGHT
 
 typedef struct c_lj_pq_t c_lj_pq_t;
 
 c_lj_pq_t * c_lj_pq_create(uint32_t boundoffset);
 
-int c_lj_pq_add(uint64_t *seed, c_lj_pq_t * pqueue, int64_t key);
+int c_lj_pq_add(uint64_t *seed, c_lj_pq_t * pqueue, pq_key_t key);
+int c_lj_pq_add_item(uint64_t *seed, c_lj_pq_t * pqueue, pq_key_t key, int64_t value);
+int c_lj_pq_add_dup(uint64_t *seed, c_lj_pq_t * pqueue, pq_key_t key);
+int c_lj_pq_add_dup_item(uint64_t *seed, c_lj_pq_t * pqueue, pq_key_t key, int64_t value);
+int c_lj_pq_add_batch(uint64_t *seed, c_lj_pq_t * pqueue, pq_key_t *keys, size_t n);
 int c_lj_pq_pop_min(c_lj_pq_t * pqueue);
 int c_lj_pq_leaky_pop_min(c_lj_pq_t * pqueue);
+int c_lj_pq_pop_min_item(c_lj_pq_t * pqueue, pq_key_t *key, int64_t *value);
+int c_lj_pq_leaky_pop_min_item(c_lj_pq_t * pqueue, pq_key_t *key, int64_t *value);
+int c_lj_pq_pop_max(c_lj_pq_t * pqueue);
+int c_lj_pq_pop_max_item(c_lj_pq_t * pqueue, pq_key_t *key, int64_t *value);
+size_t c_lj_pq_pop_many(c_lj_pq_t * pqueue, size_t k, pq_key_t *keys, int64_t *values);
+size_t c_lj_pq_leaky_pop_many(c_lj_pq_t * pqueue, size_t k, pq_key_t *keys, int64_t *values);
+int c_lj_pq_pop_min_wait(c_lj_pq_t *pqueue, pq_key_t *key, int64_t *value, int64_t timeout_ns);
+int c_lj_pq_peek_min(c_lj_pq_t * pqueue, pq_key_t *key, int64_t *value);
+size_t c_lj_pq_size(c_lj_pq_t * pqueue);
+void c_lj_pq_destroy(c_lj_pq_t * pqueue);
 void c_lj_pq_print(c_lj_pq_t *pqueue);
\ No newline at end of file
@@ -5,6 +5,9 @@
  */
 
 #include "c_mounds.h"
+#include "parking_lot.h"
+#include "sharded_counter.h"
+#include "node_pool.h"
 #include "utils.h"
 
 #include <stdbool.h>
@@ -23,18 +26,28 @@ typedef struct mound_node_t mound_node_t;
 typedef struct bit_reversed_counter_t bit_reversed_counter_t;
 
 struct list_node_t {
-  int64_t priority;
+  pq_key_t priority;
+  int64_t value;
+  c_mound_pq_handle_t *handle;
   list_node_t *next;
 };
 
+struct c_mound_pq_handle_t {
+  // The list node that holds the item, or NULL once it has left.  A node
+  // its handle has moved off is stale and is dropped when popped.
+  _Atomic(list_node_t *) node;
+};
+
 struct mound_node_t {
   pthread_mutex_t lock;
   _Atomic(list_node_t *) list;
 };
 
-list_node_t *list_node_create(list_node_t *list, int64_t priority) {
-  list_node_t *new_node = forkscan_malloc(sizeof(list_node_t));
+list_node_t *list_node_create(list_node_t *list, pq_key_t priority, int64_t value) {
+  list_node_t *new_node = node_pool_alloc(sizeof(list_node_t));
   new_node->priority = priority;
+  new_node->value = value;
+  new_node->handle = NULL;
   new_node->next = list;
   return new_node;
 }
@@ -55,8 +68,8 @@ size_t get_parent(size_t i) {
   return i / 2;
 }
 
-int64_t get_val(list_node_t *list) {
-  return (list == NULL) ? INT64_MAX : list->priority;
+pq_key_t get_val(list_node_t *list) {
+  return (list == NULL) ? PQ_KEY_MAX : list->priority;
 }
 
 struct c_mound_pq_t {
@@ -64,6 +77,8 @@ struct c_mound_pq_t {
   mound_node_t *tree;
   uintmax_t max_depth;
   atomic_uintmax_t depth;
+  sharded_counter_t *size;
+  parking_lot_t *waiters;
 };
 
 
@@ -79,6 +94,8 @@ c_mound_pq_t* c_mound_pq_create(size_t size) {
   }
   mound_pqueue->max_depth = size;
   atomic_store_explicit(&mound_pqueue->depth, log2(size) - 1, memory_order_relaxed);
+  mound_pqueue->size = sharded_counter_create(SHARDED_COUNTER_LOCAL_SHARDS);
+  mound_pqueue->waiters = parking_lot_create();
   return mound_pqueue;
 }
 
@@ -100,15 +117,15 @@ static uintmax_t rand_leaf(uintmax_t depth, uint64_t *seed) {
   return lower + (fast_rand(seed) % diff);
 }
 
-static size_t binary_search(c_mound_pq_t *pqueue, uintmax_t leaf, uintmax_t root, int64_t priority) {
+static size_t binary_search(c_mound_pq_t *pqueue, uintmax_t leaf, uintmax_t root, pq_key_t priority) {
   return ROOT;
 }
 
-static size_t linear_search(c_mound_pq_t *pqueue, uintmax_t leaf, uintmax_t root, int64_t priority) {
+static size_t linear_search(c_mound_pq_t *pqueue, uintmax_t leaf, uintmax_t root, pq_key_t priority) {
   uintmax_t last_index = leaf;
   for(uintmax_t  parent = leaf / 2; parent != 0; last_index = parent, parent /= 2) {
     list_node_t *list = atomic_load_explicit(&pqueue->tree[parent].list, memory_order_seq_cst);
-    int64_t parent_priority = get_val(list);
+    pq_key_t parent_priority = get_val(list);
     if(parent_priority < priority) {
       return last_index;
     }
@@ -116,13 +133,13 @@ static size_t linear_search(c_mound_pq_t *pqueue, uintmax_t leaf, uintmax_t root
   return last_index;
 }
 
-static uintmax_t find_insert_point(uint64_t *seed, c_mound_pq_t *pqueue, int64_t priority) {
+static uintmax_t find_insert_point(uint64_t *seed, c_mound_pq_t *pqueue, pq_key_t priority) {
   while(true) {
     uintmax_t depth = atomic_load_explicit(&pqueue->depth, memory_order_relaxed);
     for(uintmax_t i = 0; i < THRESHOLD; i++) {
       uintmax_t random_leaf = rand_leaf(depth, seed);
       list_node_t *list = atomic_load_explicit(&pqueue->tree[random_leaf].list, memory_order_seq_cst);
-      int64_t leaf_priority = get_val(list);
+      pq_key_t leaf_priority = get_val(list);
       if(leaf_priority >= priority) return linear_search(pqueue, random_leaf, ROOT, priority);
     }
     if(depth == atomic_load_explicit(&pqueue->depth, memory_order_relaxed)) {
@@ -145,7 +162,7 @@ static void moundify(c_mound_pq_t *pqueue, size_t i) {
     mound_node_t *right_mound = lock(pqueue, right_index);
     list_node_t *left = atomic_load_explicit(&left_mound->list, memory_order_seq_cst);
     list_node_t *right = atomic_load_explicit(&right_mound->list, memory_order_seq_cst);    
-    int64_t left_val = get_val(left), right_val = get_val(right), current_val = get_val(current);
+    pq_key_t left_val = get_val(left), right_val = get_val(right), current_val = get_val(current);
     if(left_val <= right_val && left_val < current_val) {
       unlock(pqueue, right_index);
       atomic_store_explicit(&pqueue->tree[i].list, left, memory_order_seq_cst);
@@ -169,21 +186,21 @@ static void moundify(c_mound_pq_t *pqueue, size_t i) {
   }
 }
 
-/** Add an item to the mound priority queue.
+/** Link node into the mound at a point where it keeps the order.
  */
-int c_mound_pq_add(uint64_t *seed, c_mound_pq_t * pqueue, int64_t priority) {
-  // printf("Add\n");
+static void insert_node(uint64_t *seed, c_mound_pq_t * pqueue, list_node_t *new_node) {
+  pq_key_t priority = new_node->priority;
   while(true) {
     uintmax_t insertion_point = find_insert_point(seed, pqueue, priority);
     if(insertion_point == ROOT) {
       mound_node_t *root = lock(pqueue, ROOT);
       list_node_t *list = atomic_load_explicit(&root->list, memory_order_seq_cst);
       if(get_val(list) >= priority) {
-        list_node_t *new_node = list_node_create(list, priority);
+        new_node->next = list;
         atomic_store_explicit(&root->list, new_node, memory_order_seq_cst);
         assert(atomic_load_explicit(&root->list, memory_order_relaxed) != NULL);
         unlock(pqueue, ROOT);
-        return true;
+        return;
       }
       unlock(pqueue, ROOT);
       continue;
@@ -194,12 +211,12 @@ int c_mound_pq_add(uint64_t *seed, c_mound_pq_t * pqueue, int64_t priority) {
     list_node_t *parent_list = atomic_load_explicit(&parent->list, memory_order_seq_cst);
     list_node_t *child_list = atomic_load_explicit(&child->list, memory_order_seq_cst);
     if(get_val(child_list) >= priority && get_val(parent_list) <= priority) {
-      list_node_t *new_node = list_node_create(child_list, priority);
+      new_node->next = child_list;
       atomic_store_explicit(&child->list, new_node, memory_order_seq_cst);
       assert(atomic_load_explicit(&child->list, memory_order_relaxed) != NULL);
       unlock(pqueue, insertion_point);
       unlock(pqueue, parent_point);
-      return true;
+      return;
     } else {
       unlock(pqueue, parent_point);
       unlock(pqueue, insertion_point);
@@ -207,34 +224,232 @@ int c_mound_pq_add(uint64_t *seed, c_mound_pq_t * pqueue, int64_t priority) {
   }
 }
 
+/** Add an item to the mound priority queue.
+ */
+int c_mound_pq_add(uint64_t *seed, c_mound_pq_t * pqueue, pq_key_t priority) {
+  return c_mound_pq_add_item(seed, pqueue, priority, 0);
+}
 
-/** Remove the minimum element in the mound priority queue.
+/** Add a priority with its value to the mound priority queue.
  */
-int c_mound_pq_leaky_pop_min(c_mound_pq_t * pqueue) {
-  // printf("Pop min\n");
-  mound_node_t *root = lock(pqueue, ROOT);
-  list_node_t *list = atomic_load_explicit(&pqueue->tree[ROOT].list, memory_order_seq_cst);
-  if(list == NULL) {
-    unlock(pqueue, ROOT);
-    return false;
+int c_mound_pq_add_item(uint64_t *seed, c_mound_pq_t * pqueue, pq_key_t priority, int64_t value) {
+  insert_node(seed, pqueue, list_node_create(NULL, priority, value));
+  sharded_counter_add_local(pqueue->size, 1);
+  parking_lot_wake(pqueue->waiters);
+  return true;
+}
+
+/** Add a priority with its value to the mound priority queue and return a
+ *  handle for decrease_key and remove.  The handle stays safe to pass in
+ *  after the item has left the queue.
+ */
+c_mound_pq_handle_t *c_mound_pq_add_handle(uint64_t *seed, c_mound_pq_t * pqueue, pq_key_t priority, int64_t value) {
+  c_mound_pq_handle_t *handle = forkscan_malloc(sizeof(c_mound_pq_handle_t));
+  list_node_t *node = list_node_create(NULL, priority, value);
+  node->handle = handle;
+  atomic_store_explicit(&handle->node, node, memory_order_relaxed);
+  insert_node(seed, pqueue, node);
+  sharded_counter_add_local(pqueue->size, 1);
+  parking_lot_wake(pqueue->waiters);
+  return handle;
+}
+
+/** Lower the priority of handle's item.  Lists are sorted and move between
+ *  mound nodes as a whole, so the item is re-linked under a new list node
+ *  and the old one is left stale.  A priority that is not lower leaves the
+ *  item alone.  Return false iff the item has already left the queue.
+ */
+int c_mound_pq_decrease_key(uint64_t *seed, c_mound_pq_t * pqueue, c_mound_pq_handle_t *handle, pq_key_t priority) {
+  list_node_t *new_node = NULL;
+  list_node_t *node = atomic_load_explicit(&handle->node, memory_order_acquire);
+  while(true) {
+    if(node == NULL) {
+      if(new_node != NULL) { node_pool_free(new_node, sizeof(list_node_t)); }
+      return false;
+    }
+    if(priority >= node->priority) {
+      if(new_node != NULL) { node_pool_free(new_node, sizeof(list_node_t)); }
+      return true;
+    }
+    if(new_node == NULL) {
+      new_node = list_node_create(NULL, priority, node->value);
+      new_node->handle = handle;
+    }
+    new_node->value = node->value;
+    if(atomic_compare_exchange_weak_explicit(&handle->node, &node, new_node,
+        memory_order_acq_rel, memory_order_acquire)) {
+      break;
+    }
   }
-  atomic_store_explicit(&root->list, list->next, memory_order_seq_cst);
-  // Leak list node. forkscan_retire(list);
-  moundify(pqueue, ROOT);
+  insert_node(seed, pqueue, new_node);
   return true;
 }
 
+/** Remove handle's item from the mound priority queue and retire the
+ *  handle.  Its list node is left stale and dropped when it reaches the
+ *  root.  Return false iff the item has already left the queue.
+ */
+int c_mound_pq_remove(c_mound_pq_t * pqueue, c_mound_pq_handle_t *handle) {
+  list_node_t *node = atomic_load_explicit(&handle->node, memory_order_acquire);
+  while(node != NULL) {
+    if(atomic_compare_exchange_weak_explicit(&handle->node, &node, NULL,
+        memory_order_acq_rel, memory_order_acquire)) {
+      sharded_counter_add_local(pqueue->size, -1);
+      // Stale list nodes still point at it; Forkscan holds off the free
+      // until they are gone.
+      forkscan_retire(handle);
+      return true;
+    }
+  }
+  return false;
+}
+
+/** Claim node for a pop.  Return false if its handle has moved off it, so
+ *  that it is stale.
+ */
+static bool claim(list_node_t *node) {
+  if(node->handle == NULL) {
+    return true;
+  }
+  list_node_t *expected = node;
+  return atomic_compare_exchange_strong_explicit(&node->handle->node, &expected, NULL,
+    memory_order_acq_rel, memory_order_relaxed);
+}
+
+/** Remove the minimum element and store its priority and value, dropping
+ *  stale list nodes on the way.  Retire removed list nodes iff retire.
+ *  Return true iff there was an element to pop.
+ */
+static int pop_min(c_mound_pq_t * pqueue, pq_key_t *priority, int64_t *value, bool retire) {
+  while(true) {
+    mound_node_t *root = lock(pqueue, ROOT);
+    list_node_t *list = atomic_load_explicit(&root->list, memory_order_seq_cst);
+    if(list == NULL) {
+      unlock(pqueue, ROOT);
+      return false;
+    }
+    atomic_store_explicit(&root->list, list->next, memory_order_seq_cst);
+    c_mound_pq_handle_t *handle = list->handle;
+    bool claimed = claim(list);
+    if(claimed) {
+      *priority = list->priority;
+      *value = list->value;
+      sharded_counter_add_local(pqueue->size, -1);
+    }
+    if(retire) { node_pool_retire(list, sizeof(list_node_t)); }
+    moundify(pqueue, ROOT);
+    if(claimed) {
+      if(retire && handle != NULL) { forkscan_retire(handle); }
+      return true;
+    }
+  }
+}
+
+/** Remove the minimum element in the mound priority queue.
+ */
+int c_mound_pq_leaky_pop_min(c_mound_pq_t * pqueue) {
+  pq_key_t priority;
+  int64_t value;
+  return c_mound_pq_leaky_pop_min_item(pqueue, &priority, &value);
+}
+
+/** Remove the minimum element in the mound priority queue and store its
+ *  priority and value.  Return true iff there was an element to pop.
+ */
+int c_mound_pq_leaky_pop_min_item(c_mound_pq_t * pqueue, pq_key_t *priority, int64_t *value) {
+  return pop_min(pqueue, priority, value, false);
+}
+
 /** Remove the minimum element in the mound priority queue.
  */
 int c_mound_pq_pop_min(c_mound_pq_t * pqueue) {
-  mound_node_t *root = lock(pqueue, ROOT);
-  list_node_t *list = atomic_load_explicit(&root->list, memory_order_seq_cst);
-  if(list == NULL) {
-    unlock(pqueue, ROOT);
-    return false;
+  pq_key_t priority;
+  int64_t value;
+  return c_mound_pq_pop_min_item(pqueue, &priority, &value);
+}
+
+/** Remove the minimum element in the mound priority queue and store its
+ *  priority and value.  Return true iff there was an element to pop.
+ */
+int c_mound_pq_pop_min_item(c_mound_pq_t * pqueue, pq_key_t *priority, int64_t *value) {
+  return pop_min(pqueue, priority, value, true);
+}
+
+static int try_pop_min(void *pqueue, void *key, int64_t *value) {
+  return c_mound_pq_pop_min_item(pqueue, key, value);
+}
+
+/** Pop the smallest item, waiting up to timeout_ns nanoseconds for one to
+ *  arrive if the queue is empty; a negative timeout waits forever.  Return
+ *  false on timeout.
+ */
+int c_mound_pq_pop_min_wait(c_mound_pq_t *pqueue, pq_key_t *key, int64_t *value, int64_t timeout_ns) {
+  return parking_lot_wait(pqueue->waiters, try_pop_min, pqueue, key, value, timeout_ns);
+}
+
+/** Store the priority and value at the root without removing them.  Return
+ *  true iff the queue was not empty.  The root is read under its lock, where
+ *  it is no larger than anything linked below it, so this is the minimum of
+ *  every finished insert.  A stale list node at the root stands for no item;
+ *  it is dropped as pop_min would, so the next one down can surface.
+ */
+int c_mound_pq_peek_min(c_mound_pq_t * pqueue, pq_key_t *priority, int64_t *value) {
+  while(true) {
+    mound_node_t *root = lock(pqueue, ROOT);
+    list_node_t *list = atomic_load_explicit(&root->list, memory_order_seq_cst);
+    if(list == NULL) {
+      unlock(pqueue, ROOT);
+      return false;
+    }
+    if(list->handle == NULL
+      || atomic_load_explicit(&list->handle->node, memory_order_acquire) == list) {
+      *priority = list->priority;
+      *value = list->value;
+      unlock(pqueue, ROOT);
+      return true;
+    }
+    atomic_store_explicit(&root->list, list->next, memory_order_seq_cst);
+    node_pool_retire(list, sizeof(list_node_t));
+    moundify(pqueue, ROOT);
   }
-  atomic_store_explicit(&root->list, list->next, memory_order_seq_cst);
-  forkscan_retire(list);
-  moundify(pqueue, ROOT);
-  return true;
+}
+
+/** Return the approximate number of items, summed from per-thread shards
+ *  without stopping writers.  Exact only at quiescence.
+ */
+size_t c_mound_pq_size(c_mound_pq_t * pqueue) {
+  return sharded_counter_read_size(pqueue->size);
+}
+
+/** Free the mound, every list node still in it and the handles of the
+ *  items still in it.  A handle whose item has left was retired then, so
+ *  only the handle's current node frees it; stale nodes drop their handle
+ *  pointer first, since a handle may be freed before its stale nodes are
+ *  reached.  No other thread may be using the mound, and its outstanding
+ *  handles are invalid afterwards.
+ */
+void c_mound_pq_destroy(c_mound_pq_t * pqueue) {
+  size_t size = pqueue->max_depth;
+  for(size_t i = 0; i < size; i++) {
+    list_node_t *list = atomic_load_explicit(&pqueue->tree[i].list, memory_order_relaxed);
+    for(; list != NULL; list = list->next) {
+      if(list->handle != NULL && atomic_load_explicit(&list->handle->node, memory_order_relaxed) != list) {
+        list->handle = NULL;
+      }
+    }
+  }
+  for(size_t i = 0; i < size; i++) {
+    list_node_t *list = atomic_load_explicit(&pqueue->tree[i].list, memory_order_relaxed);
+    while(list != NULL) {
+      list_node_t *next = list->next;
+      if(list->handle != NULL) { forkscan_free(list->handle); }
+      node_pool_free(list, sizeof(list_node_t));
+      list = next;
+    }
+  }
+  parking_lot_destroy(pqueue->waiters);
+  sharded_counter_destroy(pqueue->size);
+  forkscan_free(pqueue->tree);
+  forkscan_free((void*)pqueue->locks);
+  forkscan_free(pqueue);
 }
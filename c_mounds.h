@@ -7,12 +7,23 @@
 #include <stdint.h>
 #include <stddef.h>
 
-#define N 20
+#include "pq_key.h"
 
 typedef struct c_mound_pq_t c_mound_pq_t;
+typedef struct c_mound_pq_handle_t c_mound_pq_handle_t;
 
 c_mound_pq_t *c_mound_pq_create(size_t size);
 
-int c_mound_pq_add(uint64_t *seed, c_mound_pq_t *pqueue, int64_t priority);
+int c_mound_pq_add(uint64_t *seed, c_mound_pq_t *pqueue, pq_key_t priority);
+int c_mound_pq_add_item(uint64_t *seed, c_mound_pq_t *pqueue, pq_key_t priority, int64_t value);
+c_mound_pq_handle_t *c_mound_pq_add_handle(uint64_t *seed, c_mound_pq_t *pqueue, pq_key_t priority, int64_t value);
+int c_mound_pq_decrease_key(uint64_t *seed, c_mound_pq_t *pqueue, c_mound_pq_handle_t *handle, pq_key_t priority);
+int c_mound_pq_remove(c_mound_pq_t *pqueue, c_mound_pq_handle_t *handle);
 int c_mound_pq_leaky_pop_min(c_mound_pq_t *pqueue);
-int c_mound_pq_pop_min(c_mound_pq_t * pqueue);
\ No newline at end of file
+int c_mound_pq_pop_min(c_mound_pq_t * pqueue);
+int c_mound_pq_leaky_pop_min_item(c_mound_pq_t *pqueue, pq_key_t *priority, int64_t *value);
+int c_mound_pq_pop_min_item(c_mound_pq_t *pqueue, pq_key_t *priority, int64_t *value);
+int c_mound_pq_pop_min_wait(c_mound_pq_t *pqueue, pq_key_t *key, int64_t *value, int64_t timeout_ns);
+int c_mound_pq_peek_min(c_mound_pq_t *pqueue, pq_key_t *priority, int64_t *value);
+size_t c_mound_pq_size(c_mound_pq_t *pqueue);
+void c_mound_pq_destroy(c_mound_pq_t *pqueue);
\ No newline at end of file
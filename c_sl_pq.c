@@ -5,6 +5,9 @@
  */
 
 #include "c_sl_pq.h"
+#include "parking_lot.h"
+#include "sharded_counter.h"
+#include "node_pool.h"
 #include "utils.h"
 
 #include <stdbool.h>
@@ -13,7 +16,7 @@
 #include <stdio.h>
 #include <assert.h>
 
-#define N 20
+#define N SKIPLIST_HEIGHT
 #define BOTTOM 0
 
 typedef struct node_t node_t; 
@@ -21,14 +24,26 @@ typedef node_t *node_ptr;
 typedef struct node_unpacked_t node_unpacked_t;
 
 struct node_t {
-  int64_t key;
+  pq_key_t key;
+  int64_t value;
+  uint64_t seq;
   int32_t toplevel;
   atomic_bool deleted;
-  _Atomic(node_ptr) next[N];
+  // Sized to toplevel + 1 by node_create.
+  _Atomic(node_ptr) next[];
 };
 
 struct c_sl_pq_t {
-  node_t head, tail;
+  // Sequence numbers for add_dup, off the lines that finds read.
+  _Atomic(uint64_t) seq;
+  char padding[128];
+  // Adds and claims begun and ended, which snapshot scans validate against.
+  sharded_counter_t *begun, *ended;
+  // Highest level any node has been linked at; searches start there.
+  _Atomic(int32_t) toplevel;
+  sharded_counter_t *size;
+  parking_lot_t *waiters;
+  node_ptr head, tail;
 };
 
 struct node_unpacked_t {
@@ -36,14 +51,38 @@ struct node_unpacked_t {
   node_ptr address;
 };
 
-static node_ptr node_create(int64_t key, int32_t toplevel){
-  node_ptr node = forkscan_malloc(sizeof(node_t));
+/** Return the bytes a node with a tower toplevel + 1 high takes.
+ */
+static size_t node_size(int32_t toplevel) {
+  return sizeof(node_t) + (toplevel + 1) * sizeof(node_ptr);
+}
+
+/** Allocate a node with a tower of toplevel + 1 links.
+ */
+static node_ptr node_create(pq_key_t key, int64_t value, uint64_t seq, int32_t toplevel){
+  node_ptr node = node_pool_alloc(node_size(toplevel));
   node->key = key;
+  node->value = value;
+  node->seq = seq;
   node->toplevel = toplevel;
   atomic_store_explicit(&node->deleted, false, memory_order_relaxed);
   return node;
 }
 
+/** Hand a node no other thread can reach back to the node pool.
+ */
+static void node_free(node_ptr node) {
+  if(node != NULL) {
+    node_pool_free(node, node_size(node->toplevel));
+  }
+}
+
+/** Retire a node other threads may still reach.
+ */
+static void node_retire(node_ptr node) {
+  node_pool_retire(node, node_size(node->toplevel));
+}
+
 static node_ptr node_unmark(node_ptr node){
   return (node_ptr)(((size_t)node) & (~0x1));
 }
@@ -56,6 +95,24 @@ static bool node_is_marked(node_ptr node){
   return node_unmark(node) != node;
 }
 
+/** Return the highest level any node has been linked at.  The levels above
+ *  it are empty, so a search starts here rather than at the top of the
+ *  head's tower, which in a small queue skips most of it.
+ */
+static int32_t top_level(c_sl_pq_t *pqueue) {
+  return atomic_load_explicit(&pqueue->toplevel, memory_order_relaxed);
+}
+
+/** Raise the top level to cover a node of height toplevel + 1.  This is
+ *  done before the node is linked, so that by the time a search can reach
+ *  the node it starts at or above the node's top.
+ */
+static void raise_top_level(c_sl_pq_t *pqueue, int32_t toplevel) {
+  int32_t top = atomic_load_explicit(&pqueue->toplevel, memory_order_relaxed);
+  while(top < toplevel && !atomic_compare_exchange_weak_explicit(&pqueue->toplevel,
+    &top, toplevel, memory_order_seq_cst, memory_order_relaxed)) {}
+}
+
 static node_unpacked_t node_unpack(node_ptr node){
   return (node_unpacked_t){
     .marked = node_is_marked(node),
@@ -64,11 +121,11 @@ static node_unpacked_t node_unpack(node_ptr node){
 }
 
 void c_sl_pq_print (c_sl_pq_t *pqueue){
-  node_ptr node = atomic_load_explicit(&pqueue->head.next[0], memory_order_relaxed);
-  while(node_unmark(node) != &pqueue->tail) {
+  node_ptr node = atomic_load_explicit(&pqueue->head->next[0], memory_order_relaxed);
+  while(node_unmark(node) != pqueue->tail) {
     node_ptr next = atomic_load_explicit(&node->next[0], memory_order_consume);
     if(!node_is_marked(next)) {
-      printf("node[%d]: %ld\n", node->toplevel, node->key);
+      printf("node[%d]: %ld\n", node->toplevel, (long)node->key);
     }
     node = next;
   }
@@ -78,11 +135,17 @@ void c_sl_pq_print (c_sl_pq_t *pqueue){
  */
 c_sl_pq_t* c_sl_pq_create() {
   c_sl_pq_t* sl_pqueue = forkscan_malloc(sizeof(c_sl_pq_t));
-  sl_pqueue->head.key = INT64_MIN;
-  sl_pqueue->tail.key = INT64_MAX;
+  sl_pqueue->head = node_create(PQ_KEY_MIN, 0, 0, N - 1);
+  sl_pqueue->tail = node_create(PQ_KEY_MAX, 0, UINT64_MAX, N - 1);
+  atomic_store_explicit(&sl_pqueue->seq, 0, memory_order_relaxed);
+  sl_pqueue->size = sharded_counter_create(SHARDED_COUNTER_LOCAL_SHARDS);
+  sl_pqueue->begun = sharded_counter_create(SHARDED_COUNTER_LOCAL_SHARDS);
+  sl_pqueue->ended = sharded_counter_create(SHARDED_COUNTER_LOCAL_SHARDS);
+  sl_pqueue->waiters = parking_lot_create();
+  atomic_store_explicit(&sl_pqueue->toplevel, 0, memory_order_relaxed);
   for(int64_t i = 0; i < N; i++) {
-    atomic_store_explicit(&sl_pqueue->head.next[i], &sl_pqueue->tail, memory_order_relaxed);
-    atomic_store_explicit(&sl_pqueue->tail.next[i], NULL, memory_order_relaxed);
+    atomic_store_explicit(&sl_pqueue->head->next[i], sl_pqueue->tail, memory_order_relaxed);
+    atomic_store_explicit(&sl_pqueue->tail->next[i], NULL, memory_order_relaxed);
   }
   return sl_pqueue;
 }
@@ -104,17 +167,87 @@ static void mark_pointers(node_ptr node) {
   }
 }
 
-static bool find(c_sl_pq_t *pqueue, int64_t key, 
-  node_ptr preds[N], node_ptr succs[N]) {
+/** Count an update as begun, before the CAS or exchange that makes it take
+ *  effect.  The count goes to the calling thread's shard, so updates do
+ *  not contend on it, and the fence orders it before the update.
+ */
+static void begin_update(c_sl_pq_t *pqueue) {
+  sharded_counter_add_local(pqueue->begun, 1);
+  atomic_thread_fence(memory_order_release);
+}
+
+/** Count an update as ended, after the CAS or exchange has taken effect.
+ */
+static void end_update(c_sl_pq_t *pqueue) {
+  atomic_thread_fence(memory_order_release);
+  sharded_counter_add_local(pqueue->ended, 1);
+}
+
+/** The CAS that links a new node, counted for snapshot scans.
+ */
+static bool update_cas(c_sl_pq_t *pqueue, _Atomic(node_ptr) *link, node_ptr *expected, node_ptr desired) {
+  begin_update(pqueue);
+  bool done = atomic_compare_exchange_weak_explicit(link, expected, desired,
+    memory_order_seq_cst, memory_order_relaxed);
+  end_update(pqueue);
+  return done;
+}
+
+/** Set a node's deleted flag and return whether it was already set, counted
+ *  for snapshot scans.  Whoever clears the flag owns the node.
+ */
+static bool claim(c_sl_pq_t *pqueue, node_ptr node) {
+  begin_update(pqueue);
+  bool deleted = atomic_exchange_explicit(&node->deleted, true, memory_order_seq_cst);
+  end_update(pqueue);
+  return deleted;
+}
+
+/** Wait until no add or claim is under way and return the number begun.
+ *  As in c_fhsl_lf, the ended counts are read before the begun ones, so
+ *  equal sums mean every update begun had ended at some instant between
+ *  the reads, and the scan that follows sees all of them.
+ */
+static int64_t wait_for_updates(c_sl_pq_t *pqueue) {
+  while(true) {
+    int64_t ended = sharded_counter_read(pqueue->ended);
+    atomic_thread_fence(memory_order_acquire);
+    int64_t begun = sharded_counter_read(pqueue->begun);
+    atomic_thread_fence(memory_order_acquire);
+    if(begun == ended) { return begun; }
+  }
+}
+
+/** Order nodes by key, then by sequence number.  Plain adds use sequence
+ *  0, which sorts ahead of every duplicate of the same key.
+ */
+static bool node_less(node_ptr node, pq_key_t key, uint64_t seq) {
+  return node->key < key || (node->key == key && node->seq < seq);
+}
+
+/** Fill preds and succs for (key, seq) and return whether a node with key
+ *  is at succs[BOTTOM].  If hinted, preds already holds the predecessors of
+ *  a smaller key and each level resumes from there rather than from the
+ *  head.
+ */
+static bool find_from(c_sl_pq_t *pqueue, pq_key_t key, uint64_t seq,
+  node_ptr preds[N], node_ptr succs[N], bool hinted) {
   bool marked, snip;
   // node_ptr pred = NULL, curr = NULL, succ = NULL;
 retry:
   while(true) {
-    node_ptr left = &pqueue->head, right = NULL;
-    for(int64_t level = N - 1; level >= BOTTOM; --level) {
+    node_ptr left = pqueue->head, right = NULL;
+    int32_t top = top_level(pqueue);
+    // Nothing is linked above the top level.
+    for(int64_t level = N - 1; level > top; --level) {
+      preds[level] = pqueue->head;
+      succs[level] = pqueue->tail;
+    }
+    for(int64_t level = top; level >= BOTTOM; --level) {
+      if(hinted && preds[level]->key > left->key) { left = preds[level]; }
       node_ptr left_next = atomic_load_explicit(&left->next[level], memory_order_consume);
-      // Is our current node invalid?
-      if(node_is_marked(left_next)) { goto retry; }
+      // Is our current node invalid?  A stale hint is, so drop the hints.
+      if(node_is_marked(left_next)) { hinted = false; goto retry; }
       node_ptr right = left_next;
       // Find two nodes to put into preds and succs.
       while(true) {
@@ -125,7 +258,7 @@ retry:
           right_next = atomic_load_explicit(&right->next[level], memory_order_consume);
         }
         // Has the right not gone far enough?        
-        if(right->key < key) {
+        if(node_less(right, key, seq)) {
           left = right;
           left_next = right_next;
           right = right_next;
@@ -147,27 +280,42 @@ retry:
   }
 }
 
+static bool find(c_sl_pq_t *pqueue, pq_key_t key, 
+  node_ptr preds[N], node_ptr succs[N]) {
+  return find_from(pqueue, key, 0, preds, succs, false);
+}
+
 /** Add a node, lock-free, to the Shavit Lotan priority queue.
  */
-int c_sl_pq_add(uint64_t *seed, c_sl_pq_t * pqueue, int64_t key) {
-  node_ptr preds[N], succs[N];
-  int32_t toplevel = random_level(seed, N);
-  node_ptr node = NULL;
+int c_sl_pq_add(uint64_t *seed, c_sl_pq_t * pqueue, pq_key_t key) {
+  return c_sl_pq_add_item(seed, pqueue, key, 0);
+}
+
+/** Insert (key, seq).  Sequence 0 is a plain add and fails if key is
+ *  already present; any other sequence always goes in, after every older
+ *  duplicate of key.  If node is not NULL it is linked in, at its own
+ *  height and with its own value, in place of a new node, and freed if
+ *  the add fails.
+ */
+static int add_from(uint64_t *seed, c_sl_pq_t * pqueue, pq_key_t key, int64_t value,
+  uint64_t seq, node_ptr node, node_ptr preds[N], node_ptr succs[N], bool hinted) {
+  int32_t toplevel = node != NULL ? node->toplevel : random_level(seed, N);
+  raise_top_level(pqueue, toplevel);
   while(true) {
-    if(find(pqueue, key, preds, succs)) {
+    if(find_from(pqueue, key, seq, preds, succs, hinted) && seq == 0) {
       if(succs[BOTTOM]->deleted) {
         mark_pointers(succs[BOTTOM]);
         continue;
       }
-      forkscan_free((void*)node);
+      node_free(node);
       return false;
     }
-    if(node == NULL) { node = node_create(key, toplevel); }
+    if(node == NULL) { node = node_create(key, value, seq, toplevel); }
     for(int64_t i = 0; i <= toplevel; ++i) {
       atomic_store_explicit(&node->next[i], succs[i], memory_order_release);
     }
     node_ptr pred = preds[0], succ = succs[0];
-    if(!atomic_compare_exchange_weak_explicit(&pred->next[0], &succ, node, memory_order_release, memory_order_relaxed)) {
+    if(!update_cas(pqueue, &pred->next[0], &succ, node)) {
       continue;
     }
     for(int64_t i = 1; i <= toplevel; i++) {
@@ -177,99 +325,118 @@ int c_sl_pq_add(uint64_t *seed, c_sl_pq_t * pqueue, int64_t key) {
           &succ, node, memory_order_release, memory_order_relaxed)) {
           break;
         }
-        bool _ = find(pqueue, key, preds, succs);
+        bool _ = find_from(pqueue, key, seq, preds, succs, false);
       }
     }
+    sharded_counter_add_local(pqueue->size, 1);
+    parking_lot_wake(pqueue->waiters);
     return true;
   }
 }
 
-/** Remove a node, lock-free, from the skiplist.
+/** Add a key with its value, lock-free, to the Shavit Lotan priority queue.
  */
-int c_sl_pq_remove_leaky(c_sl_pq_t * pqueue, int64_t key) {
+int c_sl_pq_add_item(uint64_t *seed, c_sl_pq_t * pqueue, pq_key_t key, int64_t value) {
   node_ptr preds[N], succs[N];
-  node_ptr succ = NULL;
-  while(true) {
-    if(!find(pqueue, key, preds, succs)) {
-      return false;
-    }
-    node_ptr node_to_remove = succs[0];
-    bool marked;
-    for(int64_t level = node_to_remove->toplevel; level >= 1; --level) {
-      succ = atomic_load_explicit(&node_to_remove->next[level], memory_order_relaxed);
-      marked = node_is_marked(succ);
-      while(!marked) {
-        bool _ = atomic_compare_exchange_weak_explicit(&node_to_remove->next[level],
-          &succ, node_mark(succ), memory_order_relaxed, memory_order_relaxed);
-        marked = node_is_marked(succ);
-      }
-    }
-    succ = atomic_load_explicit(&node_to_remove->next[0], memory_order_relaxed);
-    marked = node_is_marked(succ);
-    while(true) {
-      bool i_marked_it = atomic_compare_exchange_weak_explicit(&node_to_remove->next[0],
-        &succ, node_mark(succ), memory_order_relaxed, memory_order_relaxed);
-      marked = node_is_marked(succ);
-      if(i_marked_it) {
-        bool _ = find(pqueue, key, preds, succs);
-        return true;
-      } else if(marked) {
-        return false;
-      }
-    }
+  return add_from(seed, pqueue, key, value, 0, NULL, preds, succs, false);
+}
+
+/** Add a key, lock-free, to the Shavit Lotan priority queue even if it is
+ *  already present.  Equal keys pop in the order they were added.
+ */
+int c_sl_pq_add_dup(uint64_t *seed, c_sl_pq_t * pqueue, pq_key_t key) {
+  return c_sl_pq_add_dup_item(seed, pqueue, key, 0);
+}
+
+/** Add a key with its value, lock-free, to the Shavit Lotan priority queue
+ *  even if the key is already present.  Equal keys pop in the order they
+ *  were added.
+ */
+int c_sl_pq_add_dup_item(uint64_t *seed, c_sl_pq_t * pqueue, pq_key_t key, int64_t value) {
+  node_ptr preds[N], succs[N];
+  uint64_t seq = atomic_fetch_add_explicit(&pqueue->seq, 1, memory_order_relaxed) + 1;
+  return add_from(seed, pqueue, key, value, seq, NULL, preds, succs, false);
+}
+
+/** Add n keys to the Shavit Lotan priority queue.  The keys are sorted in
+ *  place and spliced in left to right, each search resuming from the
+ *  predecessors of the key before it.  Return the number of keys added.
+ */
+int c_sl_pq_add_batch(uint64_t *seed, c_sl_pq_t * pqueue, pq_key_t *keys, size_t n) {
+  node_ptr preds[N], succs[N];
+  int added = 0;
+  pq_key_sort(keys, n);
+  for(size_t i = 0; i < n; i++) {
+    if(i > 0 && keys[i] == keys[i - 1]) { continue; }
+    added += add_from(seed, pqueue, keys[i], 0, 0, NULL, preds, succs, i > 0);
   }
+  return added;
 }
 
-/** Remove a node, lock-free, from the skiplist.
+/** Remove a node, lock-free, from the skiplist.  The node is claimed
+ *  through its deleted flag, as in pop_min, so a remove and a concurrent
+ *  pop_min never both succeed on the same key.
  */
-int c_sl_pq_remove(c_sl_pq_t * pqueue, int64_t key) {
+int c_sl_pq_remove_leaky(c_sl_pq_t * pqueue, pq_key_t key) {
   node_ptr preds[N], succs[N];
-  node_ptr succ = NULL;
-  while(true) {
-    if(!find(pqueue, key, preds, succs)) {
-      return false;
-    }
-    node_ptr node_to_remove = succs[0];
-    bool marked;
-    for(int64_t level = node_to_remove->toplevel; level >= 1; --level) {
-      succ = atomic_load_explicit(&node_to_remove->next[level], memory_order_relaxed);
-      marked = node_is_marked(succ);
-      while(!marked) {
-        bool _ = atomic_compare_exchange_weak_explicit(&node_to_remove->next[level],
-          &succ, node_mark(succ), memory_order_relaxed, memory_order_relaxed);
-        marked = node_is_marked(succ);
-      }
-    }
-    succ = atomic_load_explicit(&node_to_remove->next[0], memory_order_relaxed);
-    marked = node_is_marked(succ);
-    while(true) {
-      bool i_marked_it = atomic_compare_exchange_weak_explicit(&node_to_remove->next[0],
-        &succ, node_mark(succ), memory_order_relaxed, memory_order_relaxed);
-      marked = node_is_marked(succ);
-      if(i_marked_it) {
-        bool _ = find(pqueue, key, preds, succs);
-        forkscan_retire(node_to_remove);
-        return true;
-      } else if(marked) {
-        return false;
-      }
-    }
+  if(!find(pqueue, key, preds, succs)) {
+    return false;
+  }
+  node_ptr node_to_remove = succs[BOTTOM];
+  if(claim(pqueue, node_to_remove)) {
+    return false;
+  }
+  mark_pointers(node_to_remove);
+  bool _ = find_from(pqueue, key, node_to_remove->seq, preds, succs, false);
+  sharded_counter_add_local(pqueue->size, -1);
+  return true;
+}
+
+/** Remove a node, lock-free, from the skiplist.  The node is claimed
+ *  through its deleted flag, as in pop_min, so a remove and a concurrent
+ *  pop_min never both succeed on the same key.
+ */
+int c_sl_pq_remove(c_sl_pq_t * pqueue, pq_key_t key) {
+  node_ptr preds[N], succs[N];
+  if(!find(pqueue, key, preds, succs)) {
+    return false;
+  }
+  node_ptr node_to_remove = succs[BOTTOM];
+  if(claim(pqueue, node_to_remove)) {
+    return false;
   }
+  mark_pointers(node_to_remove);
+  bool _ = find_from(pqueue, key, node_to_remove->seq, preds, succs, false);
+  node_retire(node_to_remove);
+  sharded_counter_add_local(pqueue->size, -1);
+  return true;
 }
 
 /** Remove the minimum element in the Shavit Lotan priority queue.
  */
 int c_sl_pq_leaky_pop_min(c_sl_pq_t * pqueue) {
-  node_ptr left_next = node_unmark(atomic_load_explicit(&pqueue->head.next[BOTTOM], memory_order_consume));
-  if(left_next == &pqueue->tail) { return false; }
+  pq_key_t key;
+  int64_t value;
+  return c_sl_pq_leaky_pop_min_item(pqueue, &key, &value);
+}
+
+/** Remove the minimum element in the Shavit Lotan priority queue and
+ *  store its key and value.  Return true iff there was an element to pop.
+ */
+int c_sl_pq_leaky_pop_min_item(c_sl_pq_t * pqueue, pq_key_t *key, int64_t *value) {
+  node_ptr left_next = node_unmark(atomic_load_explicit(&pqueue->head->next[BOTTOM], memory_order_consume));
+  if(left_next == pqueue->tail) { return false; }
   node_ptr curr = left_next;
-  for(; curr != &pqueue->tail; curr = node_unmark(atomic_load_explicit(&curr->next[BOTTOM], memory_order_consume))) {
+  for(; curr != pqueue->tail; curr = node_unmark(atomic_load_explicit(&curr->next[BOTTOM], memory_order_consume))) {
     if(atomic_load_explicit(&curr->deleted, memory_order_relaxed)) {
       mark_pointers(curr);
       continue;
     }
-    if(!atomic_exchange_explicit(&curr->deleted, true, memory_order_relaxed)){
+    if(!claim(pqueue, curr)){
+      *key = curr->key;
+      *value = curr->value;
       mark_pointers(curr);
+      sharded_counter_add_local(pqueue->size, -1);
       return true;
     }
   }
@@ -279,20 +446,330 @@ int c_sl_pq_leaky_pop_min(c_sl_pq_t * pqueue) {
 /** Remove the minimum element in the Shavit Lotan priority queue.
  */
 int c_sl_pq_pop_min(c_sl_pq_t * pqueue) {
+  pq_key_t key;
+  int64_t value;
+  return c_sl_pq_pop_min_item(pqueue, &key, &value);
+}
+
+/** Remove the minimum element in the Shavit Lotan priority queue and
+ *  store its key and value.  Return true iff there was an element to pop.
+ */
+int c_sl_pq_pop_min_item(c_sl_pq_t * pqueue, pq_key_t *key, int64_t *value) {
+  node_ptr curr = node_unmark(atomic_load_explicit(&pqueue->head->next[0], memory_order_consume));
+  for(; curr != pqueue->tail; curr = node_unmark(atomic_load_explicit(&curr->next[0], memory_order_consume))) {
+    if(atomic_load_explicit(&curr->deleted, memory_order_relaxed)) {
+      continue;
+    }
+    if(!claim(pqueue, curr)){
+      *key = curr->key;
+      *value = curr->value;
+      mark_pointers(curr);
+      node_retire(curr);
+      sharded_counter_add_local(pqueue->size, -1);
+      return true;
+    }
+  }
+  // Every node on the way was claimed, if not yet unlinked: empty.  Going
+  // around again would spin until an add, which keeps pop_min_wait from
+  // ever parking.
+  return false;
+}
+
+/** Return the last node on the bottom level, or the head if there is none.
+ *  Each level is walked to its end before dropping to the next, so the
+ *  search costs what a find for the largest key would.  The node returned
+ *  may already be claimed.
+ */
+static node_ptr find_last(c_sl_pq_t *pqueue) {
+  node_ptr node = pqueue->head;
+  for(int64_t level = top_level(pqueue); level >= BOTTOM; --level) {
+    node_ptr next = node_unmark(atomic_load_explicit(&node->next[level], memory_order_consume));
+    while(next != pqueue->tail) {
+      node = next;
+      next = node_unmark(atomic_load_explicit(&node->next[level], memory_order_consume));
+    }
+  }
+  return node;
+}
+
+/** Claim the last node through its deleted flag and unlink it, as remove
+ *  does.  A last node that is already claimed is unlinked first, so that
+ *  the next search finds the node before it; pop_min leaves its nodes
+ *  marked but linked, so a drained tail is cleared here one node at a
+ *  time.
+ */
+static int pop_max(c_sl_pq_t * pqueue, pq_key_t *key, int64_t *value, bool retire) {
+  node_ptr preds[N], succs[N];
   while(true) {
-    node_ptr curr = node_unmark(atomic_load_explicit(&pqueue->head.next[0], memory_order_consume));
-    if(curr == &pqueue->tail) {
-      return false;
+    node_ptr curr = find_last(pqueue);
+    if(curr == pqueue->head) { return false; }
+    if(!claim(pqueue, curr)) {
+      *key = curr->key;
+      *value = curr->value;
+      mark_pointers(curr);
+      bool _ = find_from(pqueue, curr->key, curr->seq, preds, succs, false);
+      if(retire) { node_retire(curr); }
+      sharded_counter_add_local(pqueue->size, -1);
+      return true;
     }
-    for(; curr != &pqueue->tail; curr = node_unmark(atomic_load_explicit(&curr->next[0], memory_order_consume))) {
-      if(atomic_load_explicit(&curr->deleted, memory_order_relaxed)) {
-        continue;
+    mark_pointers(curr);
+    bool _ = find_from(pqueue, curr->key, curr->seq, preds, succs, false);
+  }
+}
+
+/** Remove the maximum element in the Shavit Lotan priority queue.  Leak
+ *  the memory.
+ */
+int c_sl_pq_leaky_pop_max(c_sl_pq_t * pqueue) {
+  pq_key_t key;
+  int64_t value;
+  return pop_max(pqueue, &key, &value, false);
+}
+
+/** Remove the maximum element in the Shavit Lotan priority queue and store
+ *  its key and value.  Return true iff there was an element to pop.  Leak
+ *  the memory.
+ */
+int c_sl_pq_leaky_pop_max_item(c_sl_pq_t * pqueue, pq_key_t *key, int64_t *value) {
+  return pop_max(pqueue, key, value, false);
+}
+
+/** Remove the maximum element in the Shavit Lotan priority queue.
+ */
+int c_sl_pq_pop_max(c_sl_pq_t * pqueue) {
+  pq_key_t key;
+  int64_t value;
+  return pop_max(pqueue, &key, &value, true);
+}
+
+/** Remove the maximum element in the Shavit Lotan priority queue and store
+ *  its key and value.  Return true iff there was an element to pop.
+ */
+int c_sl_pq_pop_max_item(c_sl_pq_t * pqueue, pq_key_t *key, int64_t *value) {
+  return pop_max(pqueue, key, value, true);
+}
+
+/** Claim up to k of the smallest nodes in one sweep of deleted-flag
+ *  exchanges, then unlink them all with a single find.  The claimed items
+ *  are stored in keys and values, smallest first.  Return the number
+ *  claimed.
+ */
+static size_t pop_many(c_sl_pq_t * pqueue, size_t k, pq_key_t *keys, int64_t *values, bool retire) {
+  node_ptr preds[N], succs[N];
+  size_t count = 0;
+  uint64_t last_seq = 0;
+  node_ptr curr = node_unmark(atomic_load_explicit(&pqueue->head->next[BOTTOM], memory_order_consume));
+  for(; count < k && curr != pqueue->tail; curr = node_unmark(atomic_load_explicit(&curr->next[BOTTOM], memory_order_consume))) {
+    if(atomic_load_explicit(&curr->deleted, memory_order_relaxed)) {
+      continue;
+    }
+    if(!claim(pqueue, curr)) {
+      keys[count] = curr->key;
+      values[count] = curr->value;
+      last_seq = curr->seq;
+      count++;
+      mark_pointers(curr);
+      // Forkscan holds off the free until the node is unreachable.
+      if(retire) { node_retire(curr); }
+    }
+  }
+  if(count > 0) {
+    bool _ = find_from(pqueue, keys[count - 1], last_seq, preds, succs, false);
+    sharded_counter_add_local(pqueue->size, -(int64_t)count);
+  }
+  return count;
+}
+
+/** Pop up to k of the smallest elements into keys and values, smallest
+ *  first.  Return the number popped.  Leak the memory.
+ */
+size_t c_sl_pq_leaky_pop_many(c_sl_pq_t * pqueue, size_t k, pq_key_t *keys, int64_t *values) {
+  return pop_many(pqueue, k, keys, values, false);
+}
+
+/** Pop up to k of the smallest elements into keys and values, smallest
+ *  first.  Return the number popped.
+ */
+size_t c_sl_pq_pop_many(c_sl_pq_t * pqueue, size_t k, pq_key_t *keys, int64_t *values) {
+  return pop_many(pqueue, k, keys, values, true);
+}
+
+static int try_pop_min(void *pqueue, void *key, int64_t *value) {
+  return c_sl_pq_pop_min_item(pqueue, key, value);
+}
+
+/** Pop the smallest item, waiting up to timeout_ns nanoseconds for one to
+ *  arrive if the queue is empty; a negative timeout waits forever.  Return
+ *  false on timeout.
+ */
+int c_sl_pq_pop_min_wait(c_sl_pq_t *pqueue, pq_key_t *key, int64_t *value, int64_t timeout_ns) {
+  return parking_lot_wait(pqueue->waiters, try_pop_min, pqueue, key, value, timeout_ns);
+}
+
+/** Store the key and value of the smallest element without removing it.
+ *  Return true iff there was one.  The element was in the queue, unclaimed,
+ *  when its deleted flag was read; a concurrent pop may take it before the
+ *  caller looks, and a smaller key added behind the scan is missed, so the
+ *  result is exact only at quiescence.
+ */
+int c_sl_pq_peek_min(c_sl_pq_t * pqueue, pq_key_t *key, int64_t *value) {
+  node_ptr curr = node_unmark(atomic_load_explicit(&pqueue->head->next[BOTTOM], memory_order_consume));
+  for(; curr != pqueue->tail; curr = node_unmark(atomic_load_explicit(&curr->next[BOTTOM], memory_order_consume))) {
+    if(!atomic_load_explicit(&curr->deleted, memory_order_relaxed)) {
+      *key = curr->key;
+      *value = curr->value;
+      return true;
+    }
+  }
+  return false;
+}
+
+/** Store, smallest first, up to k items with keys in [low, high] and
+ *  return how many were stored.  The search descends to the last node
+ *  below low and then walks the bottom level, skipping nodes whose deleted
+ *  flag is set.  The result is weakly consistent: an item in the queue for
+ *  the whole call is stored, but one added or claimed while the walk runs
+ *  may or may not be.  To go on past a full buffer, call again with low
+ *  one past the last key stored; duplicates of that key added with
+ *  add_dup and not yet stored are skipped.
+ */
+size_t c_sl_pq_scan(c_sl_pq_t *pqueue, pq_key_t low, pq_key_t high, size_t k, pq_key_t *keys, int64_t *values) {
+  size_t count = 0;
+  node_ptr node = pqueue->head;
+  for(int64_t level = top_level(pqueue); level >= BOTTOM; --level) {
+    node_ptr next = node_unmark(atomic_load_explicit(&node->next[level], memory_order_consume));
+    while(next->key < low) {
+      node = next;
+      next = node_unmark(atomic_load_explicit(&node->next[level], memory_order_consume));
+    }
+  }
+  node = node_unmark(atomic_load_explicit(&node->next[BOTTOM], memory_order_consume));
+  for(; count < k && node != pqueue->tail && node->key <= high;
+      node = node_unmark(atomic_load_explicit(&node->next[BOTTOM], memory_order_consume))) {
+    if(!atomic_load_explicit(&node->deleted, memory_order_relaxed)) {
+      keys[count] = node->key;
+      values[count] = node->value;
+      count++;
+    }
+  }
+  return count;
+}
+
+/** As c_sl_pq_scan, but linearizable: the items stored are exactly those
+ *  with keys in [low, high], up to k of them, at one instant during the
+ *  call.  The scan starts once no add or claim is under way and is
+ *  accepted only if none began before it finished, so a wide range under
+ *  a steady stream of adds and pops can retry many times.
+ */
+size_t c_sl_pq_scan_snapshot(c_sl_pq_t *pqueue, pq_key_t low, pq_key_t high, size_t k, pq_key_t *keys, int64_t *values) {
+  size_t count;
+  int64_t begun;
+  do {
+    begun = wait_for_updates(pqueue);
+    count = c_sl_pq_scan(pqueue, low, high, k, keys, values);
+    atomic_thread_fence(memory_order_acquire);
+  } while(sharded_counter_read(pqueue->begun) != begun);
+  return count;
+}
+
+/** Move every item of src into dst and return the number that went in.
+ *  src's nodes are relinked rather than copied, in one pass along its
+ *  bottom level, and each search in dst resumes from the predecessors of
+ *  the key before, so the cost is linear in the two sizes.  A plain key
+ *  already in dst is dropped; a duplicate from add_dup is given a new
+ *  sequence number and pops after dst's own copies.  src is left empty.
+ *  Other threads may use dst throughout, but not src.
+ */
+size_t c_sl_pq_meld(c_sl_pq_t *dst, c_sl_pq_t *src) {
+  node_ptr preds[N], succs[N];
+  size_t added = 0, moved = 0;
+  node_ptr node = node_unmark(atomic_load_explicit(&src->head->next[BOTTOM], memory_order_relaxed));
+  while(node != src->tail) {
+    node_ptr next = node_unmark(atomic_load_explicit(&node->next[BOTTOM], memory_order_relaxed));
+    // Claimed nodes were retired, or leaked, by the call that claimed them.
+    if(!atomic_load_explicit(&node->deleted, memory_order_relaxed)) {
+      uint64_t seq = node->seq;
+      if(seq != 0) {
+        seq = atomic_fetch_add_explicit(&dst->seq, 1, memory_order_relaxed) + 1;
+        node->seq = seq;
       }
-      if(!atomic_exchange_explicit(&curr->deleted, true, memory_order_relaxed)){
-        mark_pointers(curr);
-        forkscan_retire(curr);
-        return true;
+      added += add_from(NULL, dst, node->key, node->value, seq, node, preds, succs, moved > 0);
+      moved++;
+    }
+    node = next;
+  }
+  for(int64_t i = 0; i < N; i++) {
+    atomic_store_explicit(&src->head->next[i], src->tail, memory_order_relaxed);
+  }
+  sharded_counter_add_local(src->size, -(int64_t)moved);
+  return added;
+}
+
+/** Move every item with a key at or above pivot into a new queue and
+ *  return it.  Each level is cut after the last node below pivot and the
+ *  part beyond is handed to the new queue, whose last node at each level
+ *  is then pointed at the new tail, so the cost is linear in the items
+ *  moved.  No other thread may be using the queue.
+ */
+c_sl_pq_t *c_sl_pq_split(c_sl_pq_t *pqueue, pq_key_t pivot) {
+  node_ptr preds[N], succs[N];
+  c_sl_pq_t *upper = c_sl_pq_create();
+  atomic_store_explicit(&upper->toplevel, top_level(pqueue), memory_order_relaxed);
+  // Later duplicates must still sort after the ones moved across.
+  atomic_store_explicit(&upper->seq, atomic_load_explicit(&pqueue->seq, memory_order_relaxed),
+    memory_order_relaxed);
+  bool _ = find_from(pqueue, pivot, 0, preds, succs, false);
+  int64_t moved = 0;
+  for(int64_t level = N - 1; level >= BOTTOM; --level) {
+    node_ptr node = succs[level];
+    if(node == pqueue->tail) { continue; }
+    atomic_store_explicit(&upper->head->next[level], node, memory_order_relaxed);
+    atomic_store_explicit(&preds[level]->next[level], pqueue->tail, memory_order_relaxed);
+    while(true) {
+      node_ptr next = atomic_load_explicit(&node->next[level], memory_order_relaxed);
+      if(level == BOTTOM && !atomic_load_explicit(&node->deleted, memory_order_relaxed)) {
+        moved++;
+      }
+      if(node_unmark(next) == pqueue->tail) {
+        // Keep the mark: a claimed node stays claimed in its new queue.
+        node_ptr end = node_is_marked(next) ? node_mark(upper->tail) : upper->tail;
+        atomic_store_explicit(&node->next[level], end, memory_order_relaxed);
+        break;
       }
+      node = node_unmark(next);
     }
   }
+  sharded_counter_add_local(pqueue->size, -moved);
+  sharded_counter_add_local(upper->size, moved);
+  return upper;
+}
+
+/** Return the approximate number of elements.  Each thread counts its own
+ *  adds and removals on a private shard and the read sums the shards
+ *  without stopping writers, so it is exact only at quiescence.
+ */
+size_t c_sl_pq_size(c_sl_pq_t * pqueue) {
+  return sharded_counter_read_size(pqueue->size);
+}
+
+/** Free the queue and every node still in it.  Nodes a pop or remove has
+ *  claimed were retired, or leaked, by that call and are skipped.  No
+ *  other thread may be using the queue.
+ */
+void c_sl_pq_destroy(c_sl_pq_t * pqueue) {
+  node_ptr node = node_unmark(atomic_load_explicit(&pqueue->head->next[BOTTOM], memory_order_relaxed));
+  while(node != pqueue->tail) {
+    node_ptr next = node_unmark(atomic_load_explicit(&node->next[BOTTOM], memory_order_relaxed));
+    if(!atomic_load_explicit(&node->deleted, memory_order_relaxed)) {
+      node_free(node);
+    }
+    node = next;
+  }
+  node_free(pqueue->head);
+  node_free(pqueue->tail);
+  parking_lot_destroy(pqueue->waiters);
+  sharded_counter_destroy(pqueue->size);
+  sharded_counter_destroy(pqueue->begun);
+  sharded_counter_destroy(pqueue->ended);
+  forkscan_free(pqueue);
 }
@@ -7,14 +7,40 @@
  */
 
 #include <stdint.h>
+#include <stddef.h>
 
-#define N 20
+#include "pq_key.h"
+#include "utils.h"
+
+#define N SKIPLIST_HEIGHT
 
 typedef struct c_sl_pq_t c_sl_pq_t;
 
 c_sl_pq_t * c_sl_pq_create();
 
-int c_sl_pq_add(uint64_t *seed, c_sl_pq_t *pqueue, int64_t key);
+int c_sl_pq_add(uint64_t *seed, c_sl_pq_t *pqueue, pq_key_t key);
+int c_sl_pq_add_item(uint64_t *seed, c_sl_pq_t *pqueue, pq_key_t key, int64_t value);
+int c_sl_pq_add_dup(uint64_t *seed, c_sl_pq_t *pqueue, pq_key_t key);
+int c_sl_pq_add_dup_item(uint64_t *seed, c_sl_pq_t *pqueue, pq_key_t key, int64_t value);
+int c_sl_pq_add_batch(uint64_t *seed, c_sl_pq_t *pqueue, pq_key_t *keys, size_t n);
+int c_sl_pq_remove_leaky(c_sl_pq_t *pqueue, pq_key_t key);
+int c_sl_pq_remove(c_sl_pq_t *pqueue, pq_key_t key);
 int c_sl_pq_leaky_pop_min(c_sl_pq_t *pqueue);
 int c_sl_pq_pop_min(c_sl_pq_t * pqueue);
+int c_sl_pq_leaky_pop_min_item(c_sl_pq_t *pqueue, pq_key_t *key, int64_t *value);
+int c_sl_pq_pop_min_item(c_sl_pq_t *pqueue, pq_key_t *key, int64_t *value);
+int c_sl_pq_leaky_pop_max(c_sl_pq_t *pqueue);
+int c_sl_pq_pop_max(c_sl_pq_t * pqueue);
+int c_sl_pq_leaky_pop_max_item(c_sl_pq_t *pqueue, pq_key_t *key, int64_t *value);
+int c_sl_pq_pop_max_item(c_sl_pq_t *pqueue, pq_key_t *key, int64_t *value);
+size_t c_sl_pq_leaky_pop_many(c_sl_pq_t *pqueue, size_t k, pq_key_t *keys, int64_t *values);
+size_t c_sl_pq_pop_many(c_sl_pq_t *pqueue, size_t k, pq_key_t *keys, int64_t *values);
+int c_sl_pq_pop_min_wait(c_sl_pq_t *pqueue, pq_key_t *key, int64_t *value, int64_t timeout_ns);
+int c_sl_pq_peek_min(c_sl_pq_t *pqueue, pq_key_t *key, int64_t *value);
+size_t c_sl_pq_scan(c_sl_pq_t *pqueue, pq_key_t low, pq_key_t high, size_t k, pq_key_t *keys, int64_t *values);
+size_t c_sl_pq_scan_snapshot(c_sl_pq_t *pqueue, pq_key_t low, pq_key_t high, size_t k, pq_key_t *keys, int64_t *values);
+size_t c_sl_pq_meld(c_sl_pq_t *dst, c_sl_pq_t *src);
+c_sl_pq_t *c_sl_pq_split(c_sl_pq_t *pqueue, pq_key_t pivot);
+size_t c_sl_pq_size(c_sl_pq_t *pqueue);
+void c_sl_pq_destroy(c_sl_pq_t *pqueue);
 void c_sl_pq_print (c_sl_pq_t *pqueue);
\ No newline at end of file
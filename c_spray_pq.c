@@ -5,6 +5,9 @@
  */
 
 #include "c_spray_pq.h"
+#include "parking_lot.h"
+#include "sharded_counter.h"
+#include "node_pool.h"
 #include "utils.h"
 
 #include <stdbool.h>
@@ -15,7 +18,7 @@
 #include <pthread.h>
 #include <math.h>
 
-#define N 20
+#define N SKIPLIST_HEIGHT
 #define BOTTOM 0
 
 enum STATE {PADDING, ACTIVE, DELETED};
@@ -26,10 +29,13 @@ typedef node_t* node_ptr;
 typedef struct config_t config_t;
 
 struct node_t {
-  int64_t key;
+  pq_key_t key;
+  int64_t value;
+  uint64_t seq;
   int32_t toplevel;
   _Atomic(state_t) state;
-  _Atomic(node_ptr) next[N];
+  // Sized to toplevel + 1 by node_create.
+  _Atomic(node_ptr) next[];
 };
 
 struct config_t {
@@ -37,20 +43,57 @@ struct config_t {
 };
 
 struct c_spray_pq_t {
+  // Sequence numbers for add_dup, off the lines that finds read.
+  _Atomic(uint64_t) seq;
+  char padding[128];
+  sharded_counter_t *size;
+  parking_lot_t *waiters;
   config_t config;
+  // Threads registered through c_spray_pq_register, and the spray shape
+  // for that count.  With none registered the shape is the one in config,
+  // for the thread count given at create; the padding is always sized by
+  // that count.
+  _Atomic(int64_t) registered;
+  _Atomic(int64_t) thread_count, start_height, max_jump;
   node_ptr padding_head;
-  node_t head, tail;
+  // Highest level any node has been linked at; finds start there.
+  _Atomic(int32_t) toplevel;
+  node_ptr head, tail;
 };
 
 
-static node_ptr node_create(int64_t key, int32_t toplevel, state_t state){
-  node_ptr node = forkscan_malloc(sizeof(node_t));
+/** Return the bytes a node with a tower toplevel + 1 high takes.
+ */
+static size_t node_size(int32_t toplevel) {
+  return sizeof(node_t) + (toplevel + 1) * sizeof(node_ptr);
+}
+
+/** Allocate a node with a tower of toplevel + 1 links.
+ */
+static node_ptr node_create(pq_key_t key, int64_t value, uint64_t seq, int32_t toplevel, state_t state){
+  node_ptr node = node_pool_alloc(node_size(toplevel));
   node->key = key;
+  node->value = value;
+  node->seq = seq;
   node->toplevel = toplevel;
   atomic_store_explicit(&node->state, state, memory_order_relaxed);
   return node;
 }
 
+/** Hand a node no other thread can reach back to the node pool.
+ */
+static void node_free(node_ptr node) {
+  if(node != NULL) {
+    node_pool_free(node, node_size(node->toplevel));
+  }
+}
+
+/** Retire a node other threads may still reach.
+ */
+static void node_retire(node_ptr node) {
+  node_pool_retire(node, node_size(node->toplevel));
+}
+
 static node_ptr node_unmark(node_ptr node){
   return (node_ptr)(((size_t)node) & (~0x1));
 }
@@ -59,26 +102,51 @@ static node_ptr node_mark(node_ptr node){
   return (node_ptr)((size_t)node | 0x1);
 }
 
+/** Return the highest level any node has been linked at.  The levels above
+ *  it are empty, so a find starts here rather than at the top of the
+ *  head's tower.  Sprays start at their own height and ignore it.
+ */
+static int32_t top_level(c_spray_pq_t *pqueue) {
+  return atomic_load_explicit(&pqueue->toplevel, memory_order_relaxed);
+}
+
+/** Raise the top level to cover a node of height toplevel + 1, before the
+ *  node is linked.
+ */
+static void raise_top_level(c_spray_pq_t *pqueue, int32_t toplevel) {
+  int32_t top = atomic_load_explicit(&pqueue->toplevel, memory_order_relaxed);
+  while(top < toplevel && !atomic_compare_exchange_weak_explicit(&pqueue->toplevel,
+    &top, toplevel, memory_order_seq_cst, memory_order_relaxed)) {}
+}
+
 static bool node_is_marked(node_ptr node){
   return node_unmark(node) != node;
 }
 
+static int64_t max(int64_t arg1, int64_t arg2) {
+  return arg1 > arg2 ? arg1 : arg2;
+}
+
+static int64_t min(int64_t arg1, int64_t arg2) {
+  return arg1 < arg2 ? arg1 : arg2;
+}
+
+/** Return the spray shape the paper gives for threads threads.  The start
+ *  height and jump grow with log2(threads), so they are capped at the top
+ *  level, N - 1; a spray started above it would read past the towers.
+ */
 static config_t c_spray_pq_config_paper(int64_t threads) {
   int64_t log_arg = threads;
   if(threads == 1) { log_arg = 2; }
   return (config_t) {
     .thread_count = threads,
-    .start_height = log2(threads) + 1,
-    .max_jump = log2(threads) + 1,
+    .start_height = min(log2(threads) + 1, N - 1),
+    .max_jump = min(log2(threads) + 1, N - 1),
     .descend_amount = 1,
     .padding_amount = (threads * log2(log_arg)) / 2
   };
 }
 
-static int64_t max(int64_t arg1, int64_t arg2) {
-  return arg1 > arg2 ? arg1 : arg2;
-}
-
 static void print_config(config_t *config) {
   printf("Thread Count: %ld\n", config->thread_count);
   printf("Start Height: %ld\n", config->start_height);
@@ -93,7 +161,7 @@ void print_node(node_ptr node) {
   if(node_is_marked(next)) {
     printf("marked ");
   }
-  printf("node[%d] key[%ld] state: ", unmarked_node->toplevel, unmarked_node->key);
+  printf("node[%d] key[%ld] state: ", unmarked_node->toplevel, (long)unmarked_node->key);
   state_t state = atomic_load_explicit(&unmarked_node->state, memory_order_relaxed);
   if(state == ACTIVE) {
     printf("ACTIVE");
@@ -109,9 +177,9 @@ void print_node(node_ptr node) {
  */
 void c_spray_pq_print (c_spray_pq_t *pqueue) {
   printf("**************************\n");
-  node_ptr node = atomic_load_explicit(&pqueue->head.next[BOTTOM], memory_order_consume);
+  node_ptr node = atomic_load_explicit(&pqueue->head->next[BOTTOM], memory_order_consume);
   assert(!node_is_marked(node));
-  while(node_unmark(node) != &pqueue->tail) {
+  while(node_unmark(node) != pqueue->tail) {
     print_node(node);
     node_ptr next = atomic_load_explicit(&node_unmark(node)->next[BOTTOM], memory_order_consume);
     node = next;
@@ -124,28 +192,65 @@ void c_spray_pq_print (c_spray_pq_t *pqueue) {
 c_spray_pq_t* c_spray_pq_create(int64_t threads) {
   c_spray_pq_t* spray_pq = forkscan_malloc(sizeof(c_spray_pq_t));
   spray_pq->config = c_spray_pq_config_paper(threads);
-  spray_pq->head.key = INT64_MIN;
-  spray_pq->head.toplevel = N - 1;
-  atomic_store_explicit(&spray_pq->head.state, PADDING, memory_order_relaxed);
-  spray_pq->tail.key = INT64_MAX;
-  spray_pq->tail.toplevel = N - 1;
-  atomic_store_explicit(&spray_pq->tail.state, PADDING, memory_order_relaxed);
+  spray_pq->head = node_create(PQ_KEY_MIN, 0, 0, N - 1, PADDING);
+  spray_pq->tail = node_create(PQ_KEY_MAX, 0, UINT64_MAX, N - 1, PADDING);
+  atomic_store_explicit(&spray_pq->seq, 0, memory_order_relaxed);
+  spray_pq->size = sharded_counter_create(SHARDED_COUNTER_LOCAL_SHARDS);
+  spray_pq->waiters = parking_lot_create();
+  atomic_store_explicit(&spray_pq->toplevel, 0, memory_order_relaxed);
   for(int64_t i = 0; i < N; i++) {
-    atomic_store_explicit(&spray_pq->head.next[i], &spray_pq->tail, memory_order_relaxed);
-    atomic_store_explicit(&spray_pq->tail.next[i], NULL, memory_order_relaxed);
+    atomic_store_explicit(&spray_pq->head->next[i], spray_pq->tail, memory_order_relaxed);
+    atomic_store_explicit(&spray_pq->tail->next[i], NULL, memory_order_relaxed);
   }
-  spray_pq->padding_head = &spray_pq->head;
+  spray_pq->padding_head = spray_pq->head;
   for(int64_t i = 1; i < spray_pq->config.padding_amount; i++) {
-    node_ptr node = node_create(INT64_MIN, N - 1, PADDING);
+    node_ptr node = node_create(PQ_KEY_MIN, 0, 0, N - 1, PADDING);
     for(int64_t j = 0; j < N; j++) {
       atomic_store_explicit(&node->next[j], spray_pq->padding_head, memory_order_relaxed);
     }
     spray_pq->padding_head = node;
   }
+  atomic_store_explicit(&spray_pq->registered, 0, memory_order_relaxed);
+  atomic_store_explicit(&spray_pq->thread_count, spray_pq->config.thread_count, memory_order_relaxed);
+  atomic_store_explicit(&spray_pq->start_height, spray_pq->config.start_height, memory_order_relaxed);
+  atomic_store_explicit(&spray_pq->max_jump, spray_pq->config.max_jump, memory_order_relaxed);
   print_config(&spray_pq->config);
   return spray_pq;
 }
 
+/** Retune the spray for the registered thread count.  Retry if the count
+ *  moved meanwhile, so racing registrations settle on the latest shape.
+ */
+static void reshape(c_spray_pq_t *pqueue) {
+  int64_t registered = atomic_load_explicit(&pqueue->registered, memory_order_relaxed);
+  while(true) {
+    config_t shape = registered > 0 ? c_spray_pq_config_paper(registered) : pqueue->config;
+    atomic_store_explicit(&pqueue->thread_count, shape.thread_count, memory_order_relaxed);
+    atomic_store_explicit(&pqueue->start_height, min(shape.start_height, N - 1), memory_order_relaxed);
+    atomic_store_explicit(&pqueue->max_jump, min(shape.max_jump, N - 1), memory_order_relaxed);
+    int64_t now = atomic_load_explicit(&pqueue->registered, memory_order_relaxed);
+    if(now == registered) { return; }
+    registered = now;
+  }
+}
+
+/** Count the calling thread among those using the queue.  The spray's
+ *  start height, jump length and cleaner odds follow the registered count,
+ *  so a pool that grows or shrinks keeps pops spread over the right number
+ *  of nodes.
+ */
+void c_spray_pq_register(c_spray_pq_t *pqueue) {
+  atomic_fetch_add_explicit(&pqueue->registered, 1, memory_order_relaxed);
+  reshape(pqueue);
+}
+
+/** Stop counting the calling thread.
+ */
+void c_spray_pq_unregister(c_spray_pq_t *pqueue) {
+  atomic_fetch_sub_explicit(&pqueue->registered, 1, memory_order_relaxed);
+  reshape(pqueue);
+}
+
 static void mark_pointers(node_ptr node) {
   node_ptr unmarked_node = node_unmark(node);
   assert(atomic_load_explicit(&node->state, memory_order_relaxed) == DELETED);
@@ -164,17 +269,36 @@ static void mark_pointers(node_ptr node) {
   }
 }
 
-static bool find(c_spray_pq_t *pqueue, int64_t key, 
-  node_ptr preds[N], node_ptr succs[N]) {
+/** Order nodes by key, then by sequence number.  Plain adds use sequence
+ *  0, which sorts ahead of every duplicate of the same key.
+ */
+static bool node_less(node_ptr node, pq_key_t key, uint64_t seq) {
+  return node->key < key || (node->key == key && node->seq < seq);
+}
+
+/** Fill preds and succs for (key, seq) and return whether a node with key
+ *  is at succs[BOTTOM].  If hinted, preds already holds the predecessors of
+ *  a smaller key and each level resumes from there rather than from the
+ *  head.
+ */
+static bool find_from(c_spray_pq_t *pqueue, pq_key_t key, uint64_t seq,
+  node_ptr preds[N], node_ptr succs[N], bool hinted) {
   bool marked, snip;
   // node_ptr pred = NULL, curr = NULL, succ = NULL;
 retry:
   while(true) {
-    node_ptr left = &pqueue->head, right = NULL;
-    for(int64_t level = N - 1; level >= BOTTOM; --level) {
+    node_ptr left = pqueue->head, right = NULL;
+    int32_t top = top_level(pqueue);
+    // Nothing is linked above the top level.
+    for(int64_t level = N - 1; level > top; --level) {
+      preds[level] = pqueue->head;
+      succs[level] = pqueue->tail;
+    }
+    for(int64_t level = top; level >= BOTTOM; --level) {
+      if(hinted && preds[level]->key > left->key) { left = preds[level]; }
       node_ptr left_next = atomic_load_explicit(&left->next[level], memory_order_consume);
-      // Is our current node invalid?
-      if(node_is_marked(left_next)) { goto retry; }
+      // Is our current node invalid?  A stale hint is, so drop the hints.
+      if(node_is_marked(left_next)) { hinted = false; goto retry; }
       node_ptr right = left_next;
       // Find two nodes to put into preds and succs.
       while(true) {
@@ -185,7 +309,7 @@ retry:
           right_next = atomic_load_explicit(&right->next[level], memory_order_consume);
         }
         // Has the right not gone far enough?        
-        if(right->key < key) {
+        if(node_less(right, key, seq)) {
           left = right;
           left_next = right_next;
           right = right_next;
@@ -209,13 +333,22 @@ retry:
 
 /** Add a node, lock-free, to the skiplist.
  */
-int c_spray_pq_add(uint64_t *seed, c_spray_pq_t *pqueue, int64_t key) {
-  node_ptr preds[N], succs[N];
+int c_spray_pq_add(uint64_t *seed, c_spray_pq_t *pqueue, pq_key_t key) {
+  return c_spray_pq_add_item(seed, pqueue, key, 0);
+}
+
+/** Insert (key, seq).  Sequence 0 is a plain add and fails if key is
+ *  already present; any other sequence always goes in, after every older
+ *  duplicate of key.
+ */
+static int add_from(uint64_t *seed, c_spray_pq_t *pqueue, pq_key_t key, int64_t value,
+  uint64_t seq, node_ptr preds[N], node_ptr succs[N], bool hinted) {
   int32_t toplevel = random_level(seed, N);
   node_ptr node = NULL;
+  raise_top_level(pqueue, toplevel);
   // int x = 0;
   while(true) {
-    if(find(pqueue, key, preds, succs)) {
+    if(find_from(pqueue, key, seq, preds, succs, hinted) && seq == 0) {
       node_ptr found_node = succs[BOTTOM];
       state_t found_state = atomic_load_explicit(&found_node->state, memory_order_relaxed);
       if(found_state == DELETED) {
@@ -223,10 +356,10 @@ int c_spray_pq_add(uint64_t *seed, c_spray_pq_t *pqueue, int64_t key) {
         mark_pointers(found_node);
         continue;
       }
-      forkscan_free((void*)node);
+      node_free(node);
       return false;
     }
-    if(node == NULL) { node = node_create(key, toplevel, ACTIVE); }
+    if(node == NULL) { node = node_create(key, value, seq, toplevel, ACTIVE); }
     for(int64_t i = BOTTOM; i <= toplevel; ++i) {
       atomic_store_explicit(&node->next[i], succs[i], memory_order_release);
     }
@@ -241,20 +374,60 @@ int c_spray_pq_add(uint64_t *seed, c_spray_pq_t *pqueue, int64_t key) {
           &succ, node, memory_order_release, memory_order_relaxed)) {
           break;
         }
-        bool _ = find(pqueue, key, preds, succs);
+        bool _ = find_from(pqueue, key, seq, preds, succs, false);
       }
     }
+    sharded_counter_add_local(pqueue->size, 1);
+    parking_lot_wake(pqueue->waiters);
     return true;
   }
 }
 
+/** Add a key with its value, lock-free, to the skiplist.
+ */
+int c_spray_pq_add_item(uint64_t *seed, c_spray_pq_t *pqueue, pq_key_t key, int64_t value) {
+  node_ptr preds[N], succs[N];
+  return add_from(seed, pqueue, key, value, 0, preds, succs, false);
+}
+
+/** Add a key, lock-free, to the skiplist even if it is already present.
+ *  Equal keys are ordered by when they were added.
+ */
+int c_spray_pq_add_dup(uint64_t *seed, c_spray_pq_t *pqueue, pq_key_t key) {
+  return c_spray_pq_add_dup_item(seed, pqueue, key, 0);
+}
+
+/** Add a key with its value, lock-free, to the skiplist even if the key is
+ *  already present.  Equal keys are ordered by when they were added.
+ */
+int c_spray_pq_add_dup_item(uint64_t *seed, c_spray_pq_t *pqueue, pq_key_t key, int64_t value) {
+  node_ptr preds[N], succs[N];
+  uint64_t seq = atomic_fetch_add_explicit(&pqueue->seq, 1, memory_order_relaxed) + 1;
+  return add_from(seed, pqueue, key, value, seq, preds, succs, false);
+}
+
+/** Add n keys to the skiplist.  The keys are sorted in place and spliced
+ *  in left to right, each search resuming from the predecessors of the key
+ *  before it.  Return the number of keys added.
+ */
+int c_spray_pq_add_batch(uint64_t *seed, c_spray_pq_t *pqueue, pq_key_t *keys, size_t n) {
+  node_ptr preds[N], succs[N];
+  int added = 0;
+  pq_key_sort(keys, n);
+  for(size_t i = 0; i < n; i++) {
+    if(i > 0 && keys[i] == keys[i - 1]) { continue; }
+    added += add_from(seed, pqueue, keys[i], 0, 0, preds, succs, i > 0);
+  }
+  return added;
+}
+
 /** Remove a node, lock-free, from the skiplist.
  */
-static int c_spray_pq_remove_leaky(c_spray_pq_t *pqueue, int64_t key) {
+static int c_spray_pq_remove_leaky(c_spray_pq_t *pqueue, pq_key_t key, uint64_t seq) {
   node_ptr preds[N], succs[N];
   node_ptr succ = NULL;
   while(true) {
-    if(!find(pqueue, key, preds, succs)) {
+    if(!find_from(pqueue, key, seq, preds, succs, false) || succs[BOTTOM]->seq != seq) {
       return false;
     }
     node_ptr node_to_remove = succs[BOTTOM];
@@ -275,7 +448,7 @@ static int c_spray_pq_remove_leaky(c_spray_pq_t *pqueue, int64_t key) {
         &succ, node_mark(succ), memory_order_relaxed, memory_order_relaxed);
       marked = node_is_marked(succ);
       if(i_marked_it) {
-        bool _ = find(pqueue, key, preds, succs);
+        bool _ = find_from(pqueue, key, seq, preds, succs, false);
         return true;
       } else if(marked) {
         return false;
@@ -286,11 +459,11 @@ static int c_spray_pq_remove_leaky(c_spray_pq_t *pqueue, int64_t key) {
 
 /** Remove a node, lock-free, from the skiplist.
  */
-static int c_spray_pq_remove(c_spray_pq_t *pqueue, int64_t key) {
+static int c_spray_pq_remove(c_spray_pq_t *pqueue, pq_key_t key, uint64_t seq) {
   node_ptr preds[N], succs[N];
   node_ptr succ = NULL;
   while(true) {
-    if(!find(pqueue, key, preds, succs)) {
+    if(!find_from(pqueue, key, seq, preds, succs, false) || succs[BOTTOM]->seq != seq) {
       return false;
     }
     node_ptr node_to_remove = succs[BOTTOM];
@@ -311,8 +484,8 @@ static int c_spray_pq_remove(c_spray_pq_t *pqueue, int64_t key) {
         &succ, node_mark(succ), memory_order_relaxed, memory_order_relaxed);
       marked = node_is_marked(succ);
       if(i_marked_it) {
-        bool _ = find(pqueue, key, preds, succs);
-        forkscan_retire(node_to_remove);
+        bool _ = find_from(pqueue, key, seq, preds, succs, false);
+        node_retire(node_to_remove);
         return true;
       } else if(marked) {
         return false;
@@ -324,11 +497,13 @@ static int c_spray_pq_remove(c_spray_pq_t *pqueue, int64_t key) {
 static node_ptr spray(uint64_t * seed, c_spray_pq_t * pqueue) {
   node_ptr cur_node = pqueue->padding_head;
   int64_t D = pqueue->config.descend_amount;
-  for(int64_t H = pqueue->config.start_height; H >= BOTTOM; H = H - D) {
-    int64_t jump = fast_rand(seed) % (pqueue->config.max_jump + 1);
+  int64_t start_height = atomic_load_explicit(&pqueue->start_height, memory_order_relaxed);
+  int64_t max_jump = atomic_load_explicit(&pqueue->max_jump, memory_order_relaxed);
+  for(int64_t H = start_height; H >= BOTTOM; H = H - D) {
+    int64_t jump = fast_rand(seed) % (max_jump + 1);
     while(jump-- > 0) {
       node_ptr next = node_unmark(atomic_load_explicit(&cur_node->next[H], memory_order_consume));
-      if(next == &pqueue->tail || next == NULL) {
+      if(next == pqueue->tail || next == NULL) {
         break;
       }
       cur_node = next;
@@ -340,30 +515,44 @@ static node_ptr spray(uint64_t * seed, c_spray_pq_t * pqueue) {
 /** Pop the front node from the list.  Return true iff there was a node to pop.
  */
 int c_spray_pq_leaky_pop_min(uint64_t *seed, c_spray_pq_t *pqueue) {
+  pq_key_t key;
+  int64_t value;
+  return c_spray_pq_leaky_pop_min_item(seed, pqueue, &key, &value);
+}
+
+/** Pop a node near the front of the list and store its key and value.
+ *  Return true iff there was a node to pop.
+ */
+int c_spray_pq_leaky_pop_min_item(uint64_t *seed, c_spray_pq_t *pqueue, pq_key_t *key, int64_t *value) {
 
-  bool cleaner = ((fast_rand(seed) % (pqueue->config.thread_count)) == 0);
+  bool cleaner = ((fast_rand(seed) % atomic_load_explicit(&pqueue->thread_count, memory_order_relaxed)) == 0);
   if(cleaner) {
-    node_ptr left = &pqueue->head;
-    node_ptr left_next = atomic_load_explicit(&pqueue->head.next[BOTTOM], memory_order_relaxed);
+    node_ptr left = pqueue->head;
+    node_ptr left_next = atomic_load_explicit(&pqueue->head->next[BOTTOM], memory_order_relaxed);
     assert(!node_is_marked(left_next));
     node_ptr right = left_next;
     bool claimed_node = false;
-    for(; right != &pqueue->tail; right = node_unmark(atomic_load_explicit(&right->next[BOTTOM], memory_order_relaxed))) {
+    for(; right != pqueue->tail; right = node_unmark(atomic_load_explicit(&right->next[BOTTOM], memory_order_relaxed))) {
       state_t state = right->state;
       if(state == DELETED) { mark_pointers(right); continue; }
       if(state == ACTIVE) {
         if(!claimed_node) {
           claimed_node = (atomic_exchange_explicit(&right->state, DELETED, memory_order_relaxed) == ACTIVE);
+          if(claimed_node) {
+            *key = right->key;
+            *value = right->value;
+            sharded_counter_add_local(pqueue->size, -1);
+          }
           mark_pointers(right);
           continue;
         }
-        if(atomic_load_explicit(&pqueue->head.next[BOTTOM], memory_order_relaxed) == left_next) {
+        if(atomic_load_explicit(&pqueue->head->next[BOTTOM], memory_order_relaxed) == left_next) {
           atomic_compare_exchange_weak_explicit(&left->next[BOTTOM], &left_next, right, memory_order_release, memory_order_relaxed);
         }
         return true;
       }
     }
-    if(atomic_load_explicit(&pqueue->head.next[BOTTOM], memory_order_relaxed) == left_next) {
+    if(atomic_load_explicit(&pqueue->head->next[BOTTOM], memory_order_relaxed) == left_next) {
       atomic_compare_exchange_weak_explicit(&left->next[BOTTOM], &left_next, right, memory_order_release, memory_order_relaxed);
     }
     return claimed_node;
@@ -371,14 +560,17 @@ int c_spray_pq_leaky_pop_min(uint64_t *seed, c_spray_pq_t *pqueue) {
     node_ptr node = spray(seed, pqueue);
     // If we're not passed the head yet, start just after there.
     if(atomic_load_explicit(&node->state, memory_order_relaxed) == PADDING) {
-      node = atomic_load_explicit(&pqueue->head.next[BOTTOM], memory_order_relaxed);
+      node = atomic_load_explicit(&pqueue->head->next[BOTTOM], memory_order_relaxed);
     }
-    for(; node != &pqueue->tail; node = node_unmark(atomic_load_explicit(&node->next[BOTTOM], memory_order_relaxed))) {
+    for(; node != pqueue->tail; node = node_unmark(atomic_load_explicit(&node->next[BOTTOM], memory_order_relaxed))) {
       state_t state = atomic_load_explicit(&node->state, memory_order_relaxed);
       if(state == DELETED) { continue; }
       if(state == ACTIVE && 
         (atomic_exchange_explicit(&node->state, DELETED, memory_order_relaxed) == ACTIVE)) {
+        *key = node->key;
+        *value = node->value;
         mark_pointers(node);
+        sharded_counter_add_local(pqueue->size, -1);
         return true;
       }
     }
@@ -386,23 +578,108 @@ int c_spray_pq_leaky_pop_min(uint64_t *seed, c_spray_pq_t *pqueue) {
   }
 }
 
-
+/** Pop a node near the front of the list.  Return true iff there was a
+ *  node to pop.
+ */
 int c_spray_pq_pop_min(uint64_t *seed, c_spray_pq_t *pqueue) {
+  pq_key_t key;
+  int64_t value;
+  return c_spray_pq_pop_min_item(seed, pqueue, &key, &value);
+}
+
+/** Pop a node near the front of the list and store its key and value.
+ *  Return true iff there was a node to pop.
+ */
+int c_spray_pq_pop_min_item(uint64_t *seed, c_spray_pq_t *pqueue, pq_key_t *key, int64_t *value) {
   node_ptr node = spray(seed, pqueue);
   // If we're not passed the head yet, start just after there.
   if(atomic_load_explicit(&node->state, memory_order_relaxed) == PADDING) {
-    node = atomic_load_explicit(&pqueue->head.next[0], memory_order_relaxed);
+    node = atomic_load_explicit(&pqueue->head->next[0], memory_order_relaxed);
   }
-  for(uint64_t i = 0; node != &pqueue->tail; node = node_unmark(atomic_load_explicit(&node->next[0], memory_order_relaxed)), i++) {
+  for(uint64_t i = 0; node != pqueue->tail; node = node_unmark(atomic_load_explicit(&node->next[0], memory_order_relaxed)), i++) {
     state_t state = atomic_load_explicit(&node->state, memory_order_relaxed);
     if(state == PADDING || state == DELETED) {
       continue;
     }
     if(state == ACTIVE && 
       (atomic_exchange_explicit(&node->state, DELETED, memory_order_relaxed) == ACTIVE)) {
-      bool _ = c_spray_pq_remove(pqueue, node->key);
+      *key = node->key;
+      *value = node->value;
+      bool _ = c_spray_pq_remove(pqueue, node->key, node->seq);
+      sharded_counter_add_local(pqueue->size, -1);
       return true;
     }
   }
   return false;
 }
+
+typedef struct wait_ctx_t {
+  uint64_t *seed;
+  c_spray_pq_t *pqueue;
+} wait_ctx_t;
+
+static int try_pop_min(void *ctx, void *key, int64_t *value) {
+  wait_ctx_t *wait = ctx;
+  return c_spray_pq_pop_min_item(wait->seed, wait->pqueue, key, value);
+}
+
+/** Pop the smallest item, waiting up to timeout_ns nanoseconds for one to
+ *  arrive if the queue is empty; a negative timeout waits forever.  Return
+ *  false on timeout.
+ */
+int c_spray_pq_pop_min_wait(uint64_t *seed, c_spray_pq_t *pqueue, pq_key_t *key, int64_t *value, int64_t timeout_ns) {
+  wait_ctx_t wait = { seed, pqueue };
+  return parking_lot_wait(pqueue->waiters, try_pop_min, &wait, key, value, timeout_ns);
+}
+
+/** Store the key and value of the first active node without removing it.
+ *  Return true iff there was one.  This reads the true front of the list,
+ *  not a sprayed position, so it can be smaller than what the next pop
+ *  returns.  It is exact only at quiescence: a concurrent pop may claim the
+ *  node and a smaller key added behind the scan is missed.
+ */
+int c_spray_pq_peek_min(c_spray_pq_t *pqueue, pq_key_t *key, int64_t *value) {
+  node_ptr node = node_unmark(atomic_load_explicit(&pqueue->head->next[BOTTOM], memory_order_consume));
+  for(; node != pqueue->tail; node = node_unmark(atomic_load_explicit(&node->next[BOTTOM], memory_order_consume))) {
+    if(atomic_load_explicit(&node->state, memory_order_relaxed) == ACTIVE) {
+      *key = node->key;
+      *value = node->value;
+      return true;
+    }
+  }
+  return false;
+}
+
+/** Return the approximate number of elements, summed from per-thread
+ *  shards without stopping writers.  Exact only at quiescence.
+ */
+size_t c_spray_pq_size(c_spray_pq_t *pqueue) {
+  return sharded_counter_read_size(pqueue->size);
+}
+
+/** Free the queue, its padding and every node still in it.  Deleted nodes
+ *  were retired, or leaked, by the pop that claimed them and are skipped.
+ *  No other thread may be using the queue.
+ */
+void c_spray_pq_destroy(c_spray_pq_t *pqueue) {
+  node_ptr node = node_unmark(atomic_load_explicit(&pqueue->head->next[BOTTOM], memory_order_relaxed));
+  while(node != pqueue->tail) {
+    node_ptr next = node_unmark(atomic_load_explicit(&node->next[BOTTOM], memory_order_relaxed));
+    if(atomic_load_explicit(&node->state, memory_order_relaxed) == ACTIVE) {
+      node_free(node);
+    }
+    node = next;
+  }
+  // The padding nodes chain down to the head on every level.
+  node = pqueue->padding_head;
+  while(node != pqueue->head) {
+    node_ptr next = atomic_load_explicit(&node->next[BOTTOM], memory_order_relaxed);
+    node_free(node);
+    node = next;
+  }
+  node_free(pqueue->head);
+  node_free(pqueue->tail);
+  parking_lot_destroy(pqueue->waiters);
+  sharded_counter_destroy(pqueue->size);
+  forkscan_free(pqueue);
+}
@@ -7,12 +7,27 @@
  */
 
 #include <stdint.h>
+#include <stddef.h>
+
+#include "pq_key.h"
 
 typedef struct c_spray_pq_t c_spray_pq_t;
 
 c_spray_pq_t *c_spray_pq_create(int64_t threads);
+void c_spray_pq_register(c_spray_pq_t *pqueue);
+void c_spray_pq_unregister(c_spray_pq_t *pqueue);
 
-int c_spray_pq_add(uint64_t *seed, c_spray_pq_t *pqueue, int64_t key);
+int c_spray_pq_add(uint64_t *seed, c_spray_pq_t *pqueue, pq_key_t key);
+int c_spray_pq_add_item(uint64_t *seed, c_spray_pq_t *pqueue, pq_key_t key, int64_t value);
+int c_spray_pq_add_dup(uint64_t *seed, c_spray_pq_t *pqueue, pq_key_t key);
+int c_spray_pq_add_dup_item(uint64_t *seed, c_spray_pq_t *pqueue, pq_key_t key, int64_t value);
+int c_spray_pq_add_batch(uint64_t *seed, c_spray_pq_t *pqueue, pq_key_t *keys, size_t n);
 int c_spray_pq_leaky_pop_min(uint64_t *seed, c_spray_pq_t *pqueue);
 int c_spray_pq_pop_min(uint64_t *seed, c_spray_pq_t *pqueue);
+int c_spray_pq_leaky_pop_min_item(uint64_t *seed, c_spray_pq_t *pqueue, pq_key_t *key, int64_t *value);
+int c_spray_pq_pop_min_item(uint64_t *seed, c_spray_pq_t *pqueue, pq_key_t *key, int64_t *value);
+int c_spray_pq_pop_min_wait(uint64_t *seed, c_spray_pq_t *pqueue, pq_key_t *key, int64_t *value, int64_t timeout_ns);
+int c_spray_pq_peek_min(c_spray_pq_t *pqueue, pq_key_t *key, int64_t *value);
+size_t c_spray_pq_size(c_spray_pq_t *pqueue);
+void c_spray_pq_destroy(c_spray_pq_t *pqueue);
 void c_spray_pq_print (c_spray_pq_t *pqueue);
\ No newline at end of file
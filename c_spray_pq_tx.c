@@ -4,6 +4,7 @@
 
 #include "c_spray_pq_tx.h"
 #include "elided_lock.h"
+#include "node_pool.h"
 #include "utils.h"
 
 #include <assert.h>
@@ -47,7 +48,7 @@ struct c_spray_pq_tx_t {
 
 
 static node_ptr node_create(int64_t key, int32_t toplevel, state_t state){
-  node_ptr node = forkscan_malloc(sizeof(node_t));
+  node_ptr node = node_pool_alloc(sizeof(node_t));
   node->key = key;
   node->toplevel = toplevel;
   // node->state = forkscan_malloc(sizeof(_Atomic(state_t)));
@@ -179,7 +180,7 @@ c_spray_pq_tx_t * c_spray_pq_tx_create(int64_t threads) {
   spray_pq_tx->padding_head = &spray_pq_tx->head;
   printf("Padding amount %ld\n", spray_pq_tx->config.padding_amount);
   for(int64_t i = 1; i < spray_pq_tx->config.padding_amount; i++) {
-    node_ptr node = forkscan_malloc(sizeof(node_t));
+    node_ptr node = node_pool_alloc(sizeof(node_t));
     // node->state = forkscan_malloc(sizeof(_Atomic(state_t)));
     // atomic_store_explicit(node->state, PADDING, memory_order_relaxed);
     node->state = PADDING;
@@ -214,7 +215,7 @@ c_spray_pq_tx_t * c_spray_pq_tx_create_test1(int64_t threads) {
   spray_pq_tx->padding_head = &spray_pq_tx->head;
   printf("Padding amount %ld\n", spray_pq_tx->config.padding_amount);
   for(int64_t i = 1; i < spray_pq_tx->config.padding_amount; i++) {
-    node_ptr node = forkscan_malloc(sizeof(node_t));
+    node_ptr node = node_pool_alloc(sizeof(node_t));
     // node->state = forkscan_malloc(sizeof(_Atomic(state_t)));
     // atomic_store_explicit(node->state, PADDING, memory_order_relaxed);
     node->state = PADDING;
@@ -268,7 +269,7 @@ c_spray_pq_tx_t * c_spray_pq_tx_create_test2(int64_t threads) {
   spray_pq_tx->padding_head = &spray_pq_tx->head;
   printf("Padding amount %ld\n", spray_pq_tx->config.padding_amount);
   for(int64_t i = 1; i < spray_pq_tx->config.padding_amount; i++) {
-    node_ptr node = forkscan_malloc(sizeof(node_t));
+    node_ptr node = node_pool_alloc(sizeof(node_t));
     // node->state = forkscan_malloc(sizeof(_Atomic(state_t)));
     // atomic_store_explicit(node->state, PADDING, memory_order_relaxed);
     node->state = PADDING;
@@ -349,7 +350,7 @@ c_spray_pq_tx_t * c_spray_pq_tx_create_test3(int64_t threads) {
   spray_pq_tx->padding_head = &spray_pq_tx->head;
   printf("Padding amount %ld\n", spray_pq_tx->config.padding_amount);
   for(int64_t i = 1; i < spray_pq_tx->config.padding_amount; i++) {
-    node_ptr node = forkscan_malloc(sizeof(node_t));
+    node_ptr node = node_pool_alloc(sizeof(node_t));
     // node->state = forkscan_malloc(sizeof(_Atomic(state_t)));
     // atomic_store_explicit(node->state, PADDING, memory_order_relaxed);
     node->state = PADDING;
@@ -442,7 +443,7 @@ c_spray_pq_tx_t * c_spray_pq_tx_create_test4(int64_t threads) {
   spray_pq_tx->padding_head = &spray_pq_tx->head;
   printf("Padding amount %ld\n", spray_pq_tx->config.padding_amount);
   for(int64_t i = 1; i < spray_pq_tx->config.padding_amount; i++) {
-    node_ptr node = forkscan_malloc(sizeof(node_t));
+    node_ptr node = node_pool_alloc(sizeof(node_t));
     // node->state = forkscan_malloc(sizeof(_Atomic(state_t)));
     // atomic_store_explicit(node->state, PADDING, memory_order_relaxed);
     node->state = PADDING;
@@ -612,7 +613,7 @@ retry:
   }
   unlock(pqueue->lock);
   if(!added) {
-    forkscan_free(node);
+    node_pool_free(node, sizeof(node_t));
     // printf("Didn't add %ld found: %d\n", key, found);
     // print_node(succs[BOTTOM]);
     // printf("Key found: %ld with state: %ud\n", succs[BOTTOM]->key, succs[BOTTOM]->state);
@@ -650,7 +651,7 @@ static int c_spray_pq_tx_remove(c_spray_pq_tx_t * pqueue, int64_t key) {
     }
   }
   unlock(pqueue->lock);
-  forkscan_retire((void*)node);
+  node_pool_retire(node, sizeof(node_t));
   return node != NULL;
 }
 
@@ -856,3 +857,26 @@ retry:
     return false;
   }
 }
+
+/** Free the queue, its lock, its padding and every node still linked.
+ *  Pops only mark nodes deleted and removes unlink before they retire, so
+ *  nothing linked has been retired.  No other thread may be using the
+ *  queue.
+ */
+void c_spray_pq_tx_destroy(c_spray_pq_tx_t *pqueue) {
+  node_ptr node = pqueue->head.next[BOTTOM];
+  while(node != &pqueue->tail) {
+    node_ptr next = node->next[BOTTOM];
+    node_pool_free(node, sizeof(node_t));
+    node = next;
+  }
+  // The padding nodes chain down to the head on every level.
+  node = pqueue->padding_head;
+  while(node != &pqueue->head) {
+    node_ptr next = node->next[BOTTOM];
+    node_pool_free(node, sizeof(node_t));
+    node = next;
+  }
+  destroy_elided_lock(pqueue->lock);
+  forkscan_free(pqueue);
+}
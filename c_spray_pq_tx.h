@@ -2,7 +2,9 @@
 
 #include <stdint.h>
 
-#define N 20
+#include "utils.h"
+
+#define N SKIPLIST_HEIGHT
 #define BOTTOM 0
 
 typedef struct c_spray_pq_tx_t c_spray_pq_tx_t;
@@ -17,5 +19,6 @@ c_spray_pq_tx_t * c_spray_pq_tx_create_test4(int64_t threads);
 int find_external(c_spray_pq_tx_t *pqueue, int64_t key);
 int c_spray_pq_tx_add(uint64_t *seed, c_spray_pq_tx_t * set, int64_t key);
 int c_spray_pq_tx_pop_min_leaky(uint64_t *seed, c_spray_pq_tx_t *set);
+void c_spray_pq_tx_destroy(c_spray_pq_tx_t *pqueue);
 void c_spray_pq_tx_print (c_spray_pq_tx_t *set);
 void c_spray_pq_tx_test_print (c_spray_pq_tx_t *pqueue);
\ No newline at end of file
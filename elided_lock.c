@@ -45,6 +45,10 @@ elided_lock_t * create_elided_lock() {
   return lock;
 }
 
+void destroy_elided_lock(elided_lock_t *lock) {
+  forkscan_free(lock);
+}
+
 void lock(elided_lock_t *lock) {
   for (size_t i = 0; i < MAX_RETRIES; i++) {
     wait_for_lock(lock);
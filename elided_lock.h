@@ -3,5 +3,6 @@
 typedef struct elided_lock_t elided_lock_t;
 
 elided_lock_t *create_elided_lock();
+void destroy_elided_lock(elided_lock_t *lock);
 void lock(elided_lock_t *lock);
 void unlock(elided_lock_t *lock);
\ No newline at end of file
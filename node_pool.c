@@ -0,0 +1,295 @@
+/* Per-thread caches of freed queue nodes.
+ */
+
+#include "node_pool.h"
+
+#include <forkscan.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+
+#if NODE_POOL
+
+typedef struct class_cache_t class_cache_t;
+typedef struct node_cache_t node_cache_t;
+typedef struct depot_t depot_t;
+
+struct class_cache_t {
+  // Free blocks, chained through their first word.
+  void *head;
+  size_t count;
+};
+
+struct node_cache_t {
+  class_cache_t classes[NODE_POOL_CLASSES];
+  // Unused end of the thread's current arena chunk.
+  char *arena;
+  size_t arena_left;
+};
+
+struct depot_t {
+  pthread_mutex_t lock;
+  // Chains of free blocks, linked through the second word of each
+  // chain's first block.
+  void *batches;
+};
+
+static depot_t depots[NODE_POOL_CLASSES];
+// Set once, before any node is allocated.
+static node_pool_memory_t pool_memory = NODE_POOL_HEAP;
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+static pthread_key_t cache_key;
+static _Thread_local node_cache_t *local_cache = NULL;
+
+static void ** next_block(void *block) {
+  return (void **)block;
+}
+
+static void ** next_batch(void *block) {
+  return (void **)block + 1;
+}
+
+static void depot_put(depot_t *depot, void *chain) {
+  pthread_mutex_lock(&depot->lock);
+  *next_batch(chain) = depot->batches;
+  depot->batches = chain;
+  pthread_mutex_unlock(&depot->lock);
+}
+
+static void * depot_take(depot_t *depot) {
+  pthread_mutex_lock(&depot->lock);
+  void *chain = depot->batches;
+  if(chain != NULL) {
+    depot->batches = *next_batch(chain);
+  }
+  pthread_mutex_unlock(&depot->lock);
+  return chain;
+}
+
+/** Hand every block in a cache to the depot.  Runs as the thread exits,
+ *  so the blocks it freed stay in use.
+ */
+static void cache_release(void *arg) {
+  node_cache_t *cache = arg;
+  for(size_t i = 0; i < NODE_POOL_CLASSES; i++) {
+    if(cache->classes[i].head != NULL) {
+      depot_put(&depots[i], cache->classes[i].head);
+    }
+  }
+  free(cache);
+  local_cache = NULL;
+}
+
+static void pool_init(void) {
+  for(size_t i = 0; i < NODE_POOL_CLASSES; i++) {
+    pthread_mutex_init(&depots[i].lock, NULL);
+    depots[i].batches = NULL;
+  }
+  pthread_key_create(&cache_key, cache_release);
+}
+
+static node_cache_t * cache_get(void) {
+  if(local_cache == NULL) {
+    pthread_once(&pool_once, pool_init);
+    local_cache = calloc(1, sizeof(node_cache_t));
+    pthread_setspecific(cache_key, local_cache);
+  }
+  return local_cache;
+}
+
+/** Map a fresh arena chunk of the given kind, or return NULL if the system
+ *  will not provide one.  Chunks other than hugetlbfs ones are mapped
+ *  twice over and trimmed, so they start on a huge page boundary and
+ *  transparent huge pages can back the whole chunk.
+ */
+static char * chunk_map(node_pool_memory_t memory) {
+  if(memory == NODE_POOL_HUGETLB) {
+    void *chunk = mmap(NULL, NODE_POOL_CHUNK, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    return chunk == MAP_FAILED ? NULL : chunk;
+  }
+  char *region = mmap(NULL, 2 * NODE_POOL_CHUNK, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if(region == MAP_FAILED) {
+    return NULL;
+  }
+  char *chunk = (char *)(((uintptr_t)region + NODE_POOL_CHUNK - 1) & ~(uintptr_t)(NODE_POOL_CHUNK - 1));
+  if(chunk > region) {
+    munmap(region, chunk - region);
+  }
+  if(region + NODE_POOL_CHUNK > chunk) {
+    munmap(chunk + NODE_POOL_CHUNK, region + NODE_POOL_CHUNK - chunk);
+  }
+  if(memory == NODE_POOL_THP && madvise(chunk, NODE_POOL_CHUNK, MADV_HUGEPAGE) != 0) {
+    munmap(chunk, NODE_POOL_CHUNK);
+    return NULL;
+  }
+  return chunk;
+}
+
+/** Carve a block of size bytes from the thread's arena, mapping a new
+ *  chunk when the current one runs out.  A chunk that cannot be mapped
+ *  huge falls back to ordinary pages.  There is no falling back to
+ *  forkscan: its blocks would be retired as arena blocks and leak, and
+ *  forkscan cannot see references to them held in arena nodes, so running
+ *  out of address space aborts.
+ */
+static void * arena_alloc(node_cache_t *cache, size_t size) {
+  if(cache->arena_left < size) {
+    char *chunk = chunk_map(pool_memory);
+    if(chunk == NULL && pool_memory != NODE_POOL_ARENA) {
+      chunk = chunk_map(NODE_POOL_ARENA);
+    }
+    if(chunk == NULL) {
+      fprintf(stderr, "node_pool: cannot map a %d-byte arena chunk\n", NODE_POOL_CHUNK);
+      abort();
+    }
+    cache->arena = chunk;
+    cache->arena_left = NODE_POOL_CHUNK;
+  }
+  void *block = cache->arena;
+  cache->arena += size;
+  cache->arena_left -= size;
+  return block;
+}
+
+/** Choose where new blocks come from and return the choice in effect.
+ *  Huge pages that the system will not provide fall back, hugetlbfs to
+ *  transparent huge pages and those to ordinary arenas.  Call before any
+ *  node is allocated.
+ */
+node_pool_memory_t node_pool_set_memory(node_pool_memory_t memory) {
+  while(memory != NODE_POOL_HEAP && memory != NODE_POOL_ARENA) {
+    char *chunk = chunk_map(memory);
+    if(chunk != NULL) {
+      munmap(chunk, NODE_POOL_CHUNK);
+      break;
+    }
+    memory = memory == NODE_POOL_HUGETLB ? NODE_POOL_THP : NODE_POOL_ARENA;
+  }
+  pool_memory = memory;
+  return memory;
+}
+
+/** Return a block of at least size bytes.  Its contents are undefined.
+ */
+void * node_pool_alloc(size_t size) {
+  size_t class = (size - 1) / NODE_POOL_GRAIN;
+  if(class >= NODE_POOL_CLASSES) {
+    return forkscan_malloc(size);
+  }
+  class_cache_t *cache = &cache_get()->classes[class];
+  if(cache->head == NULL) {
+    void *chain = depot_take(&depots[class]);
+    if(chain == NULL) {
+      if(pool_memory != NODE_POOL_HEAP) {
+        return arena_alloc(local_cache, (class + 1) * NODE_POOL_GRAIN);
+      }
+      return forkscan_malloc((class + 1) * NODE_POOL_GRAIN);
+    }
+    cache->head = chain;
+    cache->count = 0;
+    for(void *block = chain; block != NULL; block = *next_block(block)) {
+      cache->count++;
+    }
+  }
+  void *block = cache->head;
+  cache->head = *next_block(block);
+  cache->count--;
+  return block;
+}
+
+/** Return a block from node_pool_alloc, of the size it was asked for, to
+ *  the calling thread's cache.  Past two batches the oldest-held batch
+ *  goes to the depot, keeping the cache's most recently freed blocks,
+ *  which are likeliest still to be in cache.
+ */
+void node_pool_free(void *block, size_t size) {
+  size_t class = (size - 1) / NODE_POOL_GRAIN;
+  if(class >= NODE_POOL_CLASSES) {
+    forkscan_free(block);
+    return;
+  }
+  class_cache_t *cache = &cache_get()->classes[class];
+  *next_block(block) = cache->head;
+  cache->head = block;
+  cache->count++;
+  if(cache->count > 2 * NODE_POOL_BATCH) {
+    void *last = block;
+    for(size_t i = 1; i < NODE_POOL_BATCH; i++) {
+      last = *next_block(last);
+    }
+    void *chain = *next_block(last);
+    *next_block(last) = NULL;
+    cache->count = NODE_POOL_BATCH;
+    depot_put(&depots[class], chain);
+  }
+}
+
+/** Retire a block other threads may still reach.  Heap blocks go to
+ *  forkscan, which frees them once they are unreachable.  Arena blocks are
+ *  abandoned.
+ */
+void node_pool_retire(void *block, size_t size) {
+  if(pool_memory == NODE_POOL_HEAP || (size - 1) / NODE_POOL_GRAIN >= NODE_POOL_CLASSES) {
+    forkscan_retire(block);
+  }
+}
+
+/** Deallocator for forkscan_set_allocator, alongside malloc and
+ *  malloc_usable_size.  A block forkscan frees, whether retired or passed
+ *  to forkscan_free, joins the largest class it can hold, so retired
+ *  nodes are reused rather than returned to malloc.  Blocks too small or
+ *  too large for any class are freed.
+ */
+void node_pool_reclaim(void *block) {
+  if(block == NULL) {
+    return;
+  }
+  size_t usable = malloc_usable_size(block);
+  if(usable < NODE_POOL_GRAIN || usable / NODE_POOL_GRAIN > NODE_POOL_CLASSES) {
+    free(block);
+    return;
+  }
+  node_pool_free(block, usable / NODE_POOL_GRAIN * NODE_POOL_GRAIN);
+}
+
+#else
+
+node_pool_memory_t node_pool_set_memory(node_pool_memory_t memory) {
+  (void)memory;
+  return NODE_POOL_HEAP;
+}
+
+void * node_pool_alloc(size_t size) {
+  return forkscan_malloc(size);
+}
+
+void node_pool_free(void *block, size_t size) {
+  (void)size;
+  forkscan_free(block);
+}
+
+void node_pool_retire(void *block, size_t size) {
+  (void)size;
+  forkscan_retire(block);
+}
+
+void node_pool_reclaim(void *block) {
+  free(block);
+}
+
+#endif
+
+const char * node_pool_memory_name(node_pool_memory_t memory) {
+  switch(memory) {
+  case NODE_POOL_HEAP: return "heap";
+  case NODE_POOL_ARENA: return "arena";
+  case NODE_POOL_THP: return "thp";
+  case NODE_POOL_HUGETLB: return "hugetlb";
+  }
+  return "unknown";
+}
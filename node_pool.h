@@ -0,0 +1,62 @@
+#pragma once
+
+/* Per-thread caches of freed queue nodes, so adds rarely reach the general
+ * allocator.  Blocks are sorted into size classes NODE_POOL_GRAIN bytes
+ * apart.  A thread frees into its own cache and allocates from it first.
+ * A cache holding more than two batches of a class hands one batch to a
+ * shared depot, and an empty one takes a batch back, so nodes freed by
+ * consumer threads find their way back to producers.
+ *
+ * By default every block is a forkscan allocation of its own, rounded up
+ * to its class, so it may still be passed to forkscan_retire or
+ * forkscan_free.  Freeing into the pool is only safe where forkscan_free
+ * would be: nodes other threads may still reach go to node_pool_retire.
+ * With node_pool_reclaim installed as forkscan's deallocator, the blocks
+ * forkscan frees land back in the pool too.
+ *
+ * node_pool_set_memory can instead carve new blocks from per-thread
+ * arenas of NODE_POOL_CHUNK bytes, backed by huge pages where the system
+ * has them, so that a large queue's nodes share far fewer TLB entries.
+ * Forkscan cannot reclaim arena blocks, so retired nodes are then simply
+ * abandoned, as in the leaky policy.
+ *
+ * Built with NODE_POOL=0 every call goes straight to forkscan or free,
+ * and only the heap is available.  The build writes the setting into
+ * node_pool_config.h.
+ */
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#if __has_include("node_pool_config.h")
+#include "node_pool_config.h"
+#endif
+
+#ifndef NODE_POOL
+#define NODE_POOL 1
+#endif
+
+#define NODE_POOL_GRAIN 16
+#define NODE_POOL_CLASSES 32
+#define NODE_POOL_BATCH 64
+#define NODE_POOL_CHUNK (2 * 1024 * 1024)
+
+typedef enum node_pool_memory_t node_pool_memory_t;
+
+enum node_pool_memory_t {
+  // Each block from forkscan_malloc.
+  NODE_POOL_HEAP,
+  // Arenas of ordinary pages.
+  NODE_POOL_ARENA,
+  // Arenas madvised for transparent huge pages.
+  NODE_POOL_THP,
+  // Arenas mapped from the hugetlbfs pool.
+  NODE_POOL_HUGETLB,
+};
+
+node_pool_memory_t node_pool_set_memory(node_pool_memory_t memory);
+const char * node_pool_memory_name(node_pool_memory_t memory);
+void * node_pool_alloc(size_t size);
+void node_pool_free(void *block, size_t size);
+void node_pool_retire(void *block, size_t size);
+void node_pool_reclaim(void *block);
@@ -13,7 +13,7 @@ int register_thread() {
 
 int start_counters() {
   int PAPI_events[NUM_EVENTS] = { PAPI_L1_TCM, 
-    PAPI_L2_TCM, PAPI_STL_ICY, PAPI_TOT_INS, PAPI_L1_DCM /*PAPI_TOT_CYC*/};
+    PAPI_L2_TCM, PAPI_TLB_DM, PAPI_TOT_INS, PAPI_L1_DCM /*PAPI_TOT_CYC*/};
   return PAPI_start_counters(PAPI_events, NUM_EVENTS) == PAPI_OK;
 }
 
@@ -0,0 +1,92 @@
+/* Futex-based parking for consumers that find a queue empty.
+ */
+
+#include "parking_lot.h"
+
+#include <limits.h>
+#include <linux/futex.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include <immintrin.h>
+
+struct parking_lot_t {
+  // Bumped by every wake that finds a waiter; sleepers wait on it.
+  alignas(128) _Atomic(uint32_t) epoch;
+  // Consumers between registering and giving up or popping.
+  alignas(128) _Atomic(uint32_t) waiters;
+};
+
+/** Return a new lot with no waiters.
+ */
+parking_lot_t * parking_lot_create() {
+  parking_lot_t *lot = aligned_alloc(alignof(parking_lot_t), sizeof(parking_lot_t));
+  atomic_store_explicit(&lot->epoch, 0, memory_order_relaxed);
+  atomic_store_explicit(&lot->waiters, 0, memory_order_relaxed);
+  return lot;
+}
+
+/** Wake every parked waiter, if there are any.  Call after the item is
+ *  visible to pops.  The fence orders that publish before the waiter load;
+ *  a waiter registers before its last retry, so either it sees the item or
+ *  this call sees it.
+ */
+void parking_lot_wake(parking_lot_t *lot) {
+  atomic_thread_fence(memory_order_seq_cst);
+  if(atomic_load_explicit(&lot->waiters, memory_order_relaxed) == 0) {
+    return;
+  }
+  atomic_fetch_add_explicit(&lot->epoch, 1, memory_order_release);
+  syscall(SYS_futex, &lot->epoch, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+static int64_t now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/** Pop with try_pop, waiting up to timeout_ns nanoseconds for an item if
+ *  the queue is empty; a negative timeout waits forever.  Spins for a few
+ *  attempts first, since an item is often only a moment away, then parks.
+ *  Returns false on timeout.
+ */
+int parking_lot_wait(parking_lot_t *lot, parking_lot_try_t try_pop, void *ctx,
+                     void *key, int64_t *value, int64_t timeout_ns) {
+  for(int spin = 0; spin < PARKING_LOT_SPINS; spin++) {
+    if(try_pop(ctx, key, value)) {
+      return true;
+    }
+    _mm_pause();
+  }
+  int64_t deadline = timeout_ns < 0 ? INT64_MAX : now_ns() + timeout_ns;
+  while(true) {
+    atomic_fetch_add_explicit(&lot->waiters, 1, memory_order_seq_cst);
+    uint32_t epoch = atomic_load_explicit(&lot->epoch, memory_order_acquire);
+    if(try_pop(ctx, key, value)) {
+      atomic_fetch_sub_explicit(&lot->waiters, 1, memory_order_relaxed);
+      return true;
+    }
+    int64_t remaining = timeout_ns < 0 ? -1 : deadline - now_ns();
+    if(timeout_ns >= 0 && remaining <= 0) {
+      atomic_fetch_sub_explicit(&lot->waiters, 1, memory_order_relaxed);
+      return false;
+    }
+    struct timespec ts = { .tv_sec = remaining / 1000000000,
+                           .tv_nsec = remaining % 1000000000 };
+    // Returns at once if a wake has bumped the epoch since it was read.
+    syscall(SYS_futex, &lot->epoch, FUTEX_WAIT_PRIVATE, epoch,
+            remaining < 0 ? NULL : &ts, NULL, 0);
+    atomic_fetch_sub_explicit(&lot->waiters, 1, memory_order_relaxed);
+    if(try_pop(ctx, key, value)) {
+      return true;
+    }
+  }
+}
+
+void parking_lot_destroy(parking_lot_t *lot) {
+  free(lot);
+}
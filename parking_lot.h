@@ -0,0 +1,27 @@
+#pragma once
+
+/* Futex-based parking for consumers that find a queue empty.
+ * A consumer registers as a waiter, retries its pop, and only then sleeps
+ * on the lot's futex word.  Producers call parking_lot_wake after
+ * publishing an item; with no registered waiters that is a fence and a
+ * load of a line nobody writes, so the non-empty path stays cheap.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define PARKING_LOT_SPINS 128
+
+typedef struct parking_lot_t parking_lot_t;
+
+/* One attempt at a pop; returns nonzero on success.  ctx and key are passed
+ * through from parking_lot_wait; key points at the queue's own key type.
+ */
+typedef int (*parking_lot_try_t)(void *ctx, void *key, int64_t *value);
+
+parking_lot_t * parking_lot_create();
+
+void parking_lot_wake(parking_lot_t *lot);
+int parking_lot_wait(parking_lot_t *lot, parking_lot_try_t try_pop, void *ctx,
+                     void *key, int64_t *value, int64_t timeout_ns);
+void parking_lot_destroy(parking_lot_t *lot);
\ No newline at end of file
@@ -0,0 +1,37 @@
+/* The key type of the C priority queues, fixed at compile time.
+ */
+
+#include "pq_key.h"
+#include "utils.h"
+
+#include <stdlib.h>
+
+/** Return the key width in bits, for benchmarks that cannot see the macro.
+ */
+int pq_key_width (void) {
+  return PQ_KEY_BITS;
+}
+
+/** Return a random key, uniform over the non-negative keys below the tail
+ *  sentinel.  Wide keys take more than one draw.
+ */
+pq_key_t pq_key_random (uint64_t *seed) {
+#if PQ_KEY_BITS == 128
+  unsigned __int128 high = fast_rand(seed), low = fast_rand(seed);
+  pq_key_t key = (pq_key_t)(((high << 64) | low) >> 1);
+#else
+  pq_key_t key = (pq_key_t)(fast_rand(seed) >> (65 - PQ_KEY_BITS));
+#endif
+  return key == PQ_KEY_MAX ? key - 1 : key;
+}
+
+static int compare_pq_keys (const void *a, const void *b) {
+  pq_key_t x = *(const pq_key_t*)a, y = *(const pq_key_t*)b;
+  return (x > y) - (x < y);
+}
+
+/** Sort keys ascending, in place.  Used by the add_batch entry points.
+ */
+void pq_key_sort (pq_key_t *keys, size_t n) {
+  qsort(keys, n, sizeof(pq_key_t), compare_pq_keys);
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+/* The key type of the C priority queues, fixed at compile time.
+ * PQ_KEY_BITS picks 32-, 64- or 128-bit signed keys and defaults to 64,
+ * the width the benchmarks are written against.  The build writes the
+ * width into pq_key_bits.h so that C and Def see the same type.  The
+ * largest and smallest keys are reserved for the list sentinels.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#if __has_include("pq_key_bits.h")
+#include "pq_key_bits.h"
+#endif
+
+#ifndef PQ_KEY_BITS
+#define PQ_KEY_BITS 64
+#endif
+
+#if PQ_KEY_BITS == 32
+typedef int32_t pq_key_t;
+#define PQ_KEY_MIN INT32_MIN
+#define PQ_KEY_MAX INT32_MAX
+#elif PQ_KEY_BITS == 64
+typedef int64_t pq_key_t;
+#define PQ_KEY_MIN INT64_MIN
+#define PQ_KEY_MAX INT64_MAX
+#elif PQ_KEY_BITS == 128
+typedef __int128 pq_key_t;
+#define PQ_KEY_MAX ((pq_key_t)(((unsigned __int128)1 << 127) - 1))
+#define PQ_KEY_MIN (-PQ_KEY_MAX - 1)
+#else
+#error "PQ_KEY_BITS must be 32, 64 or 128"
+#endif
+
+int pq_key_width (void);
+pq_key_t pq_key_random (uint64_t *seed);
+void pq_key_sort (pq_key_t *keys, size_t n);
\ No newline at end of file
@@ -0,0 +1,39 @@
+/* One interface over the C priority queues.
+ */
+
+#include "pqueue.h"
+#include "pqueue_static.h"
+
+#include <string.h>
+
+/** Return the ops of a queue, or NULL if it is not built at this key
+ *  width.
+ */
+const pqueue_ops_t * pqueue_ops(pqueue_kind_t kind) {
+  switch(kind) {
+  case PQUEUE_C_SL_PQ: return &pqueue_static_c_sl_pq;
+  case PQUEUE_C_SPRAY: return &pqueue_static_c_spray;
+  case PQUEUE_C_LJ_PQ: return &pqueue_static_c_lj_pq;
+  case PQUEUE_C_HUNT: return &pqueue_static_c_hunt;
+  case PQUEUE_C_MOUNDS: return &pqueue_static_c_mounds;
+#if PQ_KEY_BITS == 64
+  case PQUEUE_C_FHSL_B: return &pqueue_static_c_fhsl_b;
+  case PQUEUE_C_FHSL_FC: return &pqueue_static_c_fhsl_fc;
+  case PQUEUE_C_APQ_SERVER: return &pqueue_static_c_apq_server;
+#endif
+  default: return NULL;
+  }
+}
+
+/** Return the ops of the queue with the given name, as printed by the
+ *  benchmarks, or NULL if there is none at this key width.
+ */
+const pqueue_ops_t * pqueue_ops_by_name(const char *name) {
+  for(int kind = 0; kind < PQUEUE_KINDS; kind++) {
+    const pqueue_ops_t *ops = pqueue_ops(kind);
+    if(ops != NULL && strcmp(ops->name, name) == 0) {
+      return ops;
+    }
+  }
+  return NULL;
+}
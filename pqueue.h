@@ -0,0 +1,58 @@
+#pragma once
+
+/* One interface over the C priority queues.
+ * Every queue is reached through a pqueue_ops_t: the same create, add,
+ * pop_min, peek_min, size and destroy for all of them, each taking a seed
+ * and a thread id whether or not that queue uses them.  pqueue_ops looks a
+ * table up at run time, so each call is an indirect call.  For a hot loop
+ * written against one queue, pqueue_static.h has the same tables as
+ * header-only constants; a loop that takes its table as a constant and is
+ * inlined calls the queue directly.
+ *
+ * The skiplists with int64_t keys (c_fhsl_b, c_fhsl_fc and c_apq_server)
+ * are only available when pq_key_t is 64 bits wide.
+ *
+ * The other C lists have no table, as none can carry an item through a
+ * pop:
+ *  - c_fhsl_lf and c_fhsl_lfc store keys alone, and their pop_min
+ *    returns neither key nor value.
+ *  - c_fhsl_fc_server stores keys alone, its pop_min returns no key, and
+ *    it has no peek_min or size.
+ *  - c_fhsl_tx and c_spray_pq_tx pop without returning the key, have no
+ *    peek_min or size, and need hardware transactions besides.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "pq_key.h"
+
+typedef struct pqueue_ops_t pqueue_ops_t;
+typedef enum pqueue_kind pqueue_kind_t;
+
+enum pqueue_kind {
+  PQUEUE_C_SL_PQ,
+  PQUEUE_C_SPRAY,
+  PQUEUE_C_LJ_PQ,
+  PQUEUE_C_HUNT,
+  PQUEUE_C_MOUNDS,
+  PQUEUE_C_FHSL_B,
+  PQUEUE_C_FHSL_FC,
+  PQUEUE_C_APQ_SERVER,
+  PQUEUE_KINDS
+};
+
+struct pqueue_ops_t {
+  const char *name;
+  // capacity bounds the array heaps; c_apq_server also takes its cutoff
+  // key from it, as capacity / num_threads.
+  void * (*create)(size_t num_threads, size_t capacity);
+  int (*add)(void *pqueue, uint64_t *seed, pq_key_t key, int64_t value, size_t thread_id);
+  int (*pop_min)(void *pqueue, uint64_t *seed, pq_key_t *key, int64_t *value, size_t thread_id);
+  int (*peek_min)(void *pqueue, pq_key_t *key, int64_t *value, size_t thread_id);
+  size_t (*size)(void *pqueue);
+  void (*destroy)(void *pqueue);
+};
+
+const pqueue_ops_t * pqueue_ops(pqueue_kind_t kind);
+const pqueue_ops_t * pqueue_ops_by_name(const char *name);
@@ -0,0 +1,145 @@
+/* Cost of the pqueue.h interface against direct calls.
+ * Each variant fills a fresh queue to size, untimed, then times ops pairs
+ * of add and pop_min on keys drawn from [0, 4 * size].  The direct loop
+ * calls the queue's own functions; the specialised loop is the generic
+ * loop inlined with a constant table from pqueue_static.h; the dynamic
+ * loop is the same generic loop kept out of line and handed the table
+ * from pqueue_ops, so every op is an indirect call.
+ */
+
+#include "pqueue_cost.h"
+#include "pqueue.h"
+#include "pqueue_static.h"
+#include "utils.h"
+
+static inline pq_key_t next_key(uint64_t *seed, int64_t size) {
+  return (pq_key_t)(fast_rand(seed) % (uint64_t)(4 * size + 1));
+}
+
+static void fill(const pqueue_ops_t *ops, void *pqueue, uint64_t *seed, int64_t size) {
+  for(int64_t i = 0; i < size; i++) {
+    ops->add(pqueue, seed, next_key(seed, size), 0, 0);
+  }
+}
+
+/** The loop every variant but direct runs.  Inlined with a constant ops,
+ *  the calls below resolve to the queue's adapters at compile time.
+ */
+static inline __attribute__((always_inline))
+uint64_t run(const pqueue_ops_t *ops, void *pqueue, uint64_t *seed, int64_t size, int64_t n) {
+  pq_key_t key;
+  int64_t value;
+  uint64_t start = read_tsc();
+  for(int64_t i = 0; i < n; i++) {
+    ops->add(pqueue, seed, next_key(seed, size), i, 0);
+    ops->pop_min(pqueue, seed, &key, &value, 0);
+  }
+  return read_tsc() - start;
+}
+
+static __attribute__((noinline))
+uint64_t run_dynamic(const pqueue_ops_t *ops, void *pqueue, uint64_t *seed, int64_t size, int64_t n) {
+  return run(ops, pqueue, seed, size, n);
+}
+
+#define DIRECT(add, pop_min)                             \
+  do {                                                   \
+    uint64_t start = read_tsc();                         \
+    for(int64_t i = 0; i < n; i++) {                     \
+      pq_key_t k = next_key(seed, size);                 \
+      add;                                               \
+      pop_min;                                           \
+    }                                                    \
+    cycles = read_tsc() - start;                         \
+  } while(0)
+
+static uint64_t run_direct(pqueue_kind_t kind, void *pqueue, uint64_t *seed, int64_t size, int64_t n) {
+  pq_key_t key;
+  int64_t value;
+  uint64_t cycles = 0;
+  switch(kind) {
+  case PQUEUE_C_SL_PQ:
+    DIRECT(c_sl_pq_add_item(seed, pqueue, k, i), c_sl_pq_pop_min_item(pqueue, &key, &value));
+    break;
+  case PQUEUE_C_SPRAY:
+    DIRECT(c_spray_pq_add_item(seed, pqueue, k, i), c_spray_pq_pop_min_item(seed, pqueue, &key, &value));
+    break;
+  case PQUEUE_C_LJ_PQ:
+    DIRECT(c_lj_pq_add_item(seed, pqueue, k, i), c_lj_pq_pop_min_item(pqueue, &key, &value));
+    break;
+  case PQUEUE_C_HUNT:
+    DIRECT(c_hunt_pq_add_item(pqueue, k, i), c_hunt_pq_pop_min_item(pqueue, &key, &value));
+    break;
+  case PQUEUE_C_MOUNDS:
+    DIRECT(c_mound_pq_add_item(seed, pqueue, k, i), c_mound_pq_pop_min_item(pqueue, &key, &value));
+    break;
+#if PQ_KEY_BITS == 64
+  case PQUEUE_C_FHSL_B:
+    DIRECT(c_fhsl_b_add_item(seed, pqueue, k, i), c_fhsl_b_pop_min_item(pqueue, &key, &value));
+    break;
+  case PQUEUE_C_FHSL_FC:
+    DIRECT(c_fhsl_fc_add_item(pqueue, k, i, 0), c_fhsl_fc_pop_min_item(pqueue, &key, &value, 0));
+    break;
+  case PQUEUE_C_APQ_SERVER:
+    DIRECT(c_apq_server_add_item(seed, pqueue, k, i, 0), c_apq_server_pop_min_item(pqueue, &key, &value, 0));
+    break;
+#endif
+  default:
+    break;
+  }
+  return cycles;
+}
+
+static uint64_t run_specialised(pqueue_kind_t kind, void *pqueue, uint64_t *seed, int64_t size, int64_t n) {
+  switch(kind) {
+  case PQUEUE_C_SL_PQ: return run(&pqueue_static_c_sl_pq, pqueue, seed, size, n);
+  case PQUEUE_C_SPRAY: return run(&pqueue_static_c_spray, pqueue, seed, size, n);
+  case PQUEUE_C_LJ_PQ: return run(&pqueue_static_c_lj_pq, pqueue, seed, size, n);
+  case PQUEUE_C_HUNT: return run(&pqueue_static_c_hunt, pqueue, seed, size, n);
+  case PQUEUE_C_MOUNDS: return run(&pqueue_static_c_mounds, pqueue, seed, size, n);
+#if PQ_KEY_BITS == 64
+  case PQUEUE_C_FHSL_B: return run(&pqueue_static_c_fhsl_b, pqueue, seed, size, n);
+  case PQUEUE_C_FHSL_FC: return run(&pqueue_static_c_fhsl_fc, pqueue, seed, size, n);
+  case PQUEUE_C_APQ_SERVER: return run(&pqueue_static_c_apq_server, pqueue, seed, size, n);
+#endif
+  default: return 0;
+  }
+}
+
+/** Return the number of queue kinds, built or not.
+ */
+int pqueue_cost_kinds (void) {
+  return PQUEUE_KINDS;
+}
+
+/** Return the name of a queue, or NULL if it is not built at this key
+ *  width.
+ */
+const char * pqueue_cost_name (int kind) {
+  const pqueue_ops_t *ops = pqueue_ops(kind);
+  return ops == NULL ? NULL : ops->name;
+}
+
+/** Store the cycles per add and pop_min pair for each way of calling the
+ *  queue of the given kind, with size items in it.
+ */
+void pqueue_cost (int kind, int64_t size, int64_t ops,
+                  double *direct, double *specialised, double *dynamic) {
+  const pqueue_ops_t *table = pqueue_ops(kind);
+  uint64_t seed = read_tsc();
+  double *results[3] = { direct, specialised, dynamic };
+  for(int variant = 0; variant < 3; variant++) {
+    void *pqueue = table->create(1, size + ops);
+    fill(table, pqueue, &seed, size);
+    uint64_t cycles;
+    if(variant == 0) {
+      cycles = run_direct(kind, pqueue, &seed, size, ops);
+    } else if(variant == 1) {
+      cycles = run_specialised(kind, pqueue, &seed, size, ops);
+    } else {
+      cycles = run_dynamic(table, pqueue, &seed, size, ops);
+    }
+    *results[variant] = (double)cycles / ops;
+    table->destroy(pqueue);
+  }
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+/* Cost of the pqueue.h interface against direct calls, for micro_bench.
+ * Kinds are the pqueue_kind_t values, passed as plain ints so that the
+ * header can be imported without the ops table types.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+int pqueue_cost_kinds (void);
+const char * pqueue_cost_name (int kind);
+void pqueue_cost (int kind, int64_t size, int64_t ops,
+                  double *direct, double *specialised, double *dynamic);
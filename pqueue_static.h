@@ -0,0 +1,217 @@
+#pragma once
+
+/* Header-only pqueue_ops_t tables, one per C priority queue.
+ * The adapters are static inline and the tables are constants, so a loop
+ * that is handed &pqueue_static_c_sl_pq (say) and inlined where it is used
+ * resolves every op at compile time: no indirect call, no switch.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "pqueue.h"
+#include "c_sl_pq.h"
+#include "c_spray_pq.h"
+#include "c_lj_pq.h"
+#include "c_hunt_heap.h"
+#include "c_mounds.h"
+#if PQ_KEY_BITS == 64
+#include "c_fhsl_b.h"
+#include "c_fhsl_fc.h"
+#include "c_apq_server.h"
+#endif
+
+// c_sl_pq: lock-free, seeded adds.
+static inline void *pqueue_c_sl_pq_create(size_t num_threads, size_t capacity) {
+  return c_sl_pq_create();
+}
+static inline int pqueue_c_sl_pq_add(void *pqueue, uint64_t *seed, pq_key_t key, int64_t value, size_t thread_id) {
+  return c_sl_pq_add_item(seed, pqueue, key, value);
+}
+static inline int pqueue_c_sl_pq_pop_min(void *pqueue, uint64_t *seed, pq_key_t *key, int64_t *value, size_t thread_id) {
+  return c_sl_pq_pop_min_item(pqueue, key, value);
+}
+static inline int pqueue_c_sl_pq_peek_min(void *pqueue, pq_key_t *key, int64_t *value, size_t thread_id) {
+  return c_sl_pq_peek_min(pqueue, key, value);
+}
+static inline size_t pqueue_c_sl_pq_size(void *pqueue) {
+  return c_sl_pq_size(pqueue);
+}
+static inline void pqueue_c_sl_pq_destroy(void *pqueue) {
+  c_sl_pq_destroy(pqueue);
+}
+static const pqueue_ops_t pqueue_static_c_sl_pq = {
+  "c_sl_pq", pqueue_c_sl_pq_create, pqueue_c_sl_pq_add, pqueue_c_sl_pq_pop_min,
+  pqueue_c_sl_pq_peek_min, pqueue_c_sl_pq_size, pqueue_c_sl_pq_destroy
+};
+
+// c_spray_pq: seeded adds and pops, shaped for num_threads.
+static inline void *pqueue_c_spray_create(size_t num_threads, size_t capacity) {
+  return c_spray_pq_create(num_threads);
+}
+static inline int pqueue_c_spray_add(void *pqueue, uint64_t *seed, pq_key_t key, int64_t value, size_t thread_id) {
+  return c_spray_pq_add_item(seed, pqueue, key, value);
+}
+static inline int pqueue_c_spray_pop_min(void *pqueue, uint64_t *seed, pq_key_t *key, int64_t *value, size_t thread_id) {
+  return c_spray_pq_pop_min_item(seed, pqueue, key, value);
+}
+static inline int pqueue_c_spray_peek_min(void *pqueue, pq_key_t *key, int64_t *value, size_t thread_id) {
+  return c_spray_pq_peek_min(pqueue, key, value);
+}
+static inline size_t pqueue_c_spray_size(void *pqueue) {
+  return c_spray_pq_size(pqueue);
+}
+static inline void pqueue_c_spray_destroy(void *pqueue) {
+  c_spray_pq_destroy(pqueue);
+}
+static const pqueue_ops_t pqueue_static_c_spray = {
+  "c_spray", pqueue_c_spray_create, pqueue_c_spray_add, pqueue_c_spray_pop_min,
+  pqueue_c_spray_peek_min, pqueue_c_spray_size, pqueue_c_spray_destroy
+};
+
+// c_lj_pq: seeded adds; the bound offset follows the thread count, as in
+// priority_bench.
+static inline void *pqueue_c_lj_pq_create(size_t num_threads, size_t capacity) {
+  return c_lj_pq_create(num_threads);
+}
+static inline int pqueue_c_lj_pq_add(void *pqueue, uint64_t *seed, pq_key_t key, int64_t value, size_t thread_id) {
+  return c_lj_pq_add_item(seed, pqueue, key, value);
+}
+static inline int pqueue_c_lj_pq_pop_min(void *pqueue, uint64_t *seed, pq_key_t *key, int64_t *value, size_t thread_id) {
+  return c_lj_pq_pop_min_item(pqueue, key, value);
+}
+static inline int pqueue_c_lj_pq_peek_min(void *pqueue, pq_key_t *key, int64_t *value, size_t thread_id) {
+  return c_lj_pq_peek_min(pqueue, key, value);
+}
+static inline size_t pqueue_c_lj_pq_size(void *pqueue) {
+  return c_lj_pq_size(pqueue);
+}
+static inline void pqueue_c_lj_pq_destroy(void *pqueue) {
+  c_lj_pq_destroy(pqueue);
+}
+static const pqueue_ops_t pqueue_static_c_lj_pq = {
+  "c_lj_pq", pqueue_c_lj_pq_create, pqueue_c_lj_pq_add, pqueue_c_lj_pq_pop_min,
+  pqueue_c_lj_pq_peek_min, pqueue_c_lj_pq_size, pqueue_c_lj_pq_destroy
+};
+
+// c_hunt_pq: array heap of capacity items.
+static inline void *pqueue_c_hunt_create(size_t num_threads, size_t capacity) {
+  return c_hunt_pq_create(capacity + 1);
+}
+static inline int pqueue_c_hunt_add(void *pqueue, uint64_t *seed, pq_key_t key, int64_t value, size_t thread_id) {
+  return c_hunt_pq_add_item(pqueue, key, value);
+}
+static inline int pqueue_c_hunt_pop_min(void *pqueue, uint64_t *seed, pq_key_t *key, int64_t *value, size_t thread_id) {
+  return c_hunt_pq_pop_min_item(pqueue, key, value);
+}
+static inline int pqueue_c_hunt_peek_min(void *pqueue, pq_key_t *key, int64_t *value, size_t thread_id) {
+  return c_hunt_pq_peek_min(pqueue, key, value);
+}
+static inline size_t pqueue_c_hunt_size(void *pqueue) {
+  return c_hunt_pq_size(pqueue);
+}
+static inline void pqueue_c_hunt_destroy(void *pqueue) {
+  c_hunt_pq_destroy(pqueue);
+}
+static const pqueue_ops_t pqueue_static_c_hunt = {
+  "c_hunt", pqueue_c_hunt_create, pqueue_c_hunt_add, pqueue_c_hunt_pop_min,
+  pqueue_c_hunt_peek_min, pqueue_c_hunt_size, pqueue_c_hunt_destroy
+};
+
+// c_mound_pq: tree of sorted lists, room for capacity items.
+static inline void *pqueue_c_mounds_create(size_t num_threads, size_t capacity) {
+  return c_mound_pq_create(capacity + 1);
+}
+static inline int pqueue_c_mounds_add(void *pqueue, uint64_t *seed, pq_key_t key, int64_t value, size_t thread_id) {
+  return c_mound_pq_add_item(seed, pqueue, key, value);
+}
+static inline int pqueue_c_mounds_pop_min(void *pqueue, uint64_t *seed, pq_key_t *key, int64_t *value, size_t thread_id) {
+  return c_mound_pq_pop_min_item(pqueue, key, value);
+}
+static inline int pqueue_c_mounds_peek_min(void *pqueue, pq_key_t *key, int64_t *value, size_t thread_id) {
+  return c_mound_pq_peek_min(pqueue, key, value);
+}
+static inline size_t pqueue_c_mounds_size(void *pqueue) {
+  return c_mound_pq_size(pqueue);
+}
+static inline void pqueue_c_mounds_destroy(void *pqueue) {
+  c_mound_pq_destroy(pqueue);
+}
+static const pqueue_ops_t pqueue_static_c_mounds = {
+  "c_mounds", pqueue_c_mounds_create, pqueue_c_mounds_add, pqueue_c_mounds_pop_min,
+  pqueue_c_mounds_peek_min, pqueue_c_mounds_size, pqueue_c_mounds_destroy
+};
+
+#if PQ_KEY_BITS == 64
+// c_fhsl_b: blocking skiplist, seeded adds.
+static inline void *pqueue_c_fhsl_b_create(size_t num_threads, size_t capacity) {
+  return c_fhsl_b_create();
+}
+static inline int pqueue_c_fhsl_b_add(void *pqueue, uint64_t *seed, pq_key_t key, int64_t value, size_t thread_id) {
+  return c_fhsl_b_add_item(seed, pqueue, key, value);
+}
+static inline int pqueue_c_fhsl_b_pop_min(void *pqueue, uint64_t *seed, pq_key_t *key, int64_t *value, size_t thread_id) {
+  return c_fhsl_b_pop_min_item(pqueue, key, value);
+}
+static inline int pqueue_c_fhsl_b_peek_min(void *pqueue, pq_key_t *key, int64_t *value, size_t thread_id) {
+  return c_fhsl_b_peek_min(pqueue, key, value);
+}
+static inline size_t pqueue_c_fhsl_b_size(void *pqueue) {
+  return c_fhsl_b_size(pqueue);
+}
+static inline void pqueue_c_fhsl_b_destroy(void *pqueue) {
+  c_fhsl_b_destroy(pqueue);
+}
+static const pqueue_ops_t pqueue_static_c_fhsl_b = {
+  "c_fhsl_b", pqueue_c_fhsl_b_create, pqueue_c_fhsl_b_add, pqueue_c_fhsl_b_pop_min,
+  pqueue_c_fhsl_b_peek_min, pqueue_c_fhsl_b_size, pqueue_c_fhsl_b_destroy
+};
+
+// c_fhsl_fc: flat combining, one slot per thread id.
+static inline void *pqueue_c_fhsl_fc_create(size_t num_threads, size_t capacity) {
+  return c_fhsl_fc_create(num_threads);
+}
+static inline int pqueue_c_fhsl_fc_add(void *pqueue, uint64_t *seed, pq_key_t key, int64_t value, size_t thread_id) {
+  return c_fhsl_fc_add_item(pqueue, key, value, thread_id);
+}
+static inline int pqueue_c_fhsl_fc_pop_min(void *pqueue, uint64_t *seed, pq_key_t *key, int64_t *value, size_t thread_id) {
+  return c_fhsl_fc_pop_min_item(pqueue, key, value, thread_id);
+}
+static inline int pqueue_c_fhsl_fc_peek_min(void *pqueue, pq_key_t *key, int64_t *value, size_t thread_id) {
+  return c_fhsl_fc_peek_min(pqueue, key, value, thread_id);
+}
+static inline size_t pqueue_c_fhsl_fc_size(void *pqueue) {
+  return c_fhsl_fc_size(pqueue);
+}
+static inline void pqueue_c_fhsl_fc_destroy(void *pqueue) {
+  c_fhsl_fc_destroy(pqueue);
+}
+static const pqueue_ops_t pqueue_static_c_fhsl_fc = {
+  "c_fhsl_fc", pqueue_c_fhsl_fc_create, pqueue_c_fhsl_fc_add, pqueue_c_fhsl_fc_pop_min,
+  pqueue_c_fhsl_fc_peek_min, pqueue_c_fhsl_fc_size, pqueue_c_fhsl_fc_destroy
+};
+
+// c_apq_server: server thread, seeded adds, one slot per thread id.
+static inline void *pqueue_c_apq_server_create(size_t num_threads, size_t capacity) {
+  return c_apq_server_create(num_threads, capacity / num_threads);
+}
+static inline int pqueue_c_apq_server_add(void *pqueue, uint64_t *seed, pq_key_t key, int64_t value, size_t thread_id) {
+  return c_apq_server_add_item(seed, pqueue, key, value, thread_id);
+}
+static inline int pqueue_c_apq_server_pop_min(void *pqueue, uint64_t *seed, pq_key_t *key, int64_t *value, size_t thread_id) {
+  return c_apq_server_pop_min_item(pqueue, key, value, thread_id);
+}
+static inline int pqueue_c_apq_server_peek_min(void *pqueue, pq_key_t *key, int64_t *value, size_t thread_id) {
+  return c_apq_server_peek_min(pqueue, key, value, thread_id);
+}
+static inline size_t pqueue_c_apq_server_size(void *pqueue) {
+  return c_apq_server_size(pqueue);
+}
+static inline void pqueue_c_apq_server_destroy(void *pqueue) {
+  c_apq_server_destroy(pqueue);
+}
+static const pqueue_ops_t pqueue_static_c_apq_server = {
+  "c_apq_server", pqueue_c_apq_server_create, pqueue_c_apq_server_add, pqueue_c_apq_server_pop_min,
+  pqueue_c_apq_server_peek_min, pqueue_c_apq_server_size, pqueue_c_apq_server_destroy
+};
+#endif
@@ -0,0 +1,81 @@
+/* A counter split into per-thread shards, each on its own cache line.
+ */
+
+#include "sharded_counter.h"
+
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+
+typedef struct shard_t shard_t;
+
+struct shard_t {
+  alignas(128) _Atomic(int64_t) value;
+};
+
+struct sharded_counter_t {
+  size_t num_shards;
+  shard_t *shards;
+};
+
+// Shards handed out to threads by sharded_counter_add_local, in order.
+static _Atomic(size_t) next_local_shard = 0;
+static _Thread_local size_t local_shard = SIZE_MAX;
+
+/** Return a new counter, at zero, with num_shards shards.
+ */
+sharded_counter_t * sharded_counter_create(size_t num_shards) {
+  sharded_counter_t *counter = malloc(sizeof(sharded_counter_t));
+  counter->num_shards = num_shards;
+  counter->shards = aligned_alloc(alignof(shard_t), sizeof(shard_t) * num_shards);
+  for(size_t i = 0; i < num_shards; i++) {
+    atomic_store_explicit(&counter->shards[i].value, 0, memory_order_relaxed);
+  }
+  return counter;
+}
+
+/** Add delta to the given shard.  Each shard has a single writer, so a
+ *  plain load and store is enough.
+ */
+void sharded_counter_add(sharded_counter_t *counter, size_t shard, int64_t delta) {
+  _Atomic(int64_t) *value = &counter->shards[shard % counter->num_shards].value;
+  atomic_store_explicit(value,
+    atomic_load_explicit(value, memory_order_relaxed) + delta,
+    memory_order_relaxed);
+}
+
+/** Add delta to the calling thread's shard.  The thread takes the next
+ *  free shard the first time it calls in; threads past the shard count wrap
+ *  around and share, hence the atomic add.
+ */
+void sharded_counter_add_local(sharded_counter_t *counter, int64_t delta) {
+  if(local_shard == SIZE_MAX) {
+    local_shard = atomic_fetch_add_explicit(&next_local_shard, 1, memory_order_relaxed);
+  }
+  atomic_fetch_add_explicit(&counter->shards[local_shard % counter->num_shards].value,
+    delta, memory_order_relaxed);
+}
+
+/** Return the sum of all shards.
+ */
+int64_t sharded_counter_read(sharded_counter_t *counter) {
+  int64_t sum = 0;
+  for(size_t i = 0; i < counter->num_shards; i++) {
+    sum += atomic_load_explicit(&counter->shards[i].value, memory_order_relaxed);
+  }
+  return sum;
+}
+
+/** Return the sum of all shards as a size.  A read that races an add on one
+ *  shard and the matching removal on another can dip below zero; that reads
+ *  as empty.
+ */
+size_t sharded_counter_read_size(sharded_counter_t *counter) {
+  int64_t sum = sharded_counter_read(counter);
+  return sum < 0 ? 0 : sum;
+}
+
+void sharded_counter_destroy(sharded_counter_t *counter) {
+  free(counter->shards);
+  free(counter);
+}
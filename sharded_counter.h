@@ -0,0 +1,26 @@
+#pragma once
+
+/* A counter split into per-thread shards, each on its own cache line.
+ * Updates touch only the caller's shard, so they never contend.  A read
+ * sums every shard without synchronizing with writers: the result is exact
+ * at quiescence and otherwise only approximate.
+ *
+ * Callers without a thread id of their own use the _local calls, which pick
+ * a shard per thread the first time it asks.  Those shards may be shared
+ * once more threads than shards have asked, so local adds are atomic.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define SHARDED_COUNTER_LOCAL_SHARDS 64
+
+typedef struct sharded_counter_t sharded_counter_t;
+
+sharded_counter_t * sharded_counter_create(size_t num_shards);
+
+void sharded_counter_add(sharded_counter_t *counter, size_t shard, int64_t delta);
+void sharded_counter_add_local(sharded_counter_t *counter, int64_t delta);
+int64_t sharded_counter_read(sharded_counter_t *counter);
+size_t sharded_counter_read_size(sharded_counter_t *counter);
+void sharded_counter_destroy(sharded_counter_t *counter);
@@ -117,4 +117,20 @@ int pin_thread(thread_pinner_t * thread_pinner, pthread_t thread) {
       thread)) { return 0; }
   }
   return 1;
+}
+
+/** Return the size in bytes of the level (1 = L1d, 2 = L2, 3 = L3) cache
+ *  seen by the first processor, or 0 if there is no such cache.
+ */
+uint64_t get_cache_size(int level) {
+  if(!cpuinfo_initialize()) { return 0; }
+  const struct cpuinfo_processor *processor = cpuinfo_get_processor(0);
+  const struct cpuinfo_cache *cache = NULL;
+  switch(level) {
+    case 1: cache = processor->cache.l1d; break;
+    case 2: cache = processor->cache.l2; break;
+    case 3: cache = processor->cache.l3; break;
+    default: break;
+  }
+  return cache == NULL ? 0 : cache->size;
 }
\ No newline at end of file
@@ -1,7 +1,9 @@
 #include <pthread.h>
+#include <stdint.h>
 
 typedef struct thread_pinner_t thread_pinner_t;
 
 thread_pinner_t * thread_pinner_create();
 int get_num_cores();
-int pin_thread(thread_pinner_t *thread_pinner, pthread_t thread);
\ No newline at end of file
+int pin_thread(thread_pinner_t *thread_pinner, pthread_t thread);
+uint64_t get_cache_size(int level);
\ No newline at end of file
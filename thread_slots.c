@@ -0,0 +1,95 @@
+/* Slot allocation for structures that keep per-thread state in an array.
+ */
+
+#include "thread_slots.h"
+
+#include <stdatomic.h>
+#include <stdlib.h>
+
+struct thread_slots_t {
+  size_t capacity;
+  // Bit i of word w is set while slot 64w + i is registered.
+  _Atomic(uint64_t) *words;
+};
+
+static size_t num_words(size_t capacity) {
+  return (capacity + 63) / 64;
+}
+
+/** Return a new allocator for capacity slots, with slots 0 to
+ *  registered - 1 already taken.  Structures created for a fixed thread
+ *  count register all of them, so callers that pass dense thread ids
+ *  without registering keep working.
+ */
+thread_slots_t * thread_slots_create(size_t capacity, size_t registered) {
+  thread_slots_t *slots = malloc(sizeof(thread_slots_t));
+  slots->capacity = capacity;
+  slots->words = malloc(sizeof(_Atomic(uint64_t)) * num_words(capacity));
+  for(size_t i = 0; i < num_words(capacity); i++) {
+    uint64_t bits = 0;
+    if(registered >= (i + 1) * 64) {
+      bits = UINT64_MAX;
+    } else if(registered > i * 64) {
+      bits = (UINT64_C(1) << (registered - i * 64)) - 1;
+    }
+    atomic_store_explicit(&slots->words[i], bits, memory_order_relaxed);
+  }
+  return slots;
+}
+
+/** Take the lowest free slot and return it, or SIZE_MAX if every slot is
+ *  taken.  Taking the lowest keeps the registered slots packed at the front
+ *  of the array, so a scan touches few words.
+ */
+size_t thread_slots_register(thread_slots_t *slots) {
+  for(size_t i = 0; i < num_words(slots->capacity); i++) {
+    uint64_t bits = atomic_load_explicit(&slots->words[i], memory_order_relaxed);
+    while(bits != UINT64_MAX) {
+      size_t bit = __builtin_ctzll(~bits);
+      if(i * 64 + bit >= slots->capacity) {
+        return SIZE_MAX;
+      }
+      if(atomic_compare_exchange_weak_explicit(&slots->words[i], &bits, bits | (UINT64_C(1) << bit),
+                                               memory_order_acq_rel, memory_order_relaxed)) {
+        return i * 64 + bit;
+      }
+    }
+  }
+  return SIZE_MAX;
+}
+
+/** Hand slot back.  Whatever the slot's owner left in the structure's
+ *  per-thread state is inherited by the next thread to register.
+ */
+void thread_slots_unregister(thread_slots_t *slots, size_t slot) {
+  atomic_fetch_and_explicit(&slots->words[slot / 64], ~(UINT64_C(1) << (slot % 64)),
+                            memory_order_release);
+}
+
+/** Return the number of bitmap words, for a scan with thread_slots_word.
+ */
+size_t thread_slots_words(thread_slots_t *slots) {
+  return num_words(slots->capacity);
+}
+
+/** Return the registered bits of slots 64 * word to 64 * word + 63.  A
+ *  slot registered or unregistered during a scan may or may not be seen.
+ */
+uint64_t thread_slots_word(thread_slots_t *slots, size_t word) {
+  return atomic_load_explicit(&slots->words[word], memory_order_acquire);
+}
+
+/** Return the number of registered slots.  Exact only at quiescence.
+ */
+size_t thread_slots_count(thread_slots_t *slots) {
+  size_t count = 0;
+  for(size_t i = 0; i < num_words(slots->capacity); i++) {
+    count += __builtin_popcountll(atomic_load_explicit(&slots->words[i], memory_order_relaxed));
+  }
+  return count;
+}
+
+void thread_slots_destroy(thread_slots_t *slots) {
+  free(slots->words);
+  free(slots);
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+/* Slot allocation for structures that keep per-thread state in an array.
+ * A thread registers to take the lowest free slot, which it then passes
+ * as its thread id, and unregisters to hand the slot back.  Registered
+ * slots are tracked in a bitmap, one word per 64 slots, so scans over the
+ * array can visit only the slots in use.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef struct thread_slots_t thread_slots_t;
+
+thread_slots_t * thread_slots_create(size_t capacity, size_t registered);
+
+size_t thread_slots_register(thread_slots_t *slots);
+void thread_slots_unregister(thread_slots_t *slots, size_t slot);
+size_t thread_slots_words(thread_slots_t *slots);
+uint64_t thread_slots_word(thread_slots_t *slots, size_t word);
+size_t thread_slots_count(thread_slots_t *slots);
+void thread_slots_destroy(thread_slots_t *slots);
@@ -1,9 +1,16 @@
 #include "utils.h"
 
+#include <immintrin.h>
+#include <malloc.h>
+
 uint64_t* fetch_and_or(uint64_t* ptr, uint64_t mark) {
   return (uint64_t*)__sync_fetch_and_or(ptr, mark);
 }
 
+int64_t fetch_and_add(int64_t* ptr, int64_t delta) {
+  return __sync_fetch_and_add(ptr, delta);
+}
+
 uint64_t fast_rand (uint64_t *seed){
   uint64_t val = *seed;
   if(val == 0) {
@@ -22,4 +29,13 @@ int32_t random_level (uint64_t *seed, int32_t max) {
     level++;
   }
   return level - 1;
-}
\ No newline at end of file
+}
+
+uint64_t read_tsc (void) {
+  return __rdtsc();
+}
+
+uint64_t heap_in_use (void) {
+  struct mallinfo2 info = mallinfo2();
+  return info.uordblks + info.hblkhd;
+}
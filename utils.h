@@ -1,7 +1,26 @@
 #pragma once
 
 #include <stdint.h>
+#include <stddef.h>
+
+/* Tallest tower the C skiplists build, fixed at compile time.  Each level
+ * holds about half the nodes of the one below, so the default of 20 keeps
+ * searches logarithmic to about 2^20 items.  Queues known to stay small
+ * can be built lower, down to 8 for a head tower that fits in one cache
+ * line.  The build writes the height into skiplist_height.h.
+ */
+#if __has_include("skiplist_height.h")
+#include "skiplist_height.h"
+#endif
+
+#ifndef SKIPLIST_HEIGHT
+#define SKIPLIST_HEIGHT 20
+#endif
 
 uint64_t* fetch_and_or(uint64_t *, uint64_t);
+int64_t fetch_and_add(int64_t *, int64_t);
 uint64_t fast_rand (uint64_t *seed);
-int32_t random_level (uint64_t *seed, int32_t max);
\ No newline at end of file
+int32_t random_level (uint64_t *seed, int32_t max);
+uint64_t read_tsc (void);
+uint64_t heap_in_use (void);
+void sort_keys (int64_t *keys, size_t n);
\ No newline at end of file